@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+uint64_t heap_allocation_count();
+
+struct ArenaStats {
+    uint64_t allocations;
+    uint64_t overflows;
+    uint64_t grows;
+    std::size_t peak_bytes;
+};
+
+class FrameArena : public std::pmr::memory_resource {
+public:
+    static constexpr std::size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    explicit FrameArena(std::size_t new_capacity = DEFAULT_CAPACITY);
+
+    void rewind();
+    std::size_t used() const { return offset + overflow_bytes; }
+    std::size_t capacity() const { return size; }
+
+    const ArenaStats &get_stats() const { return stats; }
+    void reset_stats() { stats = {}; }
+
+private:
+    struct Overflow {
+	void *pointer;
+	std::size_t bytes;
+	std::size_t alignment;
+    };
+
+    std::unique_ptr<std::byte[]> buffer;
+    std::size_t size;
+    std::size_t offset = 0;
+    std::size_t overflow_bytes = 0;
+    std::vector<Overflow> overflows;
+    ArenaStats stats {};
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+struct QuadVertex {
+    glm::vec2 pos;
+    glm::vec2 uv;
+    uint32_t color;
+};
+
+struct QuadBatch {
+    uint16_t layer;
+    uint16_t pipeline;
+    uint32_t texture;
+    uint32_t first_quad;
+    uint32_t quad_count;
+};
+
+struct BatchStats {
+    uint64_t frames;
+    uint64_t quads;
+    uint64_t batches;
+    uint64_t dropped;
+};
+
+class QuadBatcher {
+public:
+    static constexpr uint32_t VERTICES_PER_QUAD = 4;
+    static constexpr uint32_t INDICES_PER_QUAD = 6;
+
+    static std::vector<uint32_t> quad_indices(uint32_t quad_count);
+
+    void add(uint16_t layer, uint16_t pipeline, uint32_t texture, const glm::vec2 &min, const glm::vec2 &max, const glm::vec4 &color, const glm::vec2 &uv_min = glm::vec2(0.0f), const glm::vec2 &uv_max = glm::vec2(1.0f));
+    const std::vector<QuadBatch> &flush(QuadVertex *vertices, uint32_t capacity);
+    std::size_t size() const { return quads.size(); }
+    void clear() { quads.clear(); }
+
+    const BatchStats &get_stats() const { return stats; }
+    void reset_stats() { stats = {}; }
+
+private:
+    struct Quad {
+	uint64_t key;
+	glm::vec2 min, max;
+	glm::vec2 uv_min, uv_max;
+	uint32_t color;
+    };
+
+    std::vector<Quad> quads;
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    std::vector<QuadBatch> batches;
+    BatchStats stats {};
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB transformed(const glm::mat4 &transform) const;
+};
+
+struct BVHNode {
+    glm::vec3 min;
+    uint32_t right_or_first;
+    glm::vec3 max;
+    uint32_t count;
+};
+
+static_assert(sizeof(BVHNode) == 32);
+
+struct Frustum {
+    alignas(32) std::array<float, 8> nx, ny, nz, nw;
+
+    static Frustum from_matrix(const glm::mat4 &clip);
+};
+
+class BVH {
+public:
+    static constexpr uint32_t LEAF_SIZE = 4;
+    static constexpr uint32_t STACK_SIZE = 64;
+
+    void build(const std::vector<AABB> &bounds);
+    void assign(const BVHNode *new_nodes, std::size_t node_count, const uint32_t *new_indices, const std::vector<AABB> &bounds);
+    void refit(const std::vector<AABB> &bounds);
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible);
+
+    const std::vector<BVHNode> &get_nodes() const { return nodes; }
+    const std::vector<uint32_t> &get_indices() const { return indices; }
+
+private:
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> indices;
+    std::vector<AABB> leaf_bounds;
+    std::vector<uint32_t> tasks, next_tasks;
+    std::vector<std::vector<uint32_t>> task_visible;
+
+    void emit_subtree(uint32_t node, std::vector<uint32_t> &visible) const;
+    void cull_leaf(const Frustum &frustum, const BVHNode &leaf, std::vector<uint32_t> &visible) const;
+    void cull_subtree(const Frustum &frustum, uint32_t node, std::vector<uint32_t> &visible) const;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat {
+    PPM,
+    RAW,
+};
+
+struct CaptureFrame {
+    std::size_t slot;
+    uint64_t index;
+    const uint8_t *pixels;
+    uint32_t width, height;
+    bool bgra;
+};
+
+class CaptureWriter {
+public:
+    CaptureWriter(std::string new_directory, CaptureFormat new_format, std::size_t slot_count);
+    ~CaptureWriter();
+
+    static CaptureFormat parse_format(const char *name);
+
+    bool slot_busy(std::size_t slot) const { return busy.at(slot).load(std::memory_order_acquire); }
+    void submit(const CaptureFrame &frame);
+    void drop() { dropped.fetch_add(1, std::memory_order_relaxed); }
+    void drain();
+    void report(std::ostream &out) const;
+
+private:
+    std::string directory;
+    CaptureFormat format;
+    std::vector<std::atomic<bool>> busy;
+
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable queue_cv, idle_cv;
+    std::deque<CaptureFrame> queue;
+    bool writing = false, stopping = false;
+    std::vector<uint8_t> row;
+
+    std::atomic<uint64_t> written = 0, dropped = 0, bytes = 0;
+    unsigned long long first_submit = 0, last_write = 0;
+
+    void run();
+    void write(const CaptureFrame &frame);
+};
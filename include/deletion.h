@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+struct DeletionStats {
+    uint64_t retired;
+    uint64_t destroyed;
+    std::size_t peak_pending;
+};
+
+class DeletionQueue {
+public:
+    void init(VkDevice new_device) { device = new_device; }
+
+    template <typename T>
+    void retire(uint64_t frame, VkObjectType type, T handle) {
+	retire_raw(frame, type, reinterpret_cast<uint64_t>(handle));
+    }
+
+    void retire_raw(uint64_t frame, VkObjectType type, uint64_t handle);
+    void retire_command_buffers(uint64_t frame, VkCommandPool pool, std::vector<VkCommandBuffer> command_buffers);
+    std::size_t collect(uint64_t completed_frame);
+    std::size_t flush();
+
+    std::size_t pending() const { return entries.size(); }
+    const DeletionStats &get_stats() const { return stats; }
+
+private:
+    struct Entry {
+	uint64_t frame;
+	VkObjectType type;
+	uint64_t handle;
+	std::vector<VkCommandBuffer> command_buffers;
+    };
+
+    void destroy(Entry &entry);
+
+    VkDevice device = VK_NULL_HANDLE;
+    std::deque<Entry> entries;
+    DeletionStats stats {};
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+static constexpr uint32_t NO_QUEUE_FAMILY = UINT32_MAX;
+
+struct QueueTopology {
+    uint32_t graphics = NO_QUEUE_FAMILY;
+    uint32_t present = NO_QUEUE_FAMILY;
+    uint32_t transfer = NO_QUEUE_FAMILY;
+    uint32_t compute = NO_QUEUE_FAMILY;
+    bool timestamps = false;
+
+    bool dedicated_transfer() const { return transfer != graphics; }
+    bool async_compute() const { return compute != graphics; }
+};
+
+struct DeviceCandidate {
+    VkPhysicalDevice device;
+    uint32_t index;
+    std::string name;
+    VkPhysicalDeviceType type;
+    VkDeviceSize local_memory;
+    QueueTopology queues;
+    int64_t score;
+    std::string rejection;
+};
+
+const char *device_type_name(VkPhysicalDeviceType type);
+QueueTopology find_queue_topology(VkPhysicalDevice device, VkSurfaceKHR surface, std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+DeviceCandidate evaluate_device(VkPhysicalDevice device, uint32_t index, VkSurfaceKHR surface, const std::vector<const char*> &required_extensions, std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+std::size_t choose_device(const std::vector<DeviceCandidate> &candidates, const char *override_spec);
+void print_device_candidates(const std::vector<DeviceCandidate> &candidates, std::ostream &out);
+void print_queue_topology(const DeviceCandidate &candidate, std::ostream &out);
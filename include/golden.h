@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RGBImage {
+    uint32_t width = 0, height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+struct ImageDifference {
+    double mean_delta_e;
+    double max_delta_e;
+    std::size_t perceptible;
+    std::size_t pixels;
+
+    double perceptible_fraction() const { return pixels ? static_cast<double>(perceptible) / static_cast<double>(pixels) : 0.0; }
+};
+
+static constexpr double PERCEPTIBLE_DELTA_E = 2.3;
+
+RGBImage read_ppm(const std::string &path);
+void write_ppm(const std::string &path, const RGBImage &image);
+ImageDifference compare_images(const RGBImage &actual, const RGBImage &expected, RGBImage *diff = nullptr);
@@ -1,8 +1,17 @@
+#pragma once
+
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
 #include <vector>
 #include <array>
 #include <set>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include <limits>
 
 #include <chrono>
 
@@ -13,68 +22,205 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/glm.hpp>
 
+#include "registry.h"
+#include "deletion.h"
+#include "trace.h"
+#include "capture.h"
+#include "device.h"
+#include "bvh.h"
+#include "lod.h"
+#include "scene.h"
+#include "batch.h"
+#include "pipeline.h"
+#include "resolution.h"
+#include "arena.h"
+#include "stream.h"
+
 extern "C" char _binary_build_shaders_vert_spv_start;
 extern "C" char _binary_build_shaders_vert_spv_end;
 
 extern "C" char _binary_build_shaders_frag_spv_start;
 extern "C" char _binary_build_shaders_frag_spv_end;
 
+extern "C" char _binary_build_shaders_cull_spv_start;
+extern "C" char _binary_build_shaders_cull_spv_end;
+
+extern "C" char _binary_build_shaders_hiz_spv_start;
+extern "C" char _binary_build_shaders_hiz_spv_end;
+
+extern "C" char _binary_build_shaders_overlay_vert_spv_start;
+extern "C" char _binary_build_shaders_overlay_vert_spv_end;
+
+extern "C" char _binary_build_shaders_overlay_frag_spv_start;
+extern "C" char _binary_build_shaders_overlay_frag_spv_end;
+
+void VK_ASSERT(VkResult res);
+
 __attribute__((always_inline))
 inline unsigned long long micro_sec() {
     return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count());
 }
 
+using Clock = std::function<unsigned long long()>;
+
+inline Clock fixed_step_clock(unsigned long long step) {
+    return [step, now = 0ULL]() mutable { return now += step; };
+}
+
+
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec3 color;
+
+    static VkVertexInputBindingDescription get_binding_description() {
+	VkVertexInputBindingDescription desc;
+	desc.binding = 0;
+	desc.stride = sizeof(Vertex);
+	desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return desc;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 2> get_attribute_descriptions() {
+	std::array<VkVertexInputAttributeDescription, 2> descs;
+	descs[0].binding = 0;
+	descs[0].location = 0;
+	descs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	descs[0].offset = offsetof(Vertex, pos);
+	descs[1].binding = 0;
+	descs[1].location = 1;
+	descs[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+	descs[1].offset = offsetof(Vertex, color);
+	return descs;
+    }
+};
+
+static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+static constexpr uint32_t MAX_VIEWS = 4;
 
 struct UniformBufferObject {
     glm::mat4 model;
-    glm::mat4 view;
-    glm::mat4 proj;
+    std::array<glm::mat4, MAX_VIEWS> view;
+    std::array<glm::mat4, MAX_VIEWS> proj;
+};
+
+struct OcclusionStats {
+    uint64_t frames;
+    uint64_t candidates;
+    uint64_t drawn;
+    uint64_t late_drawn;
+    double cull_ms;
+    double geometry_ms;
+    uint64_t timed_frames;
+    uint64_t triangles;
+    uint64_t full_triangles;
+    double cpu_ms;
+};
+
+struct FrameMemoryStats {
+    uint64_t frames;
+    uint64_t allocations;
+    uint64_t max_allocations;
+    uint64_t clean_frames;
 };
 
+static constexpr uint32_t OCCLUSION_TIMESTAMPS = 5;
+static constexpr uint32_t CANDIDATE_HEADER_SIZE = (4 + MAX_LOD_LEVELS) * sizeof(uint32_t);
+static constexpr std::size_t NO_CANDIDATES = SIZE_MAX;
+
+enum class OverlayPipeline : uint16_t {
+    SOLID,
+    BLEND,
+};
+static constexpr std::size_t OVERLAY_PIPELINES = 2;
+
 class Graphics {
 public:
-    Graphics();
+    Graphics(Clock clock_source = micro_sec);
     ~Graphics();
 
     bool should_close();
     void render_tick();
 
     bool frame_buffer_resized = false;
+    bool snapshot_requested = false;
+    uint64_t capture_from = 0;
+
+    void export_resource_snapshot(const std::string &path);
+
+    void draw_quad(const glm::vec2 &min, const glm::vec2 &max, const glm::vec4 &color, OverlayPipeline pipeline = OverlayPipeline::SOLID, uint16_t layer = 0) {
+	overlay_batcher.add(layer, static_cast<uint16_t>(pipeline), 0, min, max, color);
+    }
+    glm::vec2 screen_size() const { return {static_cast<float>(swap_extent.width), static_cast<float>(swap_extent.height)}; }
+    VkDeviceSize peak_device_bytes() const { return registry.peak_tracked(); }
 private:
-    GLFWwindow *window;
+    Clock frame_clock;
+    unsigned long long start_time;
+
+    bool headless = std::getenv("VKT_HEADLESS") && strcmp(std::getenv("VKT_HEADLESS"), "0");
+    GLFWwindow *window = nullptr;
     VkInstance instance;
 
     VkPhysicalDevice physical_device;
     VkDevice device;
 
-    uint32_t graphics_family_index, present_family_index;
+    uint32_t graphics_family_index, present_family_index, transfer_family_index, compute_family_index;
     uint32_t queue_family_indices[2];
 
-    VkQueue graphics_queue, present_queue;
+    VkQueue graphics_queue, present_queue, transfer_queue, compute_queue;
 
-    VkSurfaceKHR surface;
-    VkExtent2D swap_extent;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    VkExtent2D swap_extent, render_extent;
     uint32_t image_count;
     VkSurfaceFormatKHR surface_format;
 
     VkSwapchainKHR swap_chain;
+    VkImageUsageFlags swap_chain_usage;
     std::vector<VkImageView> swap_chain_image_views;
     std::vector<VkImage> swap_chain_images;
     std::vector<VkFramebuffer> swap_chain_framebuffers;
+    std::vector<VkDeviceMemory> headless_images_memory;
+
+    VkFormat depth_format;
+    VkImage depth_image;
+    VkDeviceMemory depth_image_memory;
+    VkImageView depth_image_view;
+    VkRenderPass render_pass, render_pass_load;
+    VkFormat render_pass_color_format = VK_FORMAT_UNDEFINED, render_pass_depth_format = VK_FORMAT_UNDEFINED;
+    bool render_pass_offscreen = false;
+
+    uint32_t view_count = std::getenv("VKT_VIEWS") ? static_cast<uint32_t>(std::stoul(std::getenv("VKT_VIEWS"))) : 1;
+    bool multiview_enabled = !std::getenv("VKT_MULTIVIEW") || strcmp(std::getenv("VKT_MULTIVIEW"), "0");
+    float view_separation = std::getenv("VKT_VIEW_SEPARATION") ? std::stof(std::getenv("VKT_VIEW_SEPARATION")) : 0.065f;
+    VkImage view_image;
+    VkDeviceMemory view_image_memory;
+    std::vector<VkImageView> view_color_views, view_depth_views;
+    std::vector<VkFramebuffer> view_framebuffers;
+    bool dynamic_resolution = std::getenv("VKT_DYNAMIC_RESOLUTION") != nullptr;
+    ResolutionController resolution_controller {dynamic_resolution ? std::stof(std::getenv("VKT_DYNAMIC_RESOLUTION")) : 0.0f, std::getenv("VKT_RESOLUTION_MIN") ? std::stof(std::getenv("VKT_RESOLUTION_MIN")) : 0.5f, std::getenv("VKT_RESOLUTION_MAX") ? std::min(std::stof(std::getenv("VKT_RESOLUTION_MAX")), 1.0f) : 1.0f};
+    std::vector<float> command_buffer_scales;
 
-    VkAttachmentDescription color_attachment {};
-    VkAttachmentReference color_attachment_reference {};
-    VkSubpassDescription subpass {};
-    VkSubpassDependency dependency {};
-    VkRenderPass render_pass;
+    VkExtent2D hiz_extent;
+    uint32_t hiz_levels;
+    VkImage hiz_image;
+    VkDeviceMemory hiz_image_memory;
+    VkImageView hiz_image_view;
+    std::vector<VkImageView> hiz_mip_views;
+    VkSampler hiz_sampler;
 
     VkShaderModule vert_shader_module;
     VkShaderModule frag_shader_module;
-    VkViewport viewport {};
-    VkRect2D scissor {};
     VkDescriptorSetLayout descriptor_set_layout;
     VkPipelineLayout pipeline_layout;
     VkPipeline graphics_pipeline;
+    VkPipelineCache pipeline_cache;
+    PipelineVariants scene_pipelines;
+    PipelineVariant scene_variant {std::getenv("VKT_SHADING") && !strcmp(std::getenv("VKT_SHADING"), "object") ? ShadingMode::OBJECT_ID : ShadingMode::VERTEX_COLOR, std::getenv("VKT_LIGHTS") ? std::min(static_cast<uint32_t>(std::stoul(std::getenv("VKT_LIGHTS"))), MAX_LIGHTS) : 0, VK_CULL_MODE_BACK_BIT};
+    bool prewarm_pipelines = std::getenv("VKT_PIPELINE_PREWARM") && strcmp(std::getenv("VKT_PIPELINE_PREWARM"), "0");
+
+    VkShaderModule cull_shader_module, hiz_shader_module;
+    VkDescriptorSetLayout cull_descriptor_set_layout, hiz_descriptor_set_layout;
+    VkPipelineLayout cull_pipeline_layout, hiz_pipeline_layout;
+    VkPipeline cull_pipeline, hiz_pipeline;
 
     VkCommandPool command_pool;
     std::vector<VkCommandBuffer> command_buffers;
@@ -85,11 +231,43 @@ private:
     VkDeviceMemory index_buffer_memory;
     VkBuffer uniform_buffers;
     VkDeviceMemory uniform_buffers_memory;
+    VkDeviceSize candidate_buffer_stride, draw_id_buffer_stride, indirect_buffer_stride;
+    VkBuffer candidate_buffers;
+    VkDeviceMemory candidate_buffers_memory;
+    VkBuffer draw_id_buffers;
+    VkDeviceMemory draw_id_buffers_memory;
+    VkBuffer indirect_buffers;
+    VkDeviceMemory indirect_buffers_memory;
+    VkBuffer transform_buffer;
+    VkDeviceMemory transform_buffer_memory;
+    VkBuffer bounds_buffer;
+    VkDeviceMemory bounds_buffer_memory;
+    VkBuffer visibility_buffer;
+    VkDeviceMemory visibility_buffer_memory;
+
+    std::vector<Vertex> mesh_vertices;
+    std::vector<uint32_t> mesh_indices;
+    LODMesh mesh_lod;
+    LODSelector lod_selector {std::getenv("VKT_LOD_PIXELS") ? std::stof(std::getenv("VKT_LOD_PIXELS")) : 1.0f};
+    LODRanges lod_ranges {};
+
+    std::vector<glm::mat4> object_transforms;
+    std::vector<AABB> object_bounds;
+    BVH bvh;
+    std::vector<uint32_t> visible_objects, view_objects;
+
+    bool occlusion_enabled = !std::getenv("VKT_OCCLUSION") || strcmp(std::getenv("VKT_OCCLUSION"), "0");
+    bool timestamps_supported = false;
+    float timestamp_period;
+    VkQueryPool timestamp_query_pool;
+    std::vector<std::size_t> image_candidate_counts;
+    OcclusionStats occlusion_stats {};
+    int64_t trace_gpu_offset_ns = 0;
 
     VkDescriptorPool descriptor_pool;
-    std::vector<VkDescriptorSet> descriptor_sets;
+    std::vector<VkDescriptorSet> descriptor_sets, cull_descriptor_sets, hiz_descriptor_sets;
 
-    VkClearValue clear_color;
+    VkClearValue clear_values[2];
     VkPipelineStageFlags wait_stages[1] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
     VkSubmitInfo submit_info {};
     VkPresentInfoKHR present_info {};
@@ -98,30 +276,137 @@ private:
     std::vector<VkFence> in_flight_fences, images_in_flight;
     std::size_t current_frame = 0;
 
+    bool frame_arena_enabled = !std::getenv("VKT_FRAME_ARENA") || strcmp(std::getenv("VKT_FRAME_ARENA"), "0");
+    std::array<FrameArena, MAX_FRAMES_IN_FLIGHT> frame_arenas;
+    FrameMemoryStats frame_memory_stats {};
+
+    ResourceRegistry registry;
+    DeletionQueue deletion_queue;
+    VkSwapchainKHR retired_swap_chain = VK_NULL_HANDLE;
+    bool debug_utils_supported = false;
+    bool memory_budget_supported = false;
+    std::size_t snapshot_count = 0;
+
+    const char *capture_directory = std::getenv("VKT_CAPTURE_DIR");
+    bool capture_supported = false;
+    std::unique_ptr<CaptureWriter> capture_writer;
+    VkCommandPool capture_command_pool;
+    std::vector<VkCommandBuffer> capture_command_buffers;
+    std::vector<VkBuffer> capture_buffers;
+    std::vector<VkDeviceMemory> capture_buffers_memory;
+    std::vector<void*> capture_mapped;
+    std::vector<std::size_t> capture_slot_frame;
+    std::vector<uint64_t> capture_slot_index;
+    std::size_t next_capture_slot = 0;
+    uint64_t frame_count = 0;
+
+    const char *stream_path = std::getenv("VKT_STREAM_FILE");
+    StreamRecorder stream;
+
+    QuadBatcher overlay_batcher;
+    uint32_t overlay_capacity;
+    VkShaderModule overlay_vert_shader_module, overlay_frag_shader_module;
+    VkRenderPass overlay_render_pass;
+    std::vector<VkFramebuffer> overlay_framebuffers;
+    VkPipelineLayout overlay_pipeline_layout;
+    std::array<VkPipeline, OVERLAY_PIPELINES> overlay_pipelines;
+    VkBuffer overlay_vertex_buffer;
+    VkDeviceMemory overlay_vertex_buffer_memory;
+    QuadVertex *overlay_vertices;
+    VkBuffer overlay_index_buffer;
+    VkDeviceMemory overlay_index_buffer_memory;
+    VkCommandPool overlay_command_pool;
+    std::vector<VkCommandBuffer> overlay_command_buffers;
+    double overlay_flush_ms = 0.0;
+
     void glfw_init();
     void create_instance();
     void create_surface();
     void create_physical_device();
+    void configure_views();
     void create_logical_device();
     void create_swap_chain();
+    void create_headless_images();
+    VkImageUsageFlags swap_chain_image_usage(VkImageUsageFlags supported_usage);
     void create_image_views();
+    void create_depth_resources();
     void create_render_pass();
+    void retire_render_pass();
+    bool render_pass_stale() const { return render_pass_color_format != surface_format.format || render_pass_depth_format != depth_format || render_pass_offscreen != offscreen_views(); }
+    VkRenderPass create_scene_render_pass(bool load, uint32_t mask, const std::string &name);
+    uint32_t view_mask() const { return multiview_enabled ? (1u << view_count) - 1 : 0; }
+    bool offscreen_views() const { return view_count > 1 || dynamic_resolution; }
+    float render_scale() const { return dynamic_resolution ? resolution_controller.scale() : 1.0f; }
+    VkExtent2D scaled_extent(float scale) const;
+    void create_view_targets();
+    void destroy_view_targets();
+    void record_view_resolve(VkCommandBuffer command_buffer, std::size_t image, VkExtent2D extent);
     void create_descriptor_set_layout();
+    void create_pipeline_cache();
+    void create_pipeline_layout();
     void create_graphics_pipeline();
+    VkPipeline create_scene_pipeline(const PipelineVariant &variant);
+    void create_compute_pipelines();
     void create_framebuffers();
     void create_command_pool();
+    void create_mesh();
+    AABB mesh_bounds() const;
     void create_vertex_buffers();
     void create_index_buffers();
     void create_uniform_buffers();
+    void create_scene();
+    void generate_scene();
+    void load_scene(const std::string &path);
+    void create_object_buffers();
     void create_descriptor_pool();
     void create_descriptor_sets();
+    void create_occlusion_descriptor_sets();
+    void create_query_pool();
     void create_command_buffers();
+    void record_command_buffer(std::size_t image);
+    void record_cull(VkCommandBuffer command_buffer, std::size_t image, uint32_t phase);
+    void record_hiz_build(VkCommandBuffer command_buffer, VkExtent2D extent);
     void create_sync_objects();
+    void create_capture();
+    void create_capture_buffers();
     void update_uniform_buffers(uint32_t current_image);
+    void update_candidates(uint32_t current_image, const UniformBufferObject &ubo);
+    void collect_occlusion_stats(uint32_t image_index);
+    std::pmr::memory_resource *frame_memory() { return frame_arena_enabled ? &frame_arenas.at(current_frame) : std::pmr::get_default_resource(); }
+    void collect_frame_memory(uint64_t allocations);
+    void calibrate_trace_clock();
+    void trace_gpu_frame(const uint64_t *ticks);
+    void export_trace();
+    uint32_t late_draw_offset() const { return static_cast<uint32_t>(std::max<std::size_t>(object_transforms.size(), 1)); }
+    bool record_capture(uint32_t image_index);
+    void collect_capture(std::size_t frame);
+    void destroy_capture_buffers();
+    void create_overlay();
+    void destroy_overlay();
+    void create_overlay_pipelines();
+    void destroy_overlay_pipelines();
+    VkCommandBuffer record_overlay(uint32_t image_index);
 
-    void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &buffer_memory);
+    void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &buffer_memory, const std::string &name, const std::string &owner);
+    void destroy_buffer(VkBuffer buffer, VkDeviceMemory buffer_memory);
+    void retire_buffer(VkBuffer buffer, VkDeviceMemory buffer_memory);
+    template <typename T>
+    void retire(VkObjectType type, T handle) {
+	registry.release(type, handle);
+	deletion_queue.retire(frame_count, type, handle);
+    }
+    void upload_buffer(const void *contents, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &buffer_memory, const std::string &name, const std::string &owner);
     void copy_buffer(VkBuffer dst_buffer, VkBuffer src_buffer, VkDeviceSize size);
+    void create_image(VkExtent2D extent, uint32_t mip_levels, VkFormat format, VkImageUsageFlags usage, VkImage &image, VkDeviceMemory &image_memory, const std::string &name, const std::string &owner, uint32_t array_layers = 1);
+    VkImageView create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t base_mip, uint32_t mip_count, const std::string &name, const std::string &owner, VkImageViewType view_type = VK_IMAGE_VIEW_TYPE_2D, uint32_t base_layer = 0, uint32_t layer_count = 1);
+    void destroy_image(VkImage image, VkDeviceMemory image_memory);
+    void retire_image(VkImage image, VkDeviceMemory image_memory);
+    VkShaderModule create_shader_module(const char *start, const char *end, const std::string &name, const std::string &owner);
+    VkCommandBuffer begin_one_time_commands();
+    void end_one_time_commands(VkCommandBuffer command_buffer);
     uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties);
+    VkMemoryPropertyFlags readback_memory_properties();
+    void destroy_depth_resources();
     void cleanup_swap_chain();
     void recreate_swap_chain();
 };
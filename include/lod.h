@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+
+static constexpr uint32_t MAX_LOD_LEVELS = 8;
+
+struct LODLevel {
+    uint32_t first_index;
+    uint32_t index_count;
+    float error;
+};
+
+struct LODMesh {
+    int32_t vertex_offset;
+    std::vector<LODLevel> levels;
+};
+
+struct LODStats {
+    uint64_t objects;
+    uint64_t switches;
+    double error_px;
+    float max_error_px;
+};
+
+std::vector<uint32_t> simplify(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, std::size_t target_index_count, float &error);
+
+class LODPacker {
+public:
+    LODMesh add(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, float reduction = 0.5f);
+
+    const std::vector<uint32_t> &get_indices() const { return packed_indices; }
+    std::size_t get_vertex_count() const { return packed_vertex_count; }
+
+private:
+    std::vector<uint32_t> packed_indices;
+    std::size_t packed_vertex_count = 0;
+};
+
+using LODRanges = std::array<uint32_t, MAX_LOD_LEVELS + 1>;
+
+class LODSelector {
+public:
+    LODSelector(float new_threshold_px = 1.0f, float new_hysteresis = 0.25f): threshold_px(new_threshold_px), hysteresis(new_hysteresis) {}
+
+    void resize(std::size_t object_count) { levels.assign(object_count, 0); }
+    void select(const LODMesh &mesh, const std::vector<AABB> &bounds, const glm::mat4 &model_view, float pixels_per_unit, std::vector<uint32_t> &visible, LODRanges &ranges);
+
+    const LODStats &get_stats() const { return stats; }
+    void reset_stats() { stats = {}; }
+
+private:
+    float threshold_px;
+    float hysteresis;
+    std::vector<uint8_t> levels;
+    std::vector<uint32_t> sorted;
+    LODStats stats {};
+};
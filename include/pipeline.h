@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "registry.h"
+
+enum class ShadingMode : uint32_t {
+    VERTEX_COLOR,
+    OBJECT_ID,
+};
+static constexpr uint32_t SHADING_MODES = 2;
+static constexpr uint32_t MAX_LIGHTS = 4;
+
+struct PipelineVariant {
+    ShadingMode shading;
+    uint32_t light_count;
+    VkCullModeFlags cull_mode;
+
+    bool operator==(const PipelineVariant &other) const = default;
+    std::string name() const;
+};
+
+struct PipelineVariantHash {
+    std::size_t operator()(const PipelineVariant &variant) const noexcept;
+};
+
+struct PipelineVariantStats {
+    uint64_t requests;
+    uint64_t compiled;
+    uint64_t deduplicated;
+    double compile_ms;
+};
+
+class PipelineVariants {
+public:
+    using Builder = std::function<VkPipeline(const PipelineVariant&)>;
+
+    void reset(Builder new_builder, ResourceRegistry *new_registry);
+    VkPipeline get(const PipelineVariant &variant);
+    std::size_t prewarm(const std::vector<PipelineVariant> &variants);
+    std::vector<VkPipeline> take_pipelines();
+
+    std::size_t size() const { return pipelines.size(); }
+    const PipelineVariantStats &get_stats() const { return stats; }
+
+private:
+    Builder builder;
+    ResourceRegistry *registry = nullptr;
+    std::unordered_map<PipelineVariant, VkPipeline, PipelineVariantHash> pipelines;
+    PipelineVariantStats stats {};
+};
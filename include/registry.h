@@ -0,0 +1,79 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+struct ResourceRecord {
+    VkObjectType type;
+    uint64_t handle;
+    std::string name;
+    std::string owner;
+    VkDeviceSize size;
+    uint32_t heap;
+    uint32_t count;
+};
+
+struct ResourceKey {
+    VkObjectType type;
+    uint64_t handle;
+
+    bool operator==(const ResourceKey &other) const = default;
+};
+
+struct ResourceKeyHash {
+    std::size_t operator()(const ResourceKey &key) const noexcept {
+	return std::hash<uint64_t>()(key.handle * 31 + static_cast<uint64_t>(key.type));
+    }
+};
+
+struct HeapUsage {
+    VkDeviceSize size;
+    VkMemoryHeapFlags flags;
+    VkDeviceSize tracked;
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+};
+
+class ResourceRegistry {
+public:
+    static constexpr uint32_t NO_HEAP = UINT32_MAX;
+
+    void init(VkPhysicalDevice new_physical_device, VkDevice new_device, bool has_memory_budget, bool has_debug_utils);
+
+    template <typename T>
+    void record(VkObjectType type, T handle, std::string name, std::string owner, VkDeviceSize size = 0, uint32_t heap = NO_HEAP) {
+	record_raw(type, reinterpret_cast<uint64_t>(handle), std::move(name), std::move(owner), size, heap);
+    }
+
+    template <typename T>
+    void release(VkObjectType type, T handle) {
+	release_raw(type, reinterpret_cast<uint64_t>(handle));
+    }
+
+    void record_raw(VkObjectType type, uint64_t handle, std::string name, std::string owner, VkDeviceSize size, uint32_t heap);
+    void release_raw(VkObjectType type, uint64_t handle);
+
+    uint32_t heap_of_type(uint32_t memory_type) const;
+    std::vector<HeapUsage> heap_usage() const;
+    VkDeviceSize peak_tracked() const { return peak_bytes; }
+
+    void export_snapshot(std::ostream &out) const;
+    std::size_t report_leaks(std::ostream &out) const;
+
+private:
+    VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    bool memory_budget_supported = false;
+    PFN_vkSetDebugUtilsObjectNameEXT set_object_name = nullptr;
+    VkPhysicalDeviceMemoryProperties mem_props {};
+
+    std::unordered_map<ResourceKey, ResourceRecord, ResourceKeyHash> records;
+    std::vector<VkDeviceSize> tracked_per_heap;
+    VkDeviceSize tracked_bytes = 0, peak_bytes = 0;
+};
+
+const char *object_type_name(VkObjectType type);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+struct ResolutionStats {
+    uint64_t frames;
+    uint64_t changes;
+    uint64_t over_budget;
+    double scale_sum;
+    double gpu_ms;
+};
+
+class ResolutionController {
+public:
+    static constexpr float SCALE_STEP = 0.05f;
+    static constexpr float MAX_CHANGE = 0.25f;
+    static constexpr uint32_t SETTLE_FRAMES = 8;
+
+    ResolutionController(float new_target_ms, float new_min_scale = 0.5f, float new_max_scale = 1.0f, float new_headroom = 0.8f);
+
+    bool update(double gpu_ms);
+    float scale() const { return current_scale; }
+    float target() const { return target_ms; }
+
+    const ResolutionStats &get_stats() const { return stats; }
+    void reset_stats() { stats = {}; }
+
+private:
+    float target_ms;
+    float min_scale, max_scale;
+    float headroom;
+    float current_scale;
+    double average_ms = 0.0;
+    uint32_t settle = 0;
+    ResolutionStats stats {};
+};
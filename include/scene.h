@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+
+static constexpr uint32_t SCENE_MAGIC = 0x43534b56;
+static constexpr uint32_t SCENE_VERSION = 2;
+static constexpr uint64_t SCENE_ALIGNMENT = 64;
+
+struct SceneSection {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct SceneHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+    SceneSection transforms;
+    SceneSection bounds;
+    SceneSection object_meshes;
+    SceneSection object_materials;
+    SceneSection meshes;
+    SceneSection materials;
+    SceneSection bvh_nodes;
+    SceneSection bvh_indices;
+};
+
+struct SceneMesh {
+    AABB bounds;
+};
+
+struct SceneMaterial {
+    glm::vec4 base_color;
+    float roughness;
+    float metallic;
+    uint32_t flags;
+    uint32_t texture;
+};
+
+static_assert(sizeof(SceneHeader) == 144);
+static_assert(sizeof(glm::mat4) == 64 && sizeof(AABB) == 24);
+static_assert(sizeof(SceneMesh) == 24 && sizeof(SceneMaterial) == 32);
+
+struct SceneData {
+    std::vector<glm::mat4> transforms;
+    std::vector<AABB> bounds;
+    std::vector<uint32_t> object_meshes;
+    std::vector<uint32_t> object_materials;
+    std::vector<SceneMesh> meshes;
+    std::vector<SceneMaterial> materials;
+    std::vector<BVHNode> bvh_nodes;
+    std::vector<uint32_t> bvh_indices;
+};
+
+SceneData build_scene(const std::vector<glm::mat4> &transforms, const AABB &mesh_bounds, const std::vector<SceneMaterial> &materials);
+void write_scene(const std::string &path, const SceneData &scene);
+
+class SceneFile {
+public:
+    SceneFile(const std::string &path);
+    ~SceneFile();
+    SceneFile(const SceneFile&) = delete;
+    SceneFile &operator=(const SceneFile&) = delete;
+
+    std::size_t object_count() const { return header->transforms.count; }
+    std::size_t mesh_count() const { return header->meshes.count; }
+    std::size_t material_count() const { return header->materials.count; }
+    std::size_t bvh_node_count() const { return header->bvh_nodes.count; }
+    std::size_t bvh_index_count() const { return header->bvh_indices.count; }
+    std::size_t size() const { return mapped_size; }
+
+    const glm::mat4 *transforms() const { return section<glm::mat4>(header->transforms); }
+    const AABB *bounds() const { return section<AABB>(header->bounds); }
+    const uint32_t *object_meshes() const { return section<uint32_t>(header->object_meshes); }
+    const uint32_t *object_materials() const { return section<uint32_t>(header->object_materials); }
+    const SceneMesh *meshes() const { return section<SceneMesh>(header->meshes); }
+    const SceneMaterial *materials() const { return section<SceneMaterial>(header->materials); }
+    const BVHNode *bvh_nodes() const { return section<BVHNode>(header->bvh_nodes); }
+    const uint32_t *bvh_indices() const { return section<uint32_t>(header->bvh_indices); }
+
+private:
+    const uint8_t *base = nullptr;
+    std::size_t mapped_size = 0;
+    const SceneHeader *header = nullptr;
+
+    template <typename T>
+    const T *section(const SceneSection &s) const { return reinterpret_cast<const T*>(base + s.offset); }
+    void validate(const std::string &path) const;
+};
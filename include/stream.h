@@ -0,0 +1,304 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+static constexpr uint32_t STREAM_MAGIC = 0x53544b56;
+static constexpr uint32_t STREAM_VERSION = 2;
+static constexpr uint32_t NO_OBJECT = 0;
+
+struct StreamHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t frames;
+    uint32_t api_version;
+    uint32_t driver_version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    char device_name[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+    VkPhysicalDeviceFeatures features;
+    VkBool32 multiview;
+};
+
+static_assert(sizeof(StreamHeader) == 32 + VK_MAX_PHYSICAL_DEVICE_NAME_SIZE + sizeof(VkPhysicalDeviceFeatures) + sizeof(VkBool32));
+static_assert(sizeof(void*) == sizeof(uint64_t), "streams store handles as 64-bit values");
+
+enum class StreamOp : uint16_t {
+    END,
+    FRAME,
+    ALLOCATE_MEMORY,
+    WRITE_MEMORY,
+    CREATE_BUFFER,
+    BIND_BUFFER_MEMORY,
+    CREATE_IMAGE,
+    BIND_IMAGE_MEMORY,
+    CREATE_IMAGE_VIEW,
+    CREATE_SAMPLER,
+    CREATE_SHADER_MODULE,
+    CREATE_RENDER_PASS,
+    CREATE_FRAMEBUFFER,
+    CREATE_DESCRIPTOR_SET_LAYOUT,
+    CREATE_PIPELINE_LAYOUT,
+    CREATE_GRAPHICS_PIPELINE,
+    CREATE_COMPUTE_PIPELINE,
+    CREATE_DESCRIPTOR_POOL,
+    ALLOCATE_DESCRIPTOR_SETS,
+    UPDATE_DESCRIPTOR_SETS,
+    CREATE_QUERY_POOL,
+    CREATE_COMMAND_POOL,
+    ALLOCATE_COMMAND_BUFFERS,
+    FREE_COMMAND_BUFFERS,
+    CREATE_FENCE,
+    WAIT_FOR_FENCES,
+    RESET_FENCES,
+    QUEUE_SUBMIT,
+    QUEUE_WAIT_IDLE,
+    BEGIN_COMMAND_BUFFER,
+    END_COMMAND_BUFFER,
+    RESET_COMMAND_BUFFER,
+    CMD_BEGIN_RENDER_PASS,
+    CMD_END_RENDER_PASS,
+    CMD_BIND_PIPELINE,
+    CMD_BIND_DESCRIPTOR_SETS,
+    CMD_BIND_VERTEX_BUFFERS,
+    CMD_BIND_INDEX_BUFFER,
+    CMD_PUSH_CONSTANTS,
+    CMD_SET_VIEWPORT,
+    CMD_SET_SCISSOR,
+    CMD_DRAW_INDEXED,
+    CMD_DRAW_INDEXED_INDIRECT,
+    CMD_DISPATCH,
+    CMD_DISPATCH_INDIRECT,
+    CMD_PIPELINE_BARRIER,
+    CMD_RESET_QUERY_POOL,
+    CMD_WRITE_TIMESTAMP,
+    CMD_COPY_BUFFER,
+    CMD_COPY_IMAGE,
+    CMD_COPY_IMAGE_TO_BUFFER,
+    CMD_BLIT_IMAGE,
+    CMD_CLEAR_COLOR_IMAGE,
+};
+
+struct StreamBytes {
+    const void *data;
+    uint64_t size;
+};
+
+std::vector<std::string> unsupported_features(const StreamHeader &header, VkPhysicalDevice physical_device);
+
+class StreamRecorder {
+public:
+    ~StreamRecorder() { finish(); }
+
+    void open(const std::string &new_path, uint64_t new_frame_limit, VkPhysicalDevice physical_device, const VkDeviceCreateInfo &device_create_info);
+    bool recording() const { return active; }
+    void frame();
+    void finish();
+
+    VkResult allocate_memory(VkDevice device, const VkMemoryAllocateInfo *allocate_info, const VkAllocationCallbacks *allocator, VkDeviceMemory *memory);
+    VkResult map_memory(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, void **data);
+    void unmap_memory(VkDevice device, VkDeviceMemory memory);
+    void write_memory(VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, const void *data);
+    VkResult create_buffer(VkDevice device, const VkBufferCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkBuffer *buffer);
+    VkResult bind_buffer_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset);
+    VkResult create_image(VkDevice device, const VkImageCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkImage *image);
+    VkResult bind_image_memory(VkDevice device, VkImage image, VkDeviceMemory memory, VkDeviceSize offset);
+    void swap_chain_images(const std::vector<VkImage> &images, VkFormat format, VkExtent2D extent, VkImageUsageFlags usage);
+    VkResult create_image_view(VkDevice device, const VkImageViewCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkImageView *view);
+    VkResult create_sampler(VkDevice device, const VkSamplerCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkSampler *sampler);
+    VkResult create_shader_module(VkDevice device, const VkShaderModuleCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkShaderModule *shader_module);
+    VkResult create_render_pass(VkDevice device, const VkRenderPassCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkRenderPass *render_pass);
+    VkResult create_framebuffer(VkDevice device, const VkFramebufferCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkFramebuffer *framebuffer);
+    VkResult create_descriptor_set_layout(VkDevice device, const VkDescriptorSetLayoutCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkDescriptorSetLayout *layout);
+    VkResult create_pipeline_layout(VkDevice device, const VkPipelineLayoutCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkPipelineLayout *layout);
+    VkResult create_graphics_pipelines(VkDevice device, VkPipelineCache cache, uint32_t count, const VkGraphicsPipelineCreateInfo *create_infos, const VkAllocationCallbacks *allocator, VkPipeline *pipelines);
+    VkResult create_compute_pipelines(VkDevice device, VkPipelineCache cache, uint32_t count, const VkComputePipelineCreateInfo *create_infos, const VkAllocationCallbacks *allocator, VkPipeline *pipelines);
+    VkResult create_descriptor_pool(VkDevice device, const VkDescriptorPoolCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkDescriptorPool *pool);
+    VkResult allocate_descriptor_sets(VkDevice device, const VkDescriptorSetAllocateInfo *allocate_info, VkDescriptorSet *sets);
+    void update_descriptor_sets(VkDevice device, uint32_t write_count, const VkWriteDescriptorSet *writes, uint32_t copy_count, const VkCopyDescriptorSet *copies);
+    VkResult create_query_pool(VkDevice device, const VkQueryPoolCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkQueryPool *pool);
+    VkResult create_command_pool(VkDevice device, const VkCommandPoolCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkCommandPool *pool);
+    VkResult allocate_command_buffers(VkDevice device, const VkCommandBufferAllocateInfo *allocate_info, VkCommandBuffer *command_buffers);
+    void free_command_buffers(VkDevice device, VkCommandPool pool, uint32_t count, const VkCommandBuffer *command_buffers);
+    VkResult create_fence(VkDevice device, const VkFenceCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkFence *fence);
+    VkResult wait_for_fences(VkDevice device, uint32_t count, const VkFence *fences, VkBool32 wait_all, uint64_t timeout);
+    VkResult reset_fences(VkDevice device, uint32_t count, const VkFence *fences);
+    VkResult queue_submit(VkQueue queue, uint32_t count, const VkSubmitInfo *submits, VkFence fence);
+    VkResult queue_wait_idle(VkQueue queue);
+    VkResult begin_command_buffer(VkCommandBuffer command_buffer, const VkCommandBufferBeginInfo *begin_info);
+    VkResult end_command_buffer(VkCommandBuffer command_buffer);
+    VkResult reset_command_buffer(VkCommandBuffer command_buffer, VkCommandBufferResetFlags flags);
+
+    void cmd_begin_render_pass(VkCommandBuffer command_buffer, const VkRenderPassBeginInfo *begin_info, VkSubpassContents contents);
+    void cmd_end_render_pass(VkCommandBuffer command_buffer);
+    void cmd_bind_pipeline(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipeline pipeline);
+    void cmd_bind_descriptor_sets(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout layout, uint32_t first_set, uint32_t count, const VkDescriptorSet *sets, uint32_t dynamic_offset_count, const uint32_t *dynamic_offsets);
+    void cmd_bind_vertex_buffers(VkCommandBuffer command_buffer, uint32_t first_binding, uint32_t count, const VkBuffer *buffers, const VkDeviceSize *offsets);
+    void cmd_bind_index_buffer(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type);
+    void cmd_push_constants(VkCommandBuffer command_buffer, VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void *values);
+    void cmd_set_viewport(VkCommandBuffer command_buffer, uint32_t first, uint32_t count, const VkViewport *viewports);
+    void cmd_set_scissor(VkCommandBuffer command_buffer, uint32_t first, uint32_t count, const VkRect2D *scissors);
+    void cmd_draw_indexed(VkCommandBuffer command_buffer, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance);
+    void cmd_draw_indexed_indirect(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, uint32_t draw_count, uint32_t stride);
+    void cmd_dispatch(VkCommandBuffer command_buffer, uint32_t x, uint32_t y, uint32_t z);
+    void cmd_dispatch_indirect(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset);
+    void cmd_pipeline_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages, VkDependencyFlags dependencies,
+			      uint32_t memory_barrier_count, const VkMemoryBarrier *memory_barriers, uint32_t buffer_barrier_count, const VkBufferMemoryBarrier *buffer_barriers,
+			      uint32_t image_barrier_count, const VkImageMemoryBarrier *image_barriers);
+    void cmd_reset_query_pool(VkCommandBuffer command_buffer, VkQueryPool pool, uint32_t first, uint32_t count);
+    void cmd_write_timestamp(VkCommandBuffer command_buffer, VkPipelineStageFlagBits stage, VkQueryPool pool, uint32_t query);
+    void cmd_copy_buffer(VkCommandBuffer command_buffer, VkBuffer src, VkBuffer dst, uint32_t count, const VkBufferCopy *regions);
+    void cmd_copy_image(VkCommandBuffer command_buffer, VkImage src, VkImageLayout src_layout, VkImage dst, VkImageLayout dst_layout, uint32_t count, const VkImageCopy *regions);
+    void cmd_copy_image_to_buffer(VkCommandBuffer command_buffer, VkImage src, VkImageLayout src_layout, VkBuffer dst, uint32_t count, const VkBufferImageCopy *regions);
+    void cmd_blit_image(VkCommandBuffer command_buffer, VkImage src, VkImageLayout src_layout, VkImage dst, VkImageLayout dst_layout, uint32_t count, const VkImageBlit *regions, VkFilter filter);
+    void cmd_clear_color_image(VkCommandBuffer command_buffer, VkImage image, VkImageLayout layout, const VkClearColorValue *color, uint32_t count, const VkImageSubresourceRange *ranges);
+
+private:
+    struct Mapping {
+	VkDeviceSize offset, size;
+	const void *data;
+    };
+
+    std::ofstream out;
+    std::string path;
+    StreamHeader header {};
+    VkPhysicalDeviceMemoryProperties memory_properties {};
+    std::mutex mutex;
+    bool active = false, framing = false;
+    uint64_t frame_limit = 0, bytes = 0;
+    std::vector<uint8_t> pending;
+    std::size_t record_start = 0;
+    uint32_t next_id = NO_OBJECT + 1;
+    std::unordered_map<uint64_t, uint32_t> ids;
+    std::unordered_map<uint64_t, VkDeviceSize> memory_sizes;
+    std::unordered_map<uint64_t, Mapping> mappings;
+
+    template <typename T>
+    uint32_t assign(T handle) { return ids[reinterpret_cast<uint64_t>(handle)] = next_id++; }
+
+    template <typename T>
+    uint32_t id(T handle) const {
+	if (handle == VK_NULL_HANDLE) return NO_OBJECT;
+	auto found = ids.find(reinterpret_cast<uint64_t>(handle));
+	if (found == ids.end()) throw std::runtime_error("Stream references an object created outside the recorder");
+	return found->second;
+    }
+
+    template <typename T>
+    std::vector<uint32_t> ids_of(const T *handles, uint32_t count) const {
+	std::vector<uint32_t> result(count);
+	for (uint32_t i = 0; i < count; ++i) result[i] = id(handles[i]);
+	return result;
+    }
+
+    template <typename T>
+    void put(const T &value) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	auto bytes_of = reinterpret_cast<const uint8_t*>(&value);
+	pending.insert(pending.end(), bytes_of, bytes_of + sizeof(T));
+    }
+
+    template <typename T>
+    void put(const std::vector<T> &values) { put_array(values.data(), static_cast<uint32_t>(values.size())); }
+
+    template <typename T>
+    void put_array(const T *values, uint32_t count) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	put(count);
+	auto bytes_of = reinterpret_cast<const uint8_t*>(values);
+	if (count) pending.insert(pending.end(), bytes_of, bytes_of + sizeof(T) * count);
+    }
+
+    void put(const StreamBytes &value) {
+	put(value.size);
+	auto bytes_of = static_cast<const uint8_t*>(value.data);
+	pending.insert(pending.end(), bytes_of, bytes_of + value.size);
+    }
+
+    void put(std::string_view value) { put_array(value.data(), static_cast<uint32_t>(value.size())); }
+
+    void begin(StreamOp op);
+    void end();
+    void commit();
+
+    template <typename... Args>
+    void write(StreamOp op, const Args &...args) {
+	begin(op);
+	(put(args), ...);
+	end();
+    }
+
+    void put_stage(const VkPipelineShaderStageCreateInfo &stage);
+    void close();
+};
+
+class StreamReader {
+public:
+    explicit StreamReader(const std::string &path);
+
+    const StreamHeader &get_header() const { return header; }
+    bool done() const { return cursor >= data.size(); }
+    std::size_t position() const { return cursor; }
+    std::size_t size() const { return data.size(); }
+
+    StreamOp next() {
+	auto op = get<StreamOp>();
+	auto size = get<uint32_t>();
+	record_end = cursor + size;
+	if (record_end > data.size()) throw std::runtime_error("Truncated stream record");
+	return op;
+    }
+    void skip() { cursor = record_end; }
+    void expect_end() const {
+	if (cursor != record_end) throw std::runtime_error("Malformed stream record");
+    }
+
+    template <typename T>
+    T get() {
+	static_assert(std::is_trivially_copyable_v<T>);
+	T value;
+	memcpy(&value, take(sizeof(T)), sizeof(T));
+	return value;
+    }
+
+    template <typename T>
+    std::vector<T> get_array() {
+	static_assert(std::is_trivially_copyable_v<T>);
+	auto count = get<uint32_t>();
+	std::vector<T> values(count);
+	if (count) memcpy(values.data(), take(sizeof(T) * count), sizeof(T) * count);
+	return values;
+    }
+
+    std::string get_string() {
+	auto count = get<uint32_t>();
+	return std::string(reinterpret_cast<const char*>(take(count)), count);
+    }
+
+    StreamBytes get_bytes() {
+	auto count = get<uint64_t>();
+	return {take(count), count};
+    }
+
+private:
+    std::vector<uint8_t> data;
+    StreamHeader header;
+    std::size_t cursor = 0, record_end = 0;
+
+    const uint8_t *take(std::size_t count) {
+	if (count > data.size() - cursor) throw std::runtime_error("Truncated stream");
+	const uint8_t *pointer = data.data() + cursor;
+	cursor += count;
+	return pointer;
+    }
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+enum class TraceTrack : uint8_t {
+    CPU,
+    GPU,
+};
+
+struct TraceEvent {
+    const char *name;
+    uint64_t begin_ns;
+    uint64_t end_ns;
+    TraceTrack track;
+};
+
+class TraceBuffer {
+public:
+    static constexpr std::size_t CAPACITY = std::size_t(1) << 16;
+
+    TraceBuffer(uint32_t new_thread_id): thread_id(new_thread_id), events(CAPACITY) {}
+
+    void push(const TraceEvent &event) {
+	std::size_t slot = count.load(std::memory_order_relaxed);
+	if (slot == CAPACITY) {
+	    dropped.fetch_add(1, std::memory_order_relaxed);
+	    return;
+	}
+	events[slot] = event;
+	count.store(slot + 1, std::memory_order_release);
+    }
+
+    const uint32_t thread_id;
+    std::atomic<const char*> thread_name {nullptr};
+    std::vector<TraceEvent> events;
+    std::atomic<std::size_t> count {0};
+    std::atomic<uint64_t> dropped {0};
+};
+
+uint64_t trace_now_ns();
+TraceBuffer &trace_thread_buffer();
+void trace_name_thread(const char *name);
+std::size_t trace_export(std::ostream &out);
+
+inline void trace_record(const char *name, uint64_t begin_ns, uint64_t end_ns, TraceTrack track = TraceTrack::CPU) {
+    trace_thread_buffer().push({name, begin_ns, end_ns, track});
+}
+
+class TraceZone {
+public:
+    explicit TraceZone(const char *new_name): name(new_name), begin_ns(trace_now_ns()) {}
+    ~TraceZone() { trace_record(name, begin_ns, trace_now_ns()); }
+    TraceZone(const TraceZone&) = delete;
+    TraceZone &operator=(const TraceZone&) = delete;
+
+private:
+    const char *name;
+    uint64_t begin_ns;
+};
+
+class TraceStages {
+public:
+    explicit TraceStages(const char *new_name): zone(new_name) {}
+    ~TraceStages() { end_stage(); }
+
+    void next(const char *stage_name) {
+	uint64_t now = trace_now_ns();
+	end_stage(now);
+	stage = stage_name;
+	stage_begin_ns = now;
+    }
+
+private:
+    void end_stage(uint64_t now = trace_now_ns()) {
+	if (stage) trace_record(stage, stage_begin_ns, now);
+    }
+
+    TraceZone zone;
+    const char *stage = nullptr;
+    uint64_t stage_begin_ns = 0;
+};
+
+#ifdef VKT_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#define TRACE_STAGES(name) TraceStages trace_stages(name)
+#define TRACE_STAGE(name) trace_stages.next(name)
+#define TRACE_THREAD(name) trace_name_thread(name)
+#else
+#define TRACE_ZONE(name) static_cast<void>(0)
+#define TRACE_STAGES(name) static_cast<void>(0)
+#define TRACE_STAGE(name) static_cast<void>(0)
+#define TRACE_THREAD(name) static_cast<void>(0)
+#endif
@@ -0,0 +1,17 @@
+#version 460
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(push_constant) uniform OverlayParameters {
+    vec2 inverse_screen_size;
+} params;
+
+layout(location = 0) in vec2 in_position;
+layout(location = 1) in vec2 in_uv;
+layout(location = 2) in vec4 in_color;
+
+layout(location = 0) out vec4 frag_color;
+
+void main() {
+    gl_Position = vec4(in_position * params.inverse_screen_size * 2.0 - 1.0, 0.0, 1.0);
+    frag_color = in_color;
+}
@@ -1,10 +1,35 @@
 #version 460
 #extension GL_ARB_separate_shader_objects : enable
 
+const uint MAX_LIGHTS = 4;
+const vec3 light_directions[MAX_LIGHTS] = vec3[](
+    vec3(0.577, 0.577, 0.577),
+    vec3(-0.707, 0.0, 0.707),
+    vec3(0.0, -0.707, 0.707),
+    vec3(0.0, 0.0, -1.0)
+);
+const vec3 light_colors[MAX_LIGHTS] = vec3[](
+    vec3(0.9, 0.85, 0.8),
+    vec3(0.3, 0.35, 0.5),
+    vec3(0.25, 0.2, 0.15),
+    vec3(0.2, 0.2, 0.2)
+);
+
+layout(constant_id = 1) const uint LIGHT_COUNT = 0;
+
 layout(location = 0) in vec3 frag_color;
+layout(location = 1) in vec3 frag_position;
 
 layout(location = 0) out vec4 out_color;
 
 void main() {
-    out_color = vec4(frag_color, 1.0);
+    vec3 color = frag_color;
+    if (LIGHT_COUNT > 0) {
+        vec3 normal = normalize(cross(dFdx(frag_position), dFdy(frag_position)));
+        vec3 light = vec3(0.1);
+        for (uint i = 0; i < min(LIGHT_COUNT, MAX_LIGHTS); ++i)
+            light += light_colors[i] * abs(dot(normal, light_directions[i]));
+        color *= light;
+    }
+    out_color = vec4(color, 1.0);
 }
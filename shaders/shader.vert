@@ -1,18 +1,47 @@
 #version 460
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_multiview : require
+
+const uint MAX_VIEWS = 4;
+const uint SHADING_OBJECT_ID = 1;
+
+layout(constant_id = 0) const uint SHADING_MODE = 0;
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
-    mat4 view;
-    mat4 proj;
+    mat4 view[MAX_VIEWS];
+    mat4 proj[MAX_VIEWS];
 } ubo;
 
-layout(location = 0) in vec2 in_position;
+layout(std430, binding = 1) readonly buffer ObjectBuffer {
+    mat4 transforms[];
+} objects;
+
+layout(std430, binding = 2) readonly buffer DrawIdBuffer {
+    uint ids[];
+} draws;
+
+layout(push_constant) uniform DrawParameters {
+    uint draw_offset;
+    uint view_base;
+} params;
+
+layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_color;
 
 layout(location = 0) out vec3 frag_color;
+layout(location = 1) out vec3 frag_position;
+
+vec3 object_color(uint object) {
+    uint hash = object * 2654435761u;
+    return vec3((hash >> 8) & 255u, (hash >> 16) & 255u, (hash >> 24) & 255u) / 255.0;
+}
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(in_position, 0.0, 1.0);
-    frag_color = in_color;
+    uint view = params.view_base + uint(gl_ViewIndex);
+    uint object = draws.ids[params.draw_offset + gl_InstanceIndex];
+    vec4 world = ubo.model * objects.transforms[object] * vec4(in_position, 1.0);
+    gl_Position = ubo.proj[view] * ubo.view[view] * world;
+    frag_color = SHADING_MODE == SHADING_OBJECT_ID ? object_color(object) : in_color;
+    frag_position = world.xyz;
 }
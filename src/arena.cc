@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdlib>
+#include <new>
+
+#include "arena.h"
+
+static std::atomic<uint64_t> heap_allocations {0};
+
+static void *counted_malloc(std::size_t bytes) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(bytes ? bytes : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+static void *counted_aligned_alloc(std::size_t bytes, std::align_val_t alignment) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    if (void *pointer = std::aligned_alloc(align, (std::max<std::size_t>(bytes, 1) + align - 1) & ~(align - 1))) return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t bytes) { return counted_malloc(bytes); }
+void *operator new[](std::size_t bytes) { return counted_malloc(bytes); }
+void *operator new(std::size_t bytes, std::align_val_t alignment) { return counted_aligned_alloc(bytes, alignment); }
+void *operator new[](std::size_t bytes, std::align_val_t alignment) { return counted_aligned_alloc(bytes, alignment); }
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+uint64_t heap_allocation_count() {
+    return heap_allocations.load(std::memory_order_relaxed);
+}
+
+FrameArena::FrameArena(std::size_t new_capacity): buffer(std::make_unique_for_overwrite<std::byte[]>(new_capacity)), size(new_capacity) {}
+
+void FrameArena::rewind() {
+    std::pmr::memory_resource *upstream = std::pmr::new_delete_resource();
+    for (const auto &overflow : overflows)
+	upstream->deallocate(overflow.pointer, overflow.bytes, overflow.alignment);
+    if (!overflows.empty()) {
+	size = std::bit_ceil(used() + overflows.size() * alignof(std::max_align_t));
+	buffer = std::make_unique_for_overwrite<std::byte[]>(size);
+	++stats.grows;
+    }
+    overflows.clear();
+    offset = 0;
+    overflow_bytes = 0;
+}
+
+void *FrameArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+    ++stats.allocations;
+    void *pointer = buffer.get() + offset;
+    std::size_t space = size - offset;
+    if (std::align(alignment, bytes, pointer, space)) {
+	offset = size - space + bytes;
+	stats.peak_bytes = std::max(stats.peak_bytes, used());
+	return pointer;
+    }
+    ++stats.overflows;
+    pointer = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    overflows.push_back({pointer, bytes, alignment});
+    overflow_bytes += bytes;
+    stats.peak_bytes = std::max(stats.peak_bytes, used());
+    return pointer;
+}
@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "batch.h"
+
+static uint32_t pack_color(const glm::vec4 &color) {
+    glm::vec4 scaled = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+    return static_cast<uint32_t>(scaled.x) | static_cast<uint32_t>(scaled.y) << 8 | static_cast<uint32_t>(scaled.z) << 16 | static_cast<uint32_t>(scaled.w) << 24;
+}
+
+std::vector<uint32_t> QuadBatcher::quad_indices(uint32_t quad_count) {
+    std::vector<uint32_t> indices;
+    indices.reserve(static_cast<std::size_t>(quad_count) * INDICES_PER_QUAD);
+    for (uint32_t quad = 0; quad < quad_count; ++quad) {
+	uint32_t base = quad * VERTICES_PER_QUAD;
+	indices.insert(indices.end(), {base, base + 1, base + 2, base + 2, base + 3, base});
+    }
+    return indices;
+}
+
+void QuadBatcher::add(uint16_t layer, uint16_t pipeline, uint32_t texture, const glm::vec2 &min, const glm::vec2 &max, const glm::vec4 &color, const glm::vec2 &uv_min, const glm::vec2 &uv_max) {
+    uint64_t key = static_cast<uint64_t>(layer) << 48 | static_cast<uint64_t>(pipeline) << 32 | texture;
+    quads.push_back({key, min, max, uv_min, uv_max, pack_color(color)});
+}
+
+const std::vector<QuadBatch> &QuadBatcher::flush(QuadVertex *vertices, uint32_t capacity) {
+    batches.clear();
+    auto count = static_cast<uint32_t>(std::min<std::size_t>(quads.size(), capacity));
+    ++stats.frames;
+    stats.dropped += quads.size() - count;
+
+    order.resize(quads.size());
+    for (uint32_t i = 0; i < quads.size(); ++i) order[i] = {quads[i].key, i};
+    if (!std::is_sorted(order.begin(), order.end())) std::sort(order.begin(), order.end());
+
+    for (uint32_t slot = 0; slot < count; ++slot) {
+	const Quad &quad = quads[order[slot].second];
+	QuadVertex *out = vertices + static_cast<std::size_t>(slot) * VERTICES_PER_QUAD;
+	out[0] = {quad.min, quad.uv_min, quad.color};
+	out[1] = {{quad.max.x, quad.min.y}, {quad.uv_max.x, quad.uv_min.y}, quad.color};
+	out[2] = {quad.max, quad.uv_max, quad.color};
+	out[3] = {{quad.min.x, quad.max.y}, {quad.uv_min.x, quad.uv_max.y}, quad.color};
+
+	if (batches.empty() || order[slot - 1].first != quad.key) {
+	    batches.push_back({static_cast<uint16_t>(quad.key >> 48), static_cast<uint16_t>(quad.key >> 32), static_cast<uint32_t>(quad.key), slot, 0});
+	}
+	++batches.back().quad_count;
+    }
+    stats.quads += count;
+    stats.batches += batches.size();
+    quads.clear();
+    return batches;
+}
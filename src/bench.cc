@@ -0,0 +1,223 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "graphics.h"
+#include "scene.h"
+#include "resolution.h"
+
+static constexpr int CULL_ITERATIONS = 100;
+static constexpr int LOD_ITERATIONS = 20;
+static constexpr int BATCH_ITERATIONS = 50;
+static constexpr int RESOLUTION_FRAMES = 4000;
+
+static double elapsed_ms(unsigned long long before) {
+    return static_cast<double>(micro_sec() - before) / 1000.0;
+}
+
+static void bench_culling(std::size_t object_count) {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> extent(0.1f, 2.0f);
+    std::vector<AABB> bounds(object_count);
+    for (auto& box : bounds) {
+	glm::vec3 center(position(rng), position(rng), position(rng) * 0.1f);
+	glm::vec3 half(extent(rng));
+	box = {center - half, center + half};
+    }
+
+    BVH bvh;
+    auto before = micro_sec();
+    bvh.build(bounds);
+    double build_ms = elapsed_ms(before);
+
+    for (auto& box : bounds) {
+	box.min.z += 0.5f;
+	box.max.z += 0.5f;
+    }
+    before = micro_sec();
+    bvh.refit(bounds);
+    double refit_ms = elapsed_ms(before);
+
+    glm::mat4 proj = glm::perspective(0.7853981634f, 16.0f / 9.0f, 0.1f, 1000.0f);
+    std::vector<uint32_t> visible;
+    std::size_t visible_total = 0;
+    before = micro_sec();
+    for (int i = 0; i < CULL_ITERATIONS; ++i) {
+	float angle = static_cast<float>(i) * 0.0628318531f;
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 50.0f), glm::vec3(std::cos(angle) * 100.0f, std::sin(angle) * 100.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	bvh.cull(Frustum::from_matrix(proj * view), visible);
+	visible_total += visible.size();
+    }
+    double cull_ms = elapsed_ms(before) / CULL_ITERATIONS;
+
+    std::cout << "culling " << object_count << " objects: build " << build_ms << " ms, refit " << refit_ms << " ms, cull " << cull_ms << " ms ("
+	      << visible_total / CULL_ITERATIONS << " visible, " << bvh.get_nodes().size() << " nodes)" << std::endl;
+}
+
+static void bench_lod(uint32_t detail, std::size_t object_count) {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y <= detail; ++y) {
+	for (uint32_t x = 0; x <= detail; ++x) {
+	    float u = static_cast<float>(x) / static_cast<float>(detail), v = static_cast<float>(y) / static_cast<float>(detail);
+	    positions.emplace_back(u - 0.5f, v - 0.5f, 0.05f * std::sin(u * 18.849556f) * std::cos(v * 12.566371f));
+	}
+    }
+    for (uint32_t y = 0; y < detail; ++y) {
+	for (uint32_t x = 0; x < detail; ++x) {
+	    uint32_t i = y * (detail + 1) + x;
+	    indices.insert(indices.end(), {i, i + 1, i + detail + 2, i + detail + 2, i + detail + 1, i});
+	}
+    }
+
+    LODPacker packer;
+    auto before = micro_sec();
+    LODMesh mesh = packer.add(positions, indices);
+    double build_ms = elapsed_ms(before);
+    std::cout << "lod " << indices.size() / 3 << " triangles: build " << build_ms << " ms," << " levels";
+    for (const auto& level : mesh.levels)
+	std::cout << " " << level.index_count / 3 << "/" << level.error;
+    std::cout << std::endl;
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::vector<AABB> bounds(object_count);
+    std::vector<uint32_t> all(object_count);
+    for (std::size_t i = 0; i < object_count; ++i) {
+	glm::vec3 center(position(rng), position(rng), 0.0f);
+	bounds[i] = {center - glm::vec3(0.5f), center + glm::vec3(0.5f)};
+	all[i] = static_cast<uint32_t>(i);
+    }
+    glm::mat4 proj = glm::perspective(0.7853981634f, 16.0f / 9.0f, 0.1f, 1000.0f);
+    float pixels_per_unit = 0.5f * 1080.0f * proj[1][1];
+    LODSelector selector;
+    selector.resize(object_count);
+    LODRanges ranges {};
+    std::vector<uint32_t> visible;
+    uint64_t triangles = 0, full_triangles = 0;
+    before = micro_sec();
+    for (int i = 0; i < LOD_ITERATIONS; ++i) {
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, -50.0f + static_cast<float>(i), 20.0f), glm::vec3(0.0f, 100.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	visible = all;
+	selector.select(mesh, bounds, view, pixels_per_unit, visible, ranges);
+	for (std::size_t level = 0; level < mesh.levels.size(); ++level)
+	    triangles += static_cast<uint64_t>(ranges[level + 1] - ranges[level]) * mesh.levels[level].index_count / 3;
+	full_triangles += static_cast<uint64_t>(visible.size()) * mesh.levels[0].index_count / 3;
+    }
+    double select_ms = elapsed_ms(before) / LOD_ITERATIONS;
+    const LODStats &stats = selector.get_stats();
+    std::cout << "lod select " << object_count << " objects: " << select_ms << " ms, triangles " << static_cast<double>(triangles) / static_cast<double>(full_triangles) * 100.0
+	      << "% of full detail, mean error " << stats.error_px / static_cast<double>(stats.objects) << " px (max " << stats.max_error_px << "), "
+	      << stats.switches << " switches" << std::endl;
+}
+
+static void bench_batch(uint32_t quad_count, uint16_t pipelines, uint32_t textures) {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> position(0.0f, 1920.0f);
+    std::uniform_int_distribution<uint32_t> texture(0, textures - 1);
+    std::uniform_int_distribution<int> pipeline(0, pipelines - 1);
+    std::vector<glm::vec2> corners(quad_count);
+    std::vector<std::pair<uint16_t, uint32_t>> keys(quad_count);
+    for (uint32_t i = 0; i < quad_count; ++i) {
+	corners[i] = {position(rng), position(rng) * 0.5625f};
+	keys[i] = {static_cast<uint16_t>(pipeline(rng)), texture(rng)};
+    }
+
+    QuadBatcher batcher;
+    std::vector<QuadVertex> vertices(static_cast<std::size_t>(quad_count) * QuadBatcher::VERTICES_PER_QUAD);
+    std::size_t draws = 0;
+    auto before = micro_sec();
+    for (int i = 0; i < BATCH_ITERATIONS; ++i) {
+	for (uint32_t q = 0; q < quad_count; ++q)
+	    batcher.add(0, keys[q].first, keys[q].second, corners[q], corners[q] + glm::vec2(8.0f), glm::vec4(1.0f, 0.5f, 0.25f, 1.0f));
+	draws += batcher.flush(vertices.data(), quad_count).size();
+    }
+    double batch_ms = elapsed_ms(before) / BATCH_ITERATIONS;
+    std::cout << "batch " << quad_count << " quads (" << pipelines << " pipelines, " << textures << " textures): " << batch_ms << " ms, "
+	      << static_cast<double>(quad_count) / batch_ms << " quads/ms, " << draws / BATCH_ITERATIONS << " draws" << std::endl;
+}
+
+static void bench_scene(std::size_t object_count) {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::vector<glm::mat4> transforms(object_count, glm::mat4(1.0f));
+    for (auto& transform : transforms)
+	transform[3] = glm::vec4(position(rng), position(rng), 0.0f, 1.0f);
+    AABB tile {glm::vec3(-0.5f), glm::vec3(0.5f)};
+
+    auto before = micro_sec();
+    SceneData data = build_scene(transforms, tile, {{glm::vec4(1.0f), 0.5f, 0.0f, 0, 0}});
+    double build_ms = elapsed_ms(before);
+    std::string path = (std::filesystem::temp_directory_path() / "vulkan-tutorial-bench.scene").string();
+    before = micro_sec();
+    write_scene(path, data);
+    double write_ms = elapsed_ms(before);
+
+    before = micro_sec();
+    SceneFile scene(path);
+    double map_ms = elapsed_ms(before);
+    before = micro_sec();
+    float checksum = 0.0f;
+    for (std::size_t i = 0; i < scene.object_count(); ++i)
+	checksum += scene.transforms()[i][3].x + scene.bounds()[i].max.y;
+    double touch_ms = elapsed_ms(before);
+    before = micro_sec();
+    std::vector<AABB> bounds(scene.bounds(), scene.bounds() + scene.object_count());
+    BVH bvh;
+    bvh.assign(scene.bvh_nodes(), scene.bvh_node_count(), scene.bvh_indices(), bounds);
+    double import_ms = elapsed_ms(before);
+    std::remove(path.c_str());
+
+    std::cout << "scene " << object_count << " objects (" << static_cast<double>(scene.size()) / 1048576.0 << " MiB): build " << build_ms << " ms, write " << write_ms
+	      << " ms, map " << map_ms << " ms, first touch " << touch_ms << " ms, BVH import " << import_ms << " ms (checksum " << checksum << ")" << std::endl;
+}
+
+static void bench_resolution(double fixed_ms, double fill_ms, float target_ms) {
+    std::mt19937 rng(0);
+    std::normal_distribution<double> noise(1.0, 0.05);
+    ResolutionController controller(target_ms);
+    uint64_t late_changes = 0;
+    for (int frame = 0; frame < RESOLUTION_FRAMES; ++frame) {
+	double load = frame < RESOLUTION_FRAMES / 2 ? 1.0 : 1.5;
+	float scale = controller.scale();
+	double gpu_ms = (fixed_ms + fill_ms * load * scale * scale) * noise(rng);
+	if (controller.update(gpu_ms) && frame % (RESOLUTION_FRAMES / 2) > RESOLUTION_FRAMES / 4) ++late_changes;
+    }
+    const ResolutionStats &stats = controller.get_stats();
+    auto frames = static_cast<double>(stats.frames);
+    std::cout << "resolution " << fixed_ms << "+" << fill_ms << " ms at full scale, target " << target_ms << " ms: mean scale " << stats.scale_sum / frames
+	      << ", gpu " << stats.gpu_ms / frames << " ms, " << 100.0 * static_cast<double>(stats.over_budget) / frames << "% over budget, "
+	      << stats.changes << " changes (" << late_changes << " after settling), final scale " << controller.scale() << std::endl;
+}
+
+int main(int argc, char **argv) {
+    std::string suite = argc > 1 ? argv[1] : "all";
+    if (suite == "all" || suite == "culling") {
+	bench_culling(100000);
+	bench_culling(1000000);
+    }
+    if (suite == "all" || suite == "lod") {
+	bench_lod(64, 100000);
+	bench_lod(256, 1000000);
+    }
+    if (suite == "all" || suite == "batch") {
+	bench_batch(10000, 1, 1);
+	bench_batch(100000, 2, 1);
+	bench_batch(100000, 2, 64);
+    }
+    if (suite == "all" || suite == "scene") {
+	bench_scene(10000);
+	bench_scene(100000);
+	bench_scene(1000000);
+    }
+    if (suite == "all" || suite == "resolution") {
+	bench_resolution(1.0, 6.0, 8.3f);
+	bench_resolution(2.0, 14.0, 8.3f);
+	bench_resolution(2.0, 30.0, 16.6f);
+    }
+    return 0;
+}
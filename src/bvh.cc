@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <omp.h>
+
+#include "bvh.h"
+
+static constexpr std::size_t PARALLEL_NODES = 4096;
+
+enum class Containment {
+    OUTSIDE,
+    INTERSECT,
+    INSIDE,
+};
+
+AABB AABB::transformed(const glm::mat4 &transform) const {
+    glm::vec3 center = (min + max) * 0.5f;
+    glm::vec3 extent = (max - min) * 0.5f;
+    glm::vec3 new_center = glm::vec3(transform * glm::vec4(center, 1.0f));
+    glm::vec3 new_extent(0.0f);
+    for (int col = 0; col < 3; ++col) {
+	for (int row = 0; row < 3; ++row) {
+	    new_extent[row] += std::fabs(transform[col][row]) * extent[col];
+	}
+    }
+    return {new_center - new_extent, new_center + new_extent};
+}
+
+Frustum Frustum::from_matrix(const glm::mat4 &clip) {
+    auto row = [&clip](int i) { return glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]); };
+    std::array<glm::vec4, 6> planes = {
+	row(3) + row(0),
+	row(3) - row(0),
+	row(3) + row(1),
+	row(3) - row(1),
+	row(2),
+	row(3) - row(2),
+    };
+
+    Frustum frustum;
+    frustum.nx.fill(0.0f);
+    frustum.ny.fill(0.0f);
+    frustum.nz.fill(0.0f);
+    frustum.nw.fill(1.0f);
+    for (std::size_t i = 0; i < planes.size(); ++i) {
+	frustum.nx[i] = planes[i].x;
+	frustum.ny[i] = planes[i].y;
+	frustum.nz[i] = planes[i].z;
+	frustum.nw[i] = planes[i].w;
+    }
+    return frustum;
+}
+
+static inline Containment classify(const Frustum &frustum, const glm::vec3 &min, const glm::vec3 &max) {
+    float cx = (min.x + max.x) * 0.5f, cy = (min.y + max.y) * 0.5f, cz = (min.z + max.z) * 0.5f;
+    float ex = (max.x - min.x) * 0.5f, ey = (max.y - min.y) * 0.5f, ez = (max.z - min.z) * 0.5f;
+    float far_dist = std::numeric_limits<float>::infinity();
+    float near_dist = std::numeric_limits<float>::infinity();
+#pragma omp simd reduction(min:far_dist, near_dist)
+    for (std::size_t i = 0; i < 8; ++i) {
+	float d = frustum.nx[i] * cx + frustum.ny[i] * cy + frustum.nz[i] * cz + frustum.nw[i];
+	float r = std::fabs(frustum.nx[i]) * ex + std::fabs(frustum.ny[i]) * ey + std::fabs(frustum.nz[i]) * ez;
+	far_dist = std::min(far_dist, d + r);
+	near_dist = std::min(near_dist, d - r);
+    }
+    if (far_dist < 0.0f) return Containment::OUTSIDE;
+    return near_dist >= 0.0f ? Containment::INSIDE : Containment::INTERSECT;
+}
+
+static inline void grow(glm::vec3 &min, glm::vec3 &max, const glm::vec3 &other_min, const glm::vec3 &other_max) {
+    min = glm::min(min, other_min);
+    max = glm::max(max, other_max);
+}
+
+void BVH::build(const std::vector<AABB> &bounds) {
+    nodes.clear();
+    indices.resize(bounds.size());
+    leaf_bounds.resize(bounds.size());
+    if (bounds.empty()) return;
+
+    struct BuildItem {
+	AABB bounds;
+	uint32_t index;
+    };
+    std::vector<BuildItem> items(bounds.size());
+    for (std::size_t i = 0; i < bounds.size(); ++i)
+	items[i] = {bounds[i], static_cast<uint32_t>(i)};
+
+    struct BuildTask {
+	uint32_t parent, first, count;
+	bool right;
+    };
+    std::vector<BuildTask> stack = {{0, 0, static_cast<uint32_t>(bounds.size()), false}};
+    nodes.reserve(2 * bounds.size() / LEAF_SIZE + 1);
+    while (!stack.empty()) {
+	BuildTask task = stack.back();
+	stack.pop_back();
+	uint32_t node = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	if (task.right) nodes[task.parent].right_or_first = node;
+
+	glm::vec3 min(std::numeric_limits<float>::infinity()), max(-std::numeric_limits<float>::infinity());
+	glm::vec3 centroid_min = min, centroid_max = max;
+	for (uint32_t i = task.first; i < task.first + task.count; ++i) {
+	    glm::vec3 centroid = items[i].bounds.min + items[i].bounds.max;
+	    grow(min, max, items[i].bounds.min, items[i].bounds.max);
+	    grow(centroid_min, centroid_max, centroid, centroid);
+	}
+	nodes[node].min = min;
+	nodes[node].max = max;
+	if (task.count <= LEAF_SIZE) {
+	    nodes[node].right_or_first = task.first;
+	    nodes[node].count = task.count;
+	    continue;
+	}
+
+	glm::vec3 extent = centroid_max - centroid_min;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	auto begin = items.begin() + task.first;
+	auto mid = begin + task.count / 2;
+	std::nth_element(begin, mid, begin + task.count, [axis](const BuildItem &a, const BuildItem &b) {
+	    return a.bounds.min[axis] + a.bounds.max[axis] < b.bounds.min[axis] + b.bounds.max[axis];
+	});
+	nodes[node].count = 0;
+	stack.push_back({node, task.first + task.count / 2, task.count - task.count / 2, true});
+	stack.push_back({node, task.first, task.count / 2, false});
+    }
+
+    for (std::size_t i = 0; i < items.size(); ++i) {
+	indices[i] = items[i].index;
+	leaf_bounds[i] = items[i].bounds;
+    }
+}
+
+void BVH::assign(const BVHNode *new_nodes, std::size_t node_count, const uint32_t *new_indices, const std::vector<AABB> &bounds) {
+    nodes.assign(new_nodes, new_nodes + node_count);
+    indices.assign(new_indices, new_indices + bounds.size());
+    leaf_bounds.resize(bounds.size());
+    for (std::size_t i = 0; i < indices.size(); ++i)
+	leaf_bounds[i] = bounds[indices[i]];
+}
+
+void BVH::refit(const std::vector<AABB> &bounds) {
+    for (std::size_t i = 0; i < indices.size(); ++i)
+	leaf_bounds[i] = bounds[indices[i]];
+    for (std::size_t i = nodes.size(); i-- > 0;) {
+	BVHNode &node = nodes[i];
+	glm::vec3 min(std::numeric_limits<float>::infinity()), max(-std::numeric_limits<float>::infinity());
+	if (node.count) {
+	    for (uint32_t j = node.right_or_first; j < node.right_or_first + node.count; ++j)
+		grow(min, max, leaf_bounds[j].min, leaf_bounds[j].max);
+	}
+	else {
+	    grow(min, max, nodes[i + 1].min, nodes[i + 1].max);
+	    grow(min, max, nodes[node.right_or_first].min, nodes[node.right_or_first].max);
+	}
+	node.min = min;
+	node.max = max;
+    }
+}
+
+void BVH::emit_subtree(uint32_t node, std::vector<uint32_t> &visible) const {
+    uint32_t stack[STACK_SIZE];
+    std::size_t top = 0;
+    stack[top++] = node;
+    while (top) {
+	const BVHNode &current = nodes[stack[--top]];
+	if (current.count) {
+	    visible.insert(visible.end(), indices.begin() + current.right_or_first, indices.begin() + current.right_or_first + current.count);
+	    continue;
+	}
+	stack[top++] = current.right_or_first;
+	stack[top++] = static_cast<uint32_t>(&current - nodes.data()) + 1;
+    }
+}
+
+void BVH::cull_leaf(const Frustum &frustum, const BVHNode &leaf, std::vector<uint32_t> &visible) const {
+    for (uint32_t i = leaf.right_or_first; i < leaf.right_or_first + leaf.count; ++i) {
+	if (classify(frustum, leaf_bounds[i].min, leaf_bounds[i].max) != Containment::OUTSIDE)
+	    visible.push_back(indices[i]);
+    }
+}
+
+void BVH::cull_subtree(const Frustum &frustum, uint32_t node, std::vector<uint32_t> &visible) const {
+    uint32_t stack[STACK_SIZE];
+    std::size_t top = 0;
+    stack[top++] = node;
+    while (top) {
+	uint32_t index = stack[--top];
+	const BVHNode &current = nodes[index];
+	Containment containment = classify(frustum, current.min, current.max);
+	if (containment == Containment::OUTSIDE) continue;
+	if (containment == Containment::INSIDE) {
+	    emit_subtree(index, visible);
+	    continue;
+	}
+	if (current.count) {
+	    cull_leaf(frustum, current, visible);
+	    continue;
+	}
+	stack[top++] = current.right_or_first;
+	stack[top++] = index + 1;
+    }
+}
+
+void BVH::cull(const Frustum &frustum, std::vector<uint32_t> &visible) {
+    visible.clear();
+    if (nodes.empty()) return;
+    if (nodes.size() < PARALLEL_NODES) {
+	cull_subtree(frustum, 0, visible);
+	return;
+    }
+
+    std::size_t target = static_cast<std::size_t>(omp_get_max_threads()) * 4;
+    tasks.assign(1, 0);
+    next_tasks.clear();
+    bool split = true;
+    while (split && tasks.size() < target) {
+	split = false;
+	next_tasks.clear();
+	for (uint32_t task : tasks) {
+	    if (nodes[task].count) {
+		next_tasks.push_back(task);
+		continue;
+	    }
+	    next_tasks.push_back(task + 1);
+	    next_tasks.push_back(nodes[task].right_or_first);
+	    split = true;
+	}
+	tasks.swap(next_tasks);
+    }
+
+    task_visible.resize(tasks.size());
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+	task_visible[i].clear();
+	cull_subtree(frustum, tasks[i], task_visible[i]);
+    }
+    for (const auto& task : task_visible)
+	visible.insert(visible.end(), task.begin(), task.end());
+}
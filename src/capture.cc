@@ -0,0 +1,109 @@
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "graphics.h"
+#include "capture.h"
+
+CaptureWriter::CaptureWriter(std::string new_directory, CaptureFormat new_format, std::size_t slot_count): directory(std::move(new_directory)), format(new_format), busy(slot_count) {
+    for (auto& slot : busy) slot.store(false);
+    worker = std::thread(&CaptureWriter::run, this);
+}
+
+CaptureWriter::~CaptureWriter() {
+    {
+	std::lock_guard<std::mutex> lock(mutex);
+	stopping = true;
+    }
+    queue_cv.notify_all();
+    worker.join();
+}
+
+CaptureFormat CaptureWriter::parse_format(const char *name) {
+    if (!name || !strcmp(name, "ppm")) return CaptureFormat::PPM;
+    if (!strcmp(name, "raw")) return CaptureFormat::RAW;
+    throw std::runtime_error(std::string("Unknown capture format ") + name);
+}
+
+void CaptureWriter::submit(const CaptureFrame &frame) {
+    busy.at(frame.slot).store(true, std::memory_order_release);
+    {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!first_submit) first_submit = micro_sec();
+	queue.push_back(frame);
+    }
+    queue_cv.notify_one();
+}
+
+void CaptureWriter::drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle_cv.wait(lock, [this] { return queue.empty() && !writing; });
+}
+
+void CaptureWriter::report(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto seconds = static_cast<double>(last_write - first_submit) / 1000000.0;
+    auto frames = written.load();
+    out << "Captured " << frames << " frames (" << dropped.load() << " dropped)";
+    if (frames && seconds > 0.0) {
+	out << ", " << static_cast<double>(frames) / seconds << " frames/s, "
+	    << static_cast<double>(bytes.load()) / seconds / 1000000.0 << " MB/s";
+    }
+    out << std::endl;
+}
+
+void CaptureWriter::run() {
+    TRACE_THREAD("capture_writer");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+	queue_cv.wait(lock, [this] { return stopping || !queue.empty(); });
+	if (queue.empty()) break;
+	CaptureFrame frame = queue.front();
+	queue.pop_front();
+	writing = true;
+	lock.unlock();
+
+	write(frame);
+	busy.at(frame.slot).store(false, std::memory_order_release);
+
+	lock.lock();
+	writing = false;
+	last_write = micro_sec();
+	if (queue.empty()) idle_cv.notify_all();
+    }
+}
+
+void CaptureWriter::write(const CaptureFrame &frame) {
+    TRACE_ZONE("write_capture");
+    std::ostringstream path;
+    path << directory << "/frame_" << std::setw(6) << std::setfill('0') << frame.index << (format == CaptureFormat::PPM ? ".ppm" : ".raw");
+    std::ofstream out(path.str(), std::ios::binary);
+    if (!out) {
+	std::cerr << "Failed to open " << path.str() << std::endl;
+	return;
+    }
+
+    std::size_t pitch = static_cast<std::size_t>(frame.width) * 4;
+    if (format == CaptureFormat::RAW) {
+	out.write(reinterpret_cast<const char*>(frame.pixels), static_cast<std::streamsize>(pitch * frame.height));
+	bytes.fetch_add(pitch * frame.height, std::memory_order_relaxed);
+    }
+    else {
+	out << "P6\n" << frame.width << ' ' << frame.height << "\n255\n";
+	row.resize(static_cast<std::size_t>(frame.width) * 3);
+	std::size_t r = frame.bgra ? 2 : 0, b = frame.bgra ? 0 : 2;
+	for (uint32_t y = 0; y < frame.height; ++y) {
+	    const uint8_t *src = frame.pixels + y * pitch;
+	    for (uint32_t x = 0; x < frame.width; ++x) {
+		row[x * 3 + 0] = src[x * 4 + r];
+		row[x * 3 + 1] = src[x * 4 + 1];
+		row[x * 3 + 2] = src[x * 4 + b];
+	    }
+	    out.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+	}
+	bytes.fetch_add(row.size() * frame.height, std::memory_order_relaxed);
+    }
+    written.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "deletion.h"
+#include "registry.h"
+
+void DeletionQueue::retire_raw(uint64_t frame, VkObjectType type, uint64_t handle) {
+    if (!entries.empty() && frame < entries.back().frame) throw std::runtime_error("Resources retired out of frame order");
+    entries.push_back({frame, type, handle, {}});
+    ++stats.retired;
+    stats.peak_pending = std::max(stats.peak_pending, entries.size());
+}
+
+void DeletionQueue::retire_command_buffers(uint64_t frame, VkCommandPool pool, std::vector<VkCommandBuffer> command_buffers) {
+    retire_raw(frame, VK_OBJECT_TYPE_COMMAND_BUFFER, reinterpret_cast<uint64_t>(pool));
+    entries.back().command_buffers = std::move(command_buffers);
+}
+
+std::size_t DeletionQueue::collect(uint64_t completed_frame) {
+    std::size_t count = 0;
+    while (!entries.empty() && entries.front().frame <= completed_frame) {
+	destroy(entries.front());
+	entries.pop_front();
+	++count;
+    }
+    return count;
+}
+
+std::size_t DeletionQueue::flush() {
+    std::size_t count = entries.size();
+    for (auto& entry : entries) destroy(entry);
+    entries.clear();
+    return count;
+}
+
+void DeletionQueue::destroy(Entry &entry) {
+    switch (entry.type) {
+    case VK_OBJECT_TYPE_BUFFER: vkDestroyBuffer(device, reinterpret_cast<VkBuffer>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_IMAGE: vkDestroyImage(device, reinterpret_cast<VkImage>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_IMAGE_VIEW: vkDestroyImageView(device, reinterpret_cast<VkImageView>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_DEVICE_MEMORY: vkFreeMemory(device, reinterpret_cast<VkDeviceMemory>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_SWAPCHAIN_KHR: vkDestroySwapchainKHR(device, reinterpret_cast<VkSwapchainKHR>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_FRAMEBUFFER: vkDestroyFramebuffer(device, reinterpret_cast<VkFramebuffer>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_RENDER_PASS: vkDestroyRenderPass(device, reinterpret_cast<VkRenderPass>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_SHADER_MODULE: vkDestroyShaderModule(device, reinterpret_cast<VkShaderModule>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_PIPELINE: vkDestroyPipeline(device, reinterpret_cast<VkPipeline>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_PIPELINE_LAYOUT: vkDestroyPipelineLayout(device, reinterpret_cast<VkPipelineLayout>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT: vkDestroyDescriptorSetLayout(device, reinterpret_cast<VkDescriptorSetLayout>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_DESCRIPTOR_POOL: vkDestroyDescriptorPool(device, reinterpret_cast<VkDescriptorPool>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_QUERY_POOL: vkDestroyQueryPool(device, reinterpret_cast<VkQueryPool>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_SAMPLER: vkDestroySampler(device, reinterpret_cast<VkSampler>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_COMMAND_POOL: vkDestroyCommandPool(device, reinterpret_cast<VkCommandPool>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_FENCE: vkDestroyFence(device, reinterpret_cast<VkFence>(entry.handle), nullptr); break;
+    case VK_OBJECT_TYPE_COMMAND_BUFFER:
+	vkFreeCommandBuffers(device, reinterpret_cast<VkCommandPool>(entry.handle), static_cast<uint32_t>(entry.command_buffers.size()), entry.command_buffers.data());
+	break;
+    default: throw std::runtime_error(std::string("Cannot retire ") + object_type_name(entry.type));
+    }
+    ++stats.destroyed;
+}
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cctype>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+
+#include "device.h"
+
+static constexpr int64_t TYPE_WEIGHT = int64_t(1) << 20;
+static constexpr int64_t TIMESTAMP_BONUS = 64;
+static constexpr int64_t QUEUE_BONUS = 32;
+
+const char *device_type_name(VkPhysicalDeviceType type) {
+    switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+    default: return "other";
+    }
+}
+
+static int64_t type_rank(VkPhysicalDeviceType type) {
+    switch (type) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1;
+    default: return 0;
+    }
+}
+
+QueueTopology find_queue_topology(VkPhysicalDevice device, VkSurfaceKHR surface, std::pmr::memory_resource *memory) {
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, nullptr);
+    std::pmr::vector<VkQueueFamilyProperties> queue_families(queue_family_count, memory);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families.data());
+
+    QueueTopology queues;
+    std::pmr::vector<VkBool32> present_support(queue_family_count, VK_FALSE, memory);
+    for (uint32_t family = 0; family < queue_family_count; ++family) {
+	if (surface != VK_NULL_HANDLE) vkGetPhysicalDeviceSurfaceSupportKHR(device, family, surface, &present_support.at(family));
+	bool graphics = queue_families.at(family).queueFlags & VK_QUEUE_GRAPHICS_BIT;
+	if (graphics && (queues.graphics == NO_QUEUE_FAMILY || (present_support.at(family) && !present_support.at(queues.graphics)))) queues.graphics = family;
+	if (present_support.at(family) && queues.present == NO_QUEUE_FAMILY) queues.present = family;
+    }
+    if (queues.graphics == NO_QUEUE_FAMILY) return queues;
+    if (present_support.at(queues.graphics)) queues.present = queues.graphics;
+    queues.timestamps = queue_families.at(queues.graphics).timestampValidBits > 0;
+
+    queues.transfer = queues.compute = queues.graphics;
+    int transfer_rank = 0;
+    for (uint32_t family = 0; family < queue_family_count; ++family) {
+	VkQueueFlags flags = queue_families.at(family).queueFlags;
+	if (flags & VK_QUEUE_GRAPHICS_BIT) continue;
+	if ((flags & VK_QUEUE_COMPUTE_BIT) && queues.compute == queues.graphics) queues.compute = family;
+	int rank = !(flags & VK_QUEUE_TRANSFER_BIT) ? 0 : (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+	if (rank > transfer_rank) {
+	    transfer_rank = rank;
+	    queues.transfer = family;
+	}
+    }
+    return queues;
+}
+
+DeviceCandidate evaluate_device(VkPhysicalDevice device, uint32_t index, VkSurfaceKHR surface, const std::vector<const char*> &required_extensions, std::pmr::memory_resource *memory) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+    DeviceCandidate candidate {device, index, properties.deviceName, properties.deviceType, 0, {}, 0, ""};
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
+    for (uint32_t heap = 0; heap < memory_properties.memoryHeapCount; ++heap) {
+	if (memory_properties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) candidate.local_memory += memory_properties.memoryHeaps[heap].size;
+    }
+
+    if (properties.apiVersion < VK_API_VERSION_1_1) {
+	candidate.rejection = "Vulkan 1.1 not supported";
+	return candidate;
+    }
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+    std::pmr::vector<VkExtensionProperties> available_extensions(extension_count, memory);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+    std::pmr::set<std::pmr::string, std::less<>> missing_extensions(required_extensions.begin(), required_extensions.end(), memory);
+    for (const auto& extension : available_extensions) {
+	auto found = missing_extensions.find(std::string_view(extension.extensionName));
+	if (found != missing_extensions.end()) missing_extensions.erase(found);
+    }
+    if (!missing_extensions.empty()) {
+	candidate.rejection = "missing ";
+	candidate.rejection += *missing_extensions.begin();
+	return candidate;
+    }
+
+    VkPhysicalDeviceMultiviewFeatures multiview_features {};
+    multiview_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+    VkPhysicalDeviceFeatures2 features {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &multiview_features;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    if (!multiview_features.multiview) {
+	candidate.rejection = "multiview not supported";
+	return candidate;
+    }
+    if (!features.features.drawIndirectFirstInstance) {
+	candidate.rejection = "drawIndirectFirstInstance not supported";
+	return candidate;
+    }
+
+    candidate.queues = find_queue_topology(device, surface, memory);
+    if (candidate.queues.graphics == NO_QUEUE_FAMILY) {
+	candidate.rejection = "no graphics queue";
+	return candidate;
+    }
+    if (surface != VK_NULL_HANDLE && candidate.queues.present == NO_QUEUE_FAMILY) {
+	candidate.rejection = "cannot present to the window surface";
+	return candidate;
+    }
+
+    const VkPhysicalDeviceLimits &limits = properties.limits;
+    candidate.score = type_rank(properties.deviceType) * TYPE_WEIGHT;
+    candidate.score += static_cast<int64_t>(candidate.local_memory >> 20);
+    candidate.score += limits.maxImageDimension2D / 1024 + limits.maxComputeSharedMemorySize / 4096;
+    if (candidate.queues.timestamps) candidate.score += TIMESTAMP_BONUS;
+    if (candidate.queues.dedicated_transfer()) candidate.score += QUEUE_BONUS;
+    if (candidate.queues.async_compute()) candidate.score += QUEUE_BONUS;
+    return candidate;
+}
+
+std::size_t choose_device(const std::vector<DeviceCandidate> &candidates, const char *override_spec) {
+    std::string spec = override_spec ? override_spec : "";
+    bool by_index = !spec.empty() && std::all_of(spec.begin(), spec.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+    auto lower = [](std::string text) {
+	std::transform(text.begin(), text.end(), text.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+	return text;
+    };
+
+    std::size_t best = candidates.size();
+    const DeviceCandidate *rejected_match = nullptr;
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+	const auto& candidate = candidates.at(i);
+	if (!spec.empty()) {
+	    bool match = by_index ? candidate.index == std::stoul(spec) : lower(candidate.name).find(lower(spec)) != std::string::npos;
+	    if (!match) continue;
+	    if (!candidate.rejection.empty()) {
+		rejected_match = &candidate;
+		continue;
+	    }
+	}
+	if (!candidate.rejection.empty()) continue;
+	if (best == candidates.size() || candidate.score > candidates.at(best).score) best = i;
+    }
+
+    if (best != candidates.size()) return best;
+    if (rejected_match) throw std::runtime_error("VKT_DEVICE=" + spec + " selects " + rejected_match->name + ", which is unsuitable: " + rejected_match->rejection);
+    if (!spec.empty()) throw std::runtime_error("VKT_DEVICE=" + spec + " matches no Vulkan device");
+    throw std::runtime_error("No suitable Vulkan device");
+}
+
+void print_device_candidates(const std::vector<DeviceCandidate> &candidates, std::ostream &out) {
+    out << "Vulkan devices:" << std::endl;
+    for (const auto& candidate : candidates) {
+	out << "  [" << candidate.index << "] " << candidate.name << " (" << device_type_name(candidate.type) << ", " << (candidate.local_memory >> 20) << " MiB local): ";
+	if (candidate.rejection.empty()) out << "score " << candidate.score << std::endl;
+	else out << "rejected, " << candidate.rejection << std::endl;
+    }
+}
+
+void print_queue_topology(const DeviceCandidate &candidate, std::ostream &out) {
+    const QueueTopology &queues = candidate.queues;
+    out << "Using [" << candidate.index << "] " << candidate.name << ": graphics family " << queues.graphics << ", present family " << queues.present
+	<< ", transfer family " << queues.transfer << (queues.dedicated_transfer() ? " (dedicated)" : " (shared with graphics)")
+	<< ", compute family " << queues.compute << (queues.async_compute() ? " (async)" : " (shared with graphics)") << std::endl;
+}
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#include "golden.h"
+
+struct Lab {
+    double l, a, b;
+};
+
+static const std::array<double, 256> &srgb_to_linear() {
+    static const std::array<double, 256> table = [] {
+	std::array<double, 256> values;
+	for (std::size_t i = 0; i < values.size(); ++i) {
+	    double c = static_cast<double>(i) / 255.0;
+	    values[i] = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+	}
+	return values;
+    }();
+    return table;
+}
+
+static Lab to_lab(const uint8_t *rgb) {
+    const auto &linear = srgb_to_linear();
+    double r = linear[rgb[0]], g = linear[rgb[1]], b = linear[rgb[2]];
+    double xyz[3] = {
+	(0.4124 * r + 0.3576 * g + 0.1805 * b) / 0.95047,
+	0.2126 * r + 0.7152 * g + 0.0722 * b,
+	(0.0193 * r + 0.1192 * g + 0.9505 * b) / 1.08883,
+    };
+    for (auto& t : xyz) t = t > 216.0 / 24389.0 ? std::cbrt(t) : (24389.0 / 27.0 * t + 16.0) / 116.0;
+    return {116.0 * xyz[1] - 16.0, 500.0 * (xyz[0] - xyz[1]), 200.0 * (xyz[1] - xyz[2])};
+}
+
+RGBImage read_ppm(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Failed to open " + path);
+    std::string magic;
+    unsigned max_value = 0;
+    RGBImage image;
+    in >> magic >> image.width >> image.height >> max_value;
+    if (magic != "P6" || max_value != 255 || !image.width || !image.height) throw std::runtime_error(path + " is not an 8-bit binary PPM");
+    in.get();
+    image.pixels.resize(static_cast<std::size_t>(image.width) * image.height * 3);
+    in.read(reinterpret_cast<char*>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()));
+    if (!in) throw std::runtime_error(path + " is truncated");
+    return image;
+}
+
+void write_ppm(const std::string &path, const RGBImage &image) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) throw std::runtime_error("Failed to open " + path);
+    out << "P6\n" << image.width << ' ' << image.height << "\n255\n";
+    out.write(reinterpret_cast<const char*>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()));
+}
+
+ImageDifference compare_images(const RGBImage &actual, const RGBImage &expected, RGBImage *diff) {
+    if (actual.width != expected.width || actual.height != expected.height)
+	throw std::runtime_error("Image is " + std::to_string(actual.width) + "x" + std::to_string(actual.height) + ", expected " + std::to_string(expected.width) + "x" + std::to_string(expected.height));
+    ImageDifference difference {0.0, 0.0, 0, static_cast<std::size_t>(actual.width) * actual.height};
+    if (diff) *diff = {actual.width, actual.height, std::vector<uint8_t>(actual.pixels.size())};
+    for (std::size_t i = 0; i < difference.pixels; ++i) {
+	Lab a = to_lab(&actual.pixels[3 * i]), e = to_lab(&expected.pixels[3 * i]);
+	double delta_e = std::sqrt((a.l - e.l) * (a.l - e.l) + (a.a - e.a) * (a.a - e.a) + (a.b - e.b) * (a.b - e.b));
+	difference.mean_delta_e += delta_e;
+	difference.max_delta_e = std::max(difference.max_delta_e, delta_e);
+	if (delta_e > PERCEPTIBLE_DELTA_E) ++difference.perceptible;
+	if (diff) {
+	    auto gray = static_cast<uint8_t>(expected.pixels[3 * i + 1] / 4);
+	    auto heat = static_cast<uint8_t>(std::min(delta_e * 255.0 / (4.0 * PERCEPTIBLE_DELTA_E), 255.0));
+	    diff->pixels[3 * i] = std::max(gray, heat);
+	    diff->pixels[3 * i + 1] = delta_e > PERCEPTIBLE_DELTA_E ? 0 : gray;
+	    diff->pixels[3 * i + 2] = delta_e > PERCEPTIBLE_DELTA_E ? 0 : gray;
+	}
+    }
+    if (difference.pixels) difference.mean_delta_e /= static_cast<double>(difference.pixels);
+    return difference;
+}
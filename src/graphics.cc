@@ -1,3 +1,5 @@
+#include <fstream>
+
 #include "graphics.h"
 
 void VK_ASSERT(VkResult res) {
@@ -8,7 +10,16 @@ void VK_ASSERT(VkResult res) {
 
 static constexpr int WIDTH = 800;
 static constexpr int HEIGHT = 600;
-static constexpr int MAX_FRAMES_IN_FLIGHT = 3;
+static constexpr std::size_t CAPTURE_SLOTS = MAX_FRAMES_IN_FLIGHT + 2;
+static constexpr std::size_t NO_FRAME = SIZE_MAX;
+static constexpr uint64_t FRAME_MEMORY_REPORT_FRAMES = 240;
+static constexpr uint64_t STREAM_FRAMES = 100;
+static constexpr VkDeviceSize STORAGE_BUFFER_ALIGNMENT = 256;
+
+struct DrawParameters {
+    uint32_t draw_offset;
+    uint32_t view_base;
+};
 
 const std::vector<const char*> validation_layers = {
     "VK_LAYER_KHRONOS_validation",
@@ -18,42 +29,18 @@ const std::vector<const char*> device_extensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 };
 
-struct Vertex {
-    glm::vec2 pos;
-    glm::vec3 color;
-
-    static VkVertexInputBindingDescription get_binding_description() {
-	VkVertexInputBindingDescription desc;
-	desc.binding = 0;
-	desc.stride = sizeof(Vertex);
-	desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-	return desc;
-    }
-
-    static std::array<VkVertexInputAttributeDescription, 2> get_attribute_descriptions() {
-	std::array<VkVertexInputAttributeDescription, 2> descs;
-	descs[0].binding = 0;
-	descs[0].location = 0;
-	descs[0].format = VK_FORMAT_R32G32_SFLOAT;
-	descs[0].offset = offsetof(Vertex, pos);
-	descs[1].binding = 0;
-	descs[1].location = 1;
-	descs[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-	descs[1].offset = offsetof(Vertex, color);
-	return descs;
-    }
+const std::vector<const char*> optional_device_extensions = {
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
 };
 
-const std::vector<Vertex> vertices = {
-    {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-    {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-    {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-    {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}},
+const std::vector<Vertex> corners = {
+    {{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}},
+    {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}},
+    {{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+    {{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}},
 };
 
-const std::vector<uint32_t> indices = {
-    0, 1, 2, 2, 3, 0,
-};
+static constexpr float MESH_AMPLITUDE = 0.05f;
 
 #ifdef NDEBUG
 static constexpr bool enable_debug = false;
@@ -61,92 +48,199 @@ static constexpr bool enable_debug = false;
 static constexpr bool enable_debug = true;
 #endif
 
-Graphics::Graphics() {
+Graphics::Graphics(Clock clock_source): frame_clock(std::move(clock_source)) {
+    TRACE_THREAD("render");
+    TRACE_ZONE("initialize");
+    start_time = frame_clock();
     glfw_init();
     create_instance();
     create_surface();
     create_physical_device();
+    configure_views();
     create_logical_device();
     create_swap_chain();
     create_image_views();
+    create_command_pool();
+    create_depth_resources();
+    create_view_targets();
     create_render_pass();
     create_descriptor_set_layout();
+    create_pipeline_cache();
+    create_pipeline_layout();
     create_graphics_pipeline();
+    create_compute_pipelines();
     create_framebuffers();
-    create_command_pool();
+    create_mesh();
     create_vertex_buffers();
     create_index_buffers();
+    create_scene();
     create_uniform_buffers();
+    create_object_buffers();
     create_descriptor_pool();
     create_descriptor_sets();
+    create_query_pool();
+#ifdef VKT_TRACE
+    calibrate_trace_clock();
+#endif
     create_command_buffers();
     create_sync_objects();
+    create_capture();
+    create_overlay();
+    create_overlay_pipelines();
 }
 
 Graphics::~Graphics() {
+    stream.finish();
     vkDeviceWaitIdle(device);
     cleanup_swap_chain();
-    for (auto fn : in_flight_fences)
+    retire_render_pass();
+    retire(VK_OBJECT_TYPE_PIPELINE_LAYOUT, pipeline_layout);
+    retire(VK_OBJECT_TYPE_SHADER_MODULE, vert_shader_module);
+    retire(VK_OBJECT_TYPE_SHADER_MODULE, frag_shader_module);
+    deletion_queue.flush();
+    for (auto fn : in_flight_fences) {
+	registry.release(VK_OBJECT_TYPE_FENCE, fn);
 	vkDestroyFence(device, fn, nullptr);
-    for (auto sm : render_finished_semaphores)
+    }
+    for (auto sm : render_finished_semaphores) {
+	registry.release(VK_OBJECT_TYPE_SEMAPHORE, sm);
 	vkDestroySemaphore(device, sm, nullptr);
-    for (auto sm : image_available_semaphores)
+    }
+    for (auto sm : image_available_semaphores) {
+	registry.release(VK_OBJECT_TYPE_SEMAPHORE, sm);
 	vkDestroySemaphore(device, sm, nullptr);
-    vkDestroyBuffer(device, index_buffer, nullptr);
-    vkFreeMemory(device, index_buffer_memory, nullptr);
-    vkDestroyBuffer(device, vertex_buffer, nullptr);
-    vkFreeMemory(device, vertex_buffer_memory, nullptr);
+    }
+    destroy_buffer(visibility_buffer, visibility_buffer_memory);
+    destroy_buffer(bounds_buffer, bounds_buffer_memory);
+    destroy_buffer(transform_buffer, transform_buffer_memory);
+    destroy_buffer(index_buffer, index_buffer_memory);
+    destroy_buffer(vertex_buffer, vertex_buffer_memory);
+    for (auto pipeline : {cull_pipeline, hiz_pipeline}) {
+	registry.release(VK_OBJECT_TYPE_PIPELINE, pipeline);
+	vkDestroyPipeline(device, pipeline, nullptr);
+    }
+    for (auto layout : {cull_pipeline_layout, hiz_pipeline_layout}) {
+	registry.release(VK_OBJECT_TYPE_PIPELINE_LAYOUT, layout);
+	vkDestroyPipelineLayout(device, layout, nullptr);
+    }
+    for (auto layout : {cull_descriptor_set_layout, hiz_descriptor_set_layout}) {
+	registry.release(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, layout);
+	vkDestroyDescriptorSetLayout(device, layout, nullptr);
+    }
+    for (auto module : {cull_shader_module, hiz_shader_module}) {
+	registry.release(VK_OBJECT_TYPE_SHADER_MODULE, module);
+	vkDestroyShaderModule(device, module, nullptr);
+    }
+    registry.release(VK_OBJECT_TYPE_SAMPLER, hiz_sampler);
+    vkDestroySampler(device, hiz_sampler, nullptr);
+    registry.release(VK_OBJECT_TYPE_COMMAND_POOL, command_pool);
     vkDestroyCommandPool(device, command_pool, nullptr);
+    destroy_overlay();
+    if (capture_writer) {
+	registry.release(VK_OBJECT_TYPE_COMMAND_POOL, capture_command_pool);
+	vkDestroyCommandPool(device, capture_command_pool, nullptr);
+	capture_writer->report(std::cout);
+	capture_writer.reset();
+    }
+    registry.release(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, descriptor_set_layout);
     vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
+    registry.release(VK_OBJECT_TYPE_PIPELINE_CACHE, pipeline_cache);
+    vkDestroyPipelineCache(device, pipeline_cache, nullptr);
+    if (std::size_t leaks = registry.report_leaks(std::cerr))
+	std::cerr << leaks << " Vulkan objects leaked at shutdown" << std::endl;
     vkDestroyDevice(device, nullptr);
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (surface != VK_NULL_HANDLE) vkDestroySurfaceKHR(instance, surface, nullptr);
     vkDestroyInstance(instance, nullptr);
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (!headless) {
+	glfwDestroyWindow(window);
+	glfwTerminate();
+    }
+#ifdef VKT_TRACE
+    export_trace();
+#endif
 }
 
 bool Graphics::should_close() {
-    return glfwWindowShouldClose(window);
+    return !headless && glfwWindowShouldClose(window);
 }
 
 void Graphics::render_tick() {
-    glfwPollEvents();
+    TRACE_STAGES("render_tick");
+    stream.frame();
+    TRACE_STAGE("poll_events");
+    if (!headless) glfwPollEvents();
     
-    vkWaitForFences(device, 1, &in_flight_fences.at(current_frame), VK_TRUE, UINT64_MAX);
+    TRACE_STAGE("wait_frame_fence");
+    stream.wait_for_fences(device, 1, &in_flight_fences.at(current_frame), VK_TRUE, UINT64_MAX);
+    frame_arenas.at(current_frame).rewind();
+    uint64_t heap_allocations = heap_allocation_count();
+    auto cpu_start = micro_sec();
+    TRACE_STAGE("retire_and_collect");
+    if (frame_count >= MAX_FRAMES_IN_FLIGHT) deletion_queue.collect(frame_count - MAX_FRAMES_IN_FLIGHT);
+    collect_capture(current_frame);
     
     uint32_t image_index;
     VkResult result;
-    result = vkAcquireNextImageKHR(device, swap_chain, UINT64_MAX, image_available_semaphores.at(current_frame), VK_NULL_HANDLE, &image_index);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-	frame_buffer_resized = false;
-	recreate_swap_chain();
-	return;
+    TRACE_STAGE("acquire");
+    if (headless) image_index = static_cast<uint32_t>(frame_count % swap_chain_images.size());
+    else {
+	result = vkAcquireNextImageKHR(device, swap_chain, UINT64_MAX, image_available_semaphores.at(current_frame), VK_NULL_HANDLE, &image_index);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+	    frame_buffer_resized = false;
+	    overlay_batcher.clear();
+	    recreate_swap_chain();
+	    return;
+	}
+	else if (result != VK_SUBOPTIMAL_KHR) VK_ASSERT(result);
     }
-    else if (result != VK_SUBOPTIMAL_KHR) VK_ASSERT(result);
     
+    TRACE_STAGE("wait_image_fence");
     if (images_in_flight.at(image_index) != VK_NULL_HANDLE)
-	vkWaitForFences(device, 1, &images_in_flight.at(image_index), VK_TRUE, UINT64_MAX);
+	stream.wait_for_fences(device, 1, &images_in_flight.at(image_index), VK_TRUE, UINT64_MAX);
+    TRACE_STAGE("collect_stats");
+    collect_occlusion_stats(image_index);
     images_in_flight.at(image_index) = in_flight_fences.at(current_frame);
-    vkResetFences(device, 1, &in_flight_fences.at(current_frame));
+    stream.reset_fences(device, 1, &in_flight_fences.at(current_frame));
 
+    TRACE_STAGE("update_uniforms");
+    if (command_buffer_scales.at(image_index) != render_scale()) record_command_buffer(image_index);
     update_uniform_buffers(image_index);
     
-    submit_info.pCommandBuffers = &command_buffers.at(image_index);
+    TRACE_STAGE("record");
+    VkCommandBuffer frame_command_buffers[3] = {command_buffers.at(image_index), VK_NULL_HANDLE, VK_NULL_HANDLE};
+    submit_info.commandBufferCount = 1;
+    if (VkCommandBuffer overlay_command_buffer = record_overlay(image_index))
+	frame_command_buffers[submit_info.commandBufferCount++] = overlay_command_buffer;
+    if (capture_writer && frame_count >= capture_from && record_capture(image_index))
+	frame_command_buffers[submit_info.commandBufferCount++] = capture_command_buffers.at(current_frame);
+    submit_info.pCommandBuffers = frame_command_buffers;
     submit_info.pWaitSemaphores = &image_available_semaphores.at(current_frame);
     submit_info.pSignalSemaphores = &render_finished_semaphores.at(current_frame);
-    vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fences.at(current_frame));
+    TRACE_STAGE("submit");
+    stream.queue_submit(graphics_queue, 1, &submit_info, in_flight_fences.at(current_frame));
     
-    present_info.pImageIndices = &image_index;
-    present_info.pWaitSemaphores = &render_finished_semaphores.at(current_frame);
-    result = vkQueuePresentKHR(present_queue, &present_info);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-	frame_buffer_resized = false;
-	recreate_swap_chain();
+    TRACE_STAGE("present");
+    if (!headless) {
+	present_info.pImageIndices = &image_index;
+	present_info.pWaitSemaphores = &render_finished_semaphores.at(current_frame);
+	result = vkQueuePresentKHR(present_queue, &present_info);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+	    frame_buffer_resized = false;
+	    recreate_swap_chain();
+	}
+	else VK_ASSERT(result);
     }
-    else VK_ASSERT(result);
+    occlusion_stats.cpu_ms += static_cast<double>(micro_sec() - cpu_start) / 1000.0;
     
+    TRACE_STAGE("end_frame");
+    collect_frame_memory(heap_allocation_count() - heap_allocations);
     current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+    ++frame_count;
+    if (snapshot_requested) {
+	snapshot_requested = false;
+	export_resource_snapshot("memory_snapshot_" + std::to_string(snapshot_count++) + ".json");
+    }
     if (frame_buffer_resized) {
 	frame_buffer_resized = false;
 	recreate_swap_chain();
@@ -154,12 +248,61 @@ void Graphics::render_tick() {
     }
 }
 
+void Graphics::export_resource_snapshot(const std::string &path) {
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("Failed to open " + path);
+    registry.export_snapshot(out);
+    std::cout << "Wrote memory snapshot to " << path << std::endl;
+}
+
+void Graphics::export_trace() {
+    const char *path = std::getenv("VKT_TRACE_FILE") ? std::getenv("VKT_TRACE_FILE") : "trace.json";
+    std::ofstream out(path);
+    if (!out) {
+	std::cerr << "Failed to open " << path << std::endl;
+	return;
+    }
+    std::size_t events = trace_export(out);
+    std::cout << "Wrote " << events << " trace events to " << path << std::endl;
+}
+
+void Graphics::collect_frame_memory(uint64_t allocations) {
+    ++frame_memory_stats.frames;
+    frame_memory_stats.allocations += allocations;
+    frame_memory_stats.max_allocations = std::max(frame_memory_stats.max_allocations, allocations);
+    if (!allocations) ++frame_memory_stats.clean_frames;
+    if (frame_memory_stats.frames < FRAME_MEMORY_REPORT_FRAMES) return;
+
+    uint64_t arena_allocations = 0, overflows = 0;
+    std::size_t peak_bytes = 0, capacity = 0;
+    for (auto &arena : frame_arenas) {
+	const ArenaStats &arena_stats = arena.get_stats();
+	arena_allocations += arena_stats.allocations;
+	overflows += arena_stats.overflows;
+	peak_bytes = std::max(peak_bytes, arena_stats.peak_bytes);
+	capacity += arena.capacity();
+	arena.reset_stats();
+    }
+    auto frames = static_cast<double>(frame_memory_stats.frames);
+    std::cout << "Host memory: " << static_cast<double>(frame_memory_stats.allocations) / frames << " heap allocations per frame (max " << frame_memory_stats.max_allocations << "), "
+	      << frame_memory_stats.clean_frames << "/" << frame_memory_stats.frames << " frames allocation-free, arena " << (frame_arena_enabled ? "on" : "off") << ": "
+	      << static_cast<double>(arena_allocations) / frames << " allocations per frame, peak " << static_cast<double>(peak_bytes) / 1024.0 << " KiB of "
+	      << capacity / 1024 << " KiB, " << overflows << " overflows" << std::endl;
+    frame_memory_stats = {};
+}
+
 static void framebuffer_resize_callback(GLFWwindow *window, [[maybe_unused]] int width, [[maybe_unused]] int height) {
     auto graphics = reinterpret_cast<Graphics*>(glfwGetWindowUserPointer(window));
     graphics->frame_buffer_resized = true;
 }
 
+static void key_callback(GLFWwindow *window, int key, [[maybe_unused]] int scancode, int action, [[maybe_unused]] int mods) {
+    auto graphics = reinterpret_cast<Graphics*>(glfwGetWindowUserPointer(window));
+    if (key == GLFW_KEY_F12 && action == GLFW_PRESS) graphics->snapshot_requested = true;
+}
+
 void Graphics::glfw_init() {
+    if (headless) return;
     glfwInit();
     
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -168,9 +311,11 @@ void Graphics::glfw_init() {
     window = glfwCreateWindow(WIDTH, HEIGHT, "vulkan-tutorial", nullptr, nullptr);
     glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+    glfwSetKeyCallback(window, key_callback);
 }
 
 void Graphics::create_instance() {
+    TRACE_ZONE(__func__);
     VkApplicationInfo app_info {};
     app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     app_info.pApplicationName = "vulkan-tutorial";
@@ -179,13 +324,35 @@ void Graphics::create_instance() {
     app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
     app_info.apiVersion = VK_API_VERSION_1_3;
 
-    uint32_t glfw_ext_count = 0;
-    const char** glfw_exts = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+    std::vector<const char*> instance_extensions;
+    if (!headless) {
+	uint32_t glfw_ext_count = 0;
+	const char** glfw_exts = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+	instance_extensions.assign(glfw_exts, glfw_exts + glfw_ext_count);
+    }
+    else instance_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+    if (enable_debug) {
+	uint32_t available_extension_count = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &available_extension_count, nullptr);
+	std::vector<VkExtensionProperties> available_extensions(available_extension_count);
+	vkEnumerateInstanceExtensionProperties(nullptr, &available_extension_count, available_extensions.data());
+	for (const char* layer_name : validation_layers) {
+	    uint32_t layer_extension_count = 0;
+	    vkEnumerateInstanceExtensionProperties(layer_name, &layer_extension_count, nullptr);
+	    available_extensions.resize(available_extension_count + layer_extension_count);
+	    vkEnumerateInstanceExtensionProperties(layer_name, &layer_extension_count, available_extensions.data() + available_extension_count);
+	    available_extension_count += layer_extension_count;
+	}
+	debug_utils_supported = std::find_if(available_extensions.begin(), available_extensions.end(), [](const VkExtensionProperties &props) {
+	    return !strcmp(props.extensionName, VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	}) != available_extensions.end();
+    }
+    if (debug_utils_supported) instance_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     VkInstanceCreateInfo instance_create_info {};
     instance_create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     instance_create_info.pApplicationInfo = &app_info;
-    instance_create_info.enabledExtensionCount = glfw_ext_count;
-    instance_create_info.ppEnabledExtensionNames = glfw_exts;
+    instance_create_info.enabledExtensionCount = static_cast<uint32_t>(instance_extensions.size());
+    instance_create_info.ppEnabledExtensionNames = instance_extensions.data();
     instance_create_info.enabledLayerCount = 0;
 
     if (enable_debug) {
@@ -212,60 +379,36 @@ void Graphics::create_instance() {
 }
 
 void Graphics::create_surface() {
+    TRACE_ZONE(__func__);
+    if (headless) return;
     VK_ASSERT(glfwCreateWindowSurface(instance, window, nullptr, &surface));
 }
 
 void Graphics::create_physical_device() {
-    physical_device = VK_NULL_HANDLE;
+    TRACE_ZONE(__func__);
     uint32_t physical_device_count = 0;
     vkEnumeratePhysicalDevices(instance, &physical_device_count, nullptr);
     if (!physical_device_count) throw std::runtime_error("Vulkan failure");
     std::vector<VkPhysicalDevice> physical_devices(physical_device_count);
     vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices.data());
-    for (const auto& poss_device : physical_devices) {
-	if ([](VkPhysicalDevice check_device) {
-	    VkPhysicalDeviceProperties device_properties;
-	    vkGetPhysicalDeviceProperties(check_device, &device_properties);
-	    VkPhysicalDeviceFeatures device_features;
-	    vkGetPhysicalDeviceFeatures(check_device, &device_features);
-	    if (enable_debug) std::cout << device_properties.deviceName << std::endl;
-
-	    uint32_t extension_count;
-	    vkEnumerateDeviceExtensionProperties(check_device, nullptr, &extension_count, nullptr);
-	    std::vector<VkExtensionProperties> available_extensions(extension_count);
-	    vkEnumerateDeviceExtensionProperties(check_device, nullptr, &extension_count, available_extensions.data());
-
-	    std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
-	    for (const auto& extension : available_extensions) {
-		required_extensions.erase(extension.extensionName);
-	    }
-	    
-	    return required_extensions.empty();
-	}(poss_device)) {
-	    physical_device = poss_device;
-	    break;
-	}
-    }
-    if (physical_device == VK_NULL_HANDLE) throw std::runtime_error("Vulkan failure");
+
+    std::vector<DeviceCandidate> candidates;
+    for (uint32_t i = 0; i < physical_device_count; ++i)
+	candidates.push_back(evaluate_device(physical_devices.at(i), i, surface, device_extensions, frame_memory()));
+    print_device_candidates(candidates, std::cout);
+    const DeviceCandidate &chosen = candidates.at(choose_device(candidates, std::getenv("VKT_DEVICE")));
+    print_queue_topology(chosen, std::cout);
+
+    physical_device = chosen.device;
+    graphics_family_index = chosen.queues.graphics;
+    present_family_index = headless ? chosen.queues.graphics : chosen.queues.present;
+    transfer_family_index = chosen.queues.transfer;
+    compute_family_index = chosen.queues.compute;
 }
 
 void Graphics::create_logical_device() {
-    uint32_t queue_family_count = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
-    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
-    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
-    graphics_family_index = 0;
-    present_family_index = static_cast<uint32_t>(queue_families.size());
-    for (; graphics_family_index < queue_families.size(); ++graphics_family_index) {
-	VkBool32 present_support = false;
-	vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, graphics_family_index, surface, &present_support);
-	if (present_support) present_family_index = graphics_family_index;
-	const auto& queue_family = queue_families[graphics_family_index];
-	if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) break;
-    }
-    if (graphics_family_index >= queue_families.size()) throw std::runtime_error("Vulkan failure");
-    if (present_family_index >= queue_families.size()) throw std::runtime_error("Vulkan failure");
-    std::set<uint32_t> unique_queue_families = {graphics_family_index, present_family_index};
+    TRACE_ZONE(__func__);
+    std::set<uint32_t> unique_queue_families = {graphics_family_index, present_family_index, transfer_family_index, compute_family_index};
 
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
     float queue_priority = 1.0f;
@@ -278,22 +421,54 @@ void Graphics::create_logical_device() {
 	queue_create_infos.push_back(queue_create_info);
     }
 
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, available_extensions.data());
+    std::vector<const char*> enabled_extensions(device_extensions);
+    for (const char* extension_name : optional_device_extensions) {
+	for (const auto& extension : available_extensions) {
+	    if (!strcmp(extension_name, extension.extensionName)) {
+		enabled_extensions.push_back(extension_name);
+		break;
+	    }
+	}
+    }
+    memory_budget_supported = std::find_if(enabled_extensions.begin(), enabled_extensions.end(), [](const char* name) {
+	return !strcmp(name, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }) != enabled_extensions.end();
+
     VkPhysicalDeviceFeatures device_features {};
+    device_features.drawIndirectFirstInstance = VK_TRUE;
+    VkPhysicalDeviceMultiviewFeatures multiview_features {};
+    multiview_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+    multiview_features.multiview = VK_TRUE;
     VkDeviceCreateInfo device_create_info {};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_create_info.pNext = &multiview_features;
     device_create_info.pQueueCreateInfos = queue_create_infos.data();
     device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
     device_create_info.pEnabledFeatures = &device_features;
-    device_create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-    device_create_info.ppEnabledExtensionNames = device_extensions.data();
+    device_create_info.enabledExtensionCount = static_cast<uint32_t>(enabled_extensions.size());
+    device_create_info.ppEnabledExtensionNames = enabled_extensions.data();
 
     VK_ASSERT(vkCreateDevice(physical_device, &device_create_info, nullptr, &device));
+    registry.init(physical_device, device, memory_budget_supported, debug_utils_supported);
+    deletion_queue.init(device);
+    if (stream_path) stream.open(stream_path, std::getenv("VKT_STREAM_FRAMES") ? std::stoull(std::getenv("VKT_STREAM_FRAMES")) : STREAM_FRAMES, physical_device, device_create_info);
 
     vkGetDeviceQueue(device, graphics_family_index, 0, &graphics_queue);
     vkGetDeviceQueue(device, present_family_index, 0, &present_queue);
+    vkGetDeviceQueue(device, transfer_family_index, 0, &transfer_queue);
+    vkGetDeviceQueue(device, compute_family_index, 0, &compute_queue);
 }
 
 void Graphics::create_swap_chain() {
+    TRACE_ZONE(__func__);
+    if (headless) {
+	create_headless_images();
+	return;
+    }
     VkSurfaceCapabilitiesKHR surface_capabilities;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &surface_capabilities);
     if (surface_capabilities.currentExtent.width != UINT32_MAX) {
@@ -315,10 +490,11 @@ void Graphics::create_swap_chain() {
 	swap_extent.width = surface_capabilities.maxImageExtent.width;
 	swap_extent.height = surface_capabilities.maxImageExtent.height;
     }
+    render_extent = {std::max(swap_extent.width / view_count, 1u), swap_extent.height};
     
     uint32_t format_count = 0;
     vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &format_count, nullptr);
-    std::vector<VkSurfaceFormatKHR> formats(format_count);
+    std::pmr::vector<VkSurfaceFormatKHR> formats(format_count, frame_memory());
     vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &format_count, formats.data());
     surface_format = formats.at(0);
     for (const auto& available_format : formats) {
@@ -330,7 +506,7 @@ void Graphics::create_swap_chain() {
 
     uint32_t present_mode_count = 0;
     vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, nullptr);
-    std::vector<VkPresentModeKHR> present_modes(present_mode_count);
+    std::pmr::vector<VkPresentModeKHR> present_modes(present_mode_count, frame_memory());
     vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, present_modes.data());
     VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
     for (const auto& available_present_mode : present_modes) {
@@ -350,7 +526,7 @@ void Graphics::create_swap_chain() {
     swapchain_create_info.imageColorSpace = surface_format.colorSpace;
     swapchain_create_info.imageExtent = swap_extent;
     swapchain_create_info.imageArrayLayers = 1;
-    swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    swapchain_create_info.imageUsage = swap_chain_image_usage(surface_capabilities.supportedUsageFlags);
     queue_family_indices[0] = graphics_family_index;
     queue_family_indices[1] = present_family_index;
     if (graphics_family_index != present_family_index) {
@@ -367,17 +543,59 @@ void Graphics::create_swap_chain() {
     swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchain_create_info.presentMode = present_mode;
     swapchain_create_info.clipped = VK_TRUE;
-    swapchain_create_info.oldSwapchain = VK_NULL_HANDLE;
+    swapchain_create_info.oldSwapchain = retired_swap_chain;
 
     VK_ASSERT(vkCreateSwapchainKHR(device, &swapchain_create_info, nullptr, &swap_chain));
+    swap_chain_usage = swapchain_create_info.imageUsage;
+    retired_swap_chain = VK_NULL_HANDLE;
+    registry.record(VK_OBJECT_TYPE_SWAPCHAIN_KHR, swap_chain, "swap_chain", "swapchain");
 }
 
-void Graphics::create_image_views() {
-    vkGetSwapchainImagesKHR(device, swap_chain, &image_count, nullptr);
+void Graphics::create_headless_images() {
+    swap_extent = {static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT)};
+    render_extent = {std::max(swap_extent.width / view_count, 1u), swap_extent.height};
+    surface_format = {VK_FORMAT_B8G8R8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+    image_count = MAX_FRAMES_IN_FLIGHT;
+    swap_chain = VK_NULL_HANDLE;
+    swap_chain_usage = swap_chain_image_usage(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
     swap_chain_images.resize(image_count);
-    vkGetSwapchainImagesKHR(device, swap_chain, &image_count, swap_chain_images.data());
+    headless_images_memory.resize(image_count);
+    for (uint32_t i = 0; i < image_count; ++i)
+	create_image(swap_extent, 1, surface_format.format, swap_chain_usage, swap_chain_images.at(i), headless_images_memory.at(i), "headless_image_" + std::to_string(i), "swapchain");
+}
 
-    for (const auto& swap_chain_image : swap_chain_images) {
+VkImageUsageFlags Graphics::swap_chain_image_usage(VkImageUsageFlags supported_usage) {
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    capture_supported = (supported_usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+    if (capture_directory && capture_supported) usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (view_count > 1) {
+	if (!(supported_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) throw std::runtime_error("Swap chain images cannot be copied to, multi-view rendering unavailable");
+	usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    else if (dynamic_resolution) {
+	VkFormatProperties format_properties;
+	vkGetPhysicalDeviceFormatProperties(physical_device, surface_format.format, &format_properties);
+	VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	if (!(supported_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) || (format_properties.optimalTilingFeatures & blit_features) != blit_features) {
+	    std::cerr << "Swap chain images cannot be the target of a filtered blit, dynamic resolution disabled" << std::endl;
+	    dynamic_resolution = false;
+	}
+	else usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    return usage;
+}
+
+void Graphics::create_image_views() {
+    TRACE_ZONE(__func__);
+    if (!headless) {
+	vkGetSwapchainImagesKHR(device, swap_chain, &image_count, nullptr);
+	swap_chain_images.resize(image_count);
+	vkGetSwapchainImagesKHR(device, swap_chain, &image_count, swap_chain_images.data());
+	stream.swap_chain_images(swap_chain_images, surface_format.format, swap_extent, swap_chain_usage);
+    }
+
+    for (std::size_t i = 0; i < swap_chain_images.size(); ++i) {
+	const auto& swap_chain_image = swap_chain_images.at(i);
 	VkImageViewCreateInfo image_view_create_info {};
 	image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	image_view_create_info.image = swap_chain_image;
@@ -393,93 +611,185 @@ void Graphics::create_image_views() {
 	image_view_create_info.subresourceRange.baseArrayLayer = 0;
 	image_view_create_info.subresourceRange.layerCount = 1;
 	swap_chain_image_views.emplace_back();
-	VK_ASSERT(vkCreateImageView(device, &image_view_create_info, nullptr, &swap_chain_image_views.back()));
+	VK_ASSERT(stream.create_image_view(device, &image_view_create_info, nullptr, &swap_chain_image_views.back()));
+	registry.record(VK_OBJECT_TYPE_IMAGE_VIEW, swap_chain_image_views.back(), "swap_chain_image_view_" + std::to_string(i), "swapchain");
     }
 }
 
 void Graphics::create_render_pass() {
-    color_attachment.format = surface_format.format;
-    color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    TRACE_ZONE(__func__);
+    render_pass = create_scene_render_pass(false, view_mask(), "render_pass");
+    render_pass_load = create_scene_render_pass(true, view_mask(), "render_pass_load");
+    render_pass_color_format = surface_format.format;
+    render_pass_depth_format = depth_format;
+    render_pass_offscreen = offscreen_views();
+}
+
+void Graphics::retire_render_pass() {
+    for (auto pipeline : scene_pipelines.take_pipelines()) retire(VK_OBJECT_TYPE_PIPELINE, pipeline);
+    for (auto pass : {render_pass, render_pass_load})
+	retire(VK_OBJECT_TYPE_RENDER_PASS, pass);
+}
 
+VkRenderPass Graphics::create_scene_render_pass(bool load, uint32_t mask, const std::string &name) {
+    VkImageLayout present_layout = offscreen_views() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkAttachmentDescription attachments[2] {};
+    attachments[0].format = surface_format.format;
+    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = load ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[0].finalLayout = load ? present_layout : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[1].format = depth_format;
+    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[1].loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[1].storeOp = load ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = load ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[1].finalLayout = load ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    VkAttachmentReference color_attachment_reference {};
     color_attachment_reference.attachment = 0;
     color_attachment_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    VkAttachmentReference depth_attachment_reference {};
+    depth_attachment_reference.attachment = 1;
+    depth_attachment_reference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+    VkSubpassDescription subpass {};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment_reference;
-
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpass.pDepthStencilAttachment = &depth_attachment_reference;
+
+    VkSubpassDependency dependencies[2] {};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
 
     VkRenderPassCreateInfo render_pass_create_info {};
     render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_create_info.attachmentCount = 1;
-    render_pass_create_info.pAttachments = &color_attachment;
+    render_pass_create_info.attachmentCount = 2;
+    render_pass_create_info.pAttachments = attachments;
     render_pass_create_info.subpassCount = 1;
     render_pass_create_info.pSubpasses = &subpass;
-    render_pass_create_info.dependencyCount = 1;
-    render_pass_create_info.pDependencies = &dependency;
+    render_pass_create_info.dependencyCount = 2;
+    render_pass_create_info.pDependencies = dependencies;
+
+    VkRenderPassMultiviewCreateInfo multiview_create_info {};
+    multiview_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+    multiview_create_info.subpassCount = 1;
+    multiview_create_info.pViewMasks = &mask;
+    multiview_create_info.correlationMaskCount = 1;
+    multiview_create_info.pCorrelationMasks = &mask;
+    if (mask) render_pass_create_info.pNext = &multiview_create_info;
     
-    VK_ASSERT(vkCreateRenderPass(device, &render_pass_create_info, nullptr, &render_pass));
+    VkRenderPass new_render_pass;
+    VK_ASSERT(stream.create_render_pass(device, &render_pass_create_info, nullptr, &new_render_pass));
+    registry.record(VK_OBJECT_TYPE_RENDER_PASS, new_render_pass, name, "scene");
+    return new_render_pass;
 }
 
 void Graphics::create_descriptor_set_layout() {
-    VkDescriptorSetLayoutBinding ubo_layout_binding {};
-    ubo_layout_binding.binding = 0;
-    ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    ubo_layout_binding.descriptorCount = 1;
-    ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    ubo_layout_binding.pImmutableSamplers = nullptr;
+    TRACE_ZONE(__func__);
+    VkDescriptorSetLayoutBinding layout_bindings[3] {};
+    for (uint32_t i = 0; i < 3; ++i) {
+	layout_bindings[i].binding = i;
+	layout_bindings[i].descriptorType = i ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	layout_bindings[i].descriptorCount = 1;
+	layout_bindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	layout_bindings[i].pImmutableSamplers = nullptr;
+    }
     VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info {};
     descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    descriptor_set_layout_create_info.bindingCount = 1;
-    descriptor_set_layout_create_info.pBindings = &ubo_layout_binding;
-    VK_ASSERT(vkCreateDescriptorSetLayout(device, &descriptor_set_layout_create_info, nullptr, &descriptor_set_layout));
+    descriptor_set_layout_create_info.bindingCount = 3;
+    descriptor_set_layout_create_info.pBindings = layout_bindings;
+    VK_ASSERT(stream.create_descriptor_set_layout(device, &descriptor_set_layout_create_info, nullptr, &descriptor_set_layout));
+    registry.record(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, descriptor_set_layout, "descriptor_set_layout", "scene");
 }
 
-void Graphics::create_graphics_pipeline() {
-    std::size_t vert_size = static_cast<std::size_t>(&_binary_build_shaders_vert_spv_end - &_binary_build_shaders_vert_spv_start);
-    std::size_t frag_size = static_cast<std::size_t>(&_binary_build_shaders_frag_spv_end - &_binary_build_shaders_frag_spv_start);
-    std::vector<char> vert_spv(vert_size);
-    std::vector<char> frag_spv(frag_size);
-    memcpy(vert_spv.data(), &_binary_build_shaders_vert_spv_start, vert_size);
-    memcpy(frag_spv.data(), &_binary_build_shaders_frag_spv_start, frag_size);
-
-    VkShaderModuleCreateInfo vert_shader_module_create_info {};
-    vert_shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    vert_shader_module_create_info.codeSize = vert_size;
-    vert_shader_module_create_info.pCode = reinterpret_cast<const uint32_t*>(vert_spv.data());
-
-    VK_ASSERT(vkCreateShaderModule(device, &vert_shader_module_create_info, nullptr, &vert_shader_module));
+void Graphics::create_pipeline_cache() {
+    TRACE_ZONE(__func__);
+    VkPipelineCacheCreateInfo pipeline_cache_create_info {};
+    pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    VK_ASSERT(vkCreatePipelineCache(device, &pipeline_cache_create_info, nullptr, &pipeline_cache));
+    registry.record(VK_OBJECT_TYPE_PIPELINE_CACHE, pipeline_cache, "pipeline_cache", "pipeline_variants");
+}
+
+void Graphics::create_pipeline_layout() {
+    TRACE_ZONE(__func__);
+    vert_shader_module = create_shader_module(&_binary_build_shaders_vert_spv_start, &_binary_build_shaders_vert_spv_end, "vert_shader_module", "scene");
+    frag_shader_module = create_shader_module(&_binary_build_shaders_frag_spv_start, &_binary_build_shaders_frag_spv_end, "frag_shader_module", "scene");
+
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info {};
+    pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_create_info.setLayoutCount = 1;
+    pipeline_layout_create_info.pSetLayouts = &descriptor_set_layout;
+    VkPushConstantRange push_constant_range {};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(DrawParameters);
+    pipeline_layout_create_info.pushConstantRangeCount = 1;
+    pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
     
-    VkShaderModuleCreateInfo frag_shader_module_create_info {};
-    frag_shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    frag_shader_module_create_info.codeSize = frag_size;
-    frag_shader_module_create_info.pCode = reinterpret_cast<const uint32_t*>(frag_spv.data());
+    VK_ASSERT(stream.create_pipeline_layout(device, &pipeline_layout_create_info, nullptr, &pipeline_layout));
+    registry.record(VK_OBJECT_TYPE_PIPELINE_LAYOUT, pipeline_layout, "pipeline_layout", "scene");
+}
 
-    VK_ASSERT(vkCreateShaderModule(device, &frag_shader_module_create_info, nullptr, &frag_shader_module));
+void Graphics::create_graphics_pipeline() {
+    TRACE_ZONE(__func__);
+    scene_pipelines.reset([this](const PipelineVariant &variant) { return create_scene_pipeline(variant); }, &registry);
+    if (prewarm_pipelines) {
+	std::vector<PipelineVariant> variants {scene_variant};
+	for (uint32_t shading = 0; shading < SHADING_MODES; ++shading) {
+	    for (uint32_t lights = 0; lights <= MAX_LIGHTS; ++lights) variants.push_back({static_cast<ShadingMode>(shading), lights, VK_CULL_MODE_BACK_BIT});
+	}
+	PipelineVariantStats before = scene_pipelines.get_stats();
+	std::size_t compiled = scene_pipelines.prewarm(variants);
+	const PipelineVariantStats &after = scene_pipelines.get_stats();
+	std::cout << "Pipelines: " << compiled << " variants compiled in parallel in " << after.compile_ms - before.compile_ms << " ms, " << after.deduplicated - before.deduplicated << " requests deduplicated" << std::endl;
+    }
+    graphics_pipeline = scene_pipelines.get(scene_variant);
+}
+
+VkPipeline Graphics::create_scene_pipeline(const PipelineVariant &variant) {
+    uint32_t specialization_data[] = {static_cast<uint32_t>(variant.shading), variant.light_count};
+    VkSpecializationMapEntry specialization_entries[2] {};
+    for (uint32_t i = 0; i < 2; ++i) {
+	specialization_entries[i].constantID = i;
+	specialization_entries[i].offset = i * static_cast<uint32_t>(sizeof(uint32_t));
+	specialization_entries[i].size = sizeof(uint32_t);
+    }
+    VkSpecializationInfo specialization_info {};
+    specialization_info.mapEntryCount = 2;
+    specialization_info.pMapEntries = specialization_entries;
+    specialization_info.dataSize = sizeof(specialization_data);
+    specialization_info.pData = specialization_data;
 
     VkPipelineShaderStageCreateInfo vert_shader_stage_create_info {};
     vert_shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vert_shader_stage_create_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
     vert_shader_stage_create_info.module = vert_shader_module;
     vert_shader_stage_create_info.pName = "main";
+    vert_shader_stage_create_info.pSpecializationInfo = &specialization_info;
 
     VkPipelineShaderStageCreateInfo frag_shader_stage_create_info {};
     frag_shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     frag_shader_stage_create_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     frag_shader_stage_create_info.module = frag_shader_module;
     frag_shader_stage_create_info.pName = "main";
+    frag_shader_stage_create_info.pSpecializationInfo = &specialization_info;
 
     VkPipelineShaderStageCreateInfo shader_stages_create_info[] = {vert_shader_stage_create_info, frag_shader_stage_create_info};
 
@@ -498,22 +808,16 @@ void Graphics::create_graphics_pipeline() {
     input_assembly_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     input_assembly_create_info.primitiveRestartEnable = VK_FALSE;
 
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(swap_extent.width);
-    viewport.height = static_cast<float>(swap_extent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    scissor.offset = {0, 0};
-    scissor.extent = swap_extent;
-
     VkPipelineViewportStateCreateInfo viewport_state_create_info {};
     viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewport_state_create_info.viewportCount = 1;
-    viewport_state_create_info.pViewports = &viewport;
     viewport_state_create_info.scissorCount = 1;
-    viewport_state_create_info.pScissors = &scissor;
+
+    VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_state_create_info {};
+    dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state_create_info.dynamicStateCount = 2;
+    dynamic_state_create_info.pDynamicStates = dynamic_states;
 
     VkPipelineRasterizationStateCreateInfo rasterizer_state_create_info {};
     rasterizer_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -521,7 +825,7 @@ void Graphics::create_graphics_pipeline() {
     rasterizer_state_create_info.rasterizerDiscardEnable = VK_FALSE;
     rasterizer_state_create_info.polygonMode = VK_POLYGON_MODE_FILL;
     rasterizer_state_create_info.lineWidth = 1.0f;
-    rasterizer_state_create_info.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer_state_create_info.cullMode = variant.cull_mode;
     rasterizer_state_create_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
     rasterizer_state_create_info.depthBiasEnable = VK_FALSE;
     rasterizer_state_create_info.depthBiasConstantFactor = 0.0f;
@@ -537,6 +841,14 @@ void Graphics::create_graphics_pipeline() {
     multisample_state_create_info.alphaToCoverageEnable = VK_FALSE;
     multisample_state_create_info.alphaToOneEnable = VK_FALSE;
 
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state_create_info {};
+    depth_stencil_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_state_create_info.depthTestEnable = VK_TRUE;
+    depth_stencil_state_create_info.depthWriteEnable = VK_TRUE;
+    depth_stencil_state_create_info.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil_state_create_info.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil_state_create_info.stencilTestEnable = VK_FALSE;
+
     VkPipelineColorBlendAttachmentState color_blend_attachment {};
     color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
     color_blend_attachment.blendEnable = VK_FALSE;
@@ -558,15 +870,6 @@ void Graphics::create_graphics_pipeline() {
     color_blend_state_create_info.blendConstants[2] = 0.0f;
     color_blend_state_create_info.blendConstants[3] = 0.0f;
     
-    VkPipelineLayoutCreateInfo pipeline_layout_create_info {};
-    pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_create_info.setLayoutCount = 1;
-    pipeline_layout_create_info.pSetLayouts = &descriptor_set_layout;
-    pipeline_layout_create_info.pushConstantRangeCount = 0;
-    pipeline_layout_create_info.pPushConstantRanges = nullptr;
-    
-    VK_ASSERT(vkCreatePipelineLayout(device, &pipeline_layout_create_info, nullptr, &pipeline_layout));
-
     VkGraphicsPipelineCreateInfo graphics_pipeline_create_info {};
     graphics_pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     graphics_pipeline_create_info.stageCount = 2;
@@ -576,103 +879,224 @@ void Graphics::create_graphics_pipeline() {
     graphics_pipeline_create_info.pViewportState = &viewport_state_create_info;
     graphics_pipeline_create_info.pRasterizationState = &rasterizer_state_create_info;
     graphics_pipeline_create_info.pMultisampleState = &multisample_state_create_info;
-    graphics_pipeline_create_info.pDepthStencilState = nullptr;
+    graphics_pipeline_create_info.pDepthStencilState = &depth_stencil_state_create_info;
     graphics_pipeline_create_info.pColorBlendState = &color_blend_state_create_info;
-    graphics_pipeline_create_info.pDynamicState = nullptr;
+    graphics_pipeline_create_info.pDynamicState = &dynamic_state_create_info;
     graphics_pipeline_create_info.layout = pipeline_layout;
     graphics_pipeline_create_info.renderPass = render_pass;
     graphics_pipeline_create_info.subpass = 0;
     graphics_pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
     graphics_pipeline_create_info.basePipelineIndex = -1;
 
-    VK_ASSERT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphics_pipeline_create_info, nullptr, &graphics_pipeline));
+    VkPipeline pipeline;
+    VK_ASSERT(stream.create_graphics_pipelines(device, pipeline_cache, 1, &graphics_pipeline_create_info, nullptr, &pipeline));
+    return pipeline;
 }
 
 void Graphics::create_framebuffers() {
+    TRACE_ZONE(__func__);
+    if (offscreen_views()) {
+	view_framebuffers.resize(view_color_views.size());
+	for (std::size_t i = 0; i < view_framebuffers.size(); ++i) {
+	    VkFramebufferCreateInfo framebuffer_create_info {};
+	    framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	    framebuffer_create_info.renderPass = render_pass;
+	    VkImageView attachments[2] = {view_color_views.at(i), view_depth_views.at(i)};
+	    framebuffer_create_info.attachmentCount = 2;
+	    framebuffer_create_info.pAttachments = attachments;
+	    framebuffer_create_info.width = render_extent.width;
+	    framebuffer_create_info.height = render_extent.height;
+	    framebuffer_create_info.layers = 1;
+
+	    VK_ASSERT(stream.create_framebuffer(device, &framebuffer_create_info, nullptr, &view_framebuffers.at(i)));
+	    registry.record(VK_OBJECT_TYPE_FRAMEBUFFER, view_framebuffers.at(i), "view_framebuffer_" + std::to_string(i), "multiview");
+	}
+	return;
+    }
     swap_chain_framebuffers.resize(swap_chain_image_views.size());
     for (std::size_t i = 0; i < swap_chain_framebuffers.size(); ++i) {
 	VkFramebufferCreateInfo framebuffer_create_info {};
 	framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 	framebuffer_create_info.renderPass = render_pass;
-	framebuffer_create_info.attachmentCount = 1;
-	framebuffer_create_info.pAttachments = &swap_chain_image_views.at(i);
+	VkImageView attachments[2] = {swap_chain_image_views.at(i), depth_image_view};
+	framebuffer_create_info.attachmentCount = 2;
+	framebuffer_create_info.pAttachments = attachments;
 	framebuffer_create_info.width = swap_extent.width;
 	framebuffer_create_info.height = swap_extent.height;
 	framebuffer_create_info.layers = 1;
 
-	VK_ASSERT(vkCreateFramebuffer(device, &framebuffer_create_info, nullptr, &swap_chain_framebuffers.at(i)));
+	VK_ASSERT(stream.create_framebuffer(device, &framebuffer_create_info, nullptr, &swap_chain_framebuffers.at(i)));
+	registry.record(VK_OBJECT_TYPE_FRAMEBUFFER, swap_chain_framebuffers.at(i), "swap_chain_framebuffer_" + std::to_string(i), "swapchain");
     }
 }
 
 void Graphics::create_command_pool() {
+    TRACE_ZONE(__func__);
     VkCommandPoolCreateInfo command_pool_create_info {};
     command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     command_pool_create_info.queueFamilyIndex = graphics_family_index;
-    command_pool_create_info.flags = 0;
+    command_pool_create_info.flags = dynamic_resolution ? VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT : 0;
 
-    VK_ASSERT(vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool));
+    VK_ASSERT(stream.create_command_pool(device, &command_pool_create_info, nullptr, &command_pool));
+    registry.record(VK_OBJECT_TYPE_COMMAND_POOL, command_pool, "command_pool", "frame");
 }
 
-void Graphics::create_vertex_buffers() {
-    std::size_t size = sizeof(vertices[0]) * vertices.size();
+void Graphics::create_mesh() {
+    TRACE_ZONE(__func__);
+    const char *detail_env = std::getenv("VKT_MESH_DETAIL");
+    uint32_t detail = detail_env ? static_cast<uint32_t>(std::stoul(detail_env)) : 64;
+    detail = std::max(detail, 1u);
+
+    std::vector<glm::vec3> positions;
+    mesh_vertices.clear();
+    for (uint32_t y = 0; y <= detail; ++y) {
+	for (uint32_t x = 0; x <= detail; ++x) {
+	    float u = static_cast<float>(x) / static_cast<float>(detail), v = static_cast<float>(y) / static_cast<float>(detail);
+	    auto blend = [u, v](const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, const glm::vec3 &d) {
+		return (a * (1.0f - u) + b * u) * (1.0f - v) + (d * (1.0f - u) + c * u) * v;
+	    };
+	    glm::vec3 pos = blend(corners[0].pos, corners[1].pos, corners[2].pos, corners[3].pos);
+	    pos.z = MESH_AMPLITUDE * std::sin(u * 18.849556f) * std::cos(v * 12.566371f);
+	    mesh_vertices.push_back({pos, blend(corners[0].color, corners[1].color, corners[2].color, corners[3].color)});
+	    positions.push_back(pos);
+	}
+    }
+    std::vector<uint32_t> tile_indices;
+    for (uint32_t y = 0; y < detail; ++y) {
+	for (uint32_t x = 0; x < detail; ++x) {
+	    uint32_t i = y * (detail + 1) + x;
+	    tile_indices.insert(tile_indices.end(), {i, i + 1, i + detail + 2, i + detail + 2, i + detail + 1, i});
+	}
+    }
 
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+    LODPacker packer;
+    mesh_lod = packer.add(positions, tile_indices);
+    mesh_indices = packer.get_indices();
+    std::cout << "Mesh LODs:";
+    for (const auto& level : mesh_lod.levels)
+	std::cout << " " << level.index_count / 3 << " tris (error " << level.error << ")";
+    std::cout << std::endl;
+}
 
-    void *data;
-    vkMapMemory(device, staging_buffer_memory, 0, size, 0, &data);
-    memcpy(data, vertices.data(), size);
-    vkUnmapMemory(device, staging_buffer_memory);
-    
-    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertex_buffer, vertex_buffer_memory);
-    copy_buffer(vertex_buffer, staging_buffer, size);
+AABB Graphics::mesh_bounds() const {
+    AABB bounds {glm::vec3(std::numeric_limits<float>::infinity()), glm::vec3(-std::numeric_limits<float>::infinity())};
+    for (const auto& vertex : mesh_vertices) {
+	bounds.min = glm::min(bounds.min, vertex.pos);
+	bounds.max = glm::max(bounds.max, vertex.pos);
+    }
+    return bounds;
+}
 
-    vkDestroyBuffer(device, staging_buffer, nullptr);
-    vkFreeMemory(device, staging_buffer_memory, nullptr);
+void Graphics::create_vertex_buffers() {
+    TRACE_ZONE(__func__);
+    upload_buffer(mesh_vertices.data(), sizeof(mesh_vertices[0]) * mesh_vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertex_buffer, vertex_buffer_memory, "vertex_buffer", "scene");
 }
 
 void Graphics::create_index_buffers() {
-    std::size_t size = sizeof(indices[0]) * indices.size();
+    TRACE_ZONE(__func__);
+    upload_buffer(mesh_indices.data(), sizeof(mesh_indices[0]) * mesh_indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, index_buffer, index_buffer_memory, "index_buffer", "scene");
+}
 
-    VkBuffer staging_buffer;
-    VkDeviceMemory staging_buffer_memory;
-    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+void Graphics::create_uniform_buffers() {
+    TRACE_ZONE(__func__);
+    std::size_t size = sizeof(UniformBufferObject) * swap_chain_images.size();
 
-    void *data;
-    vkMapMemory(device, staging_buffer_memory, 0, size, 0, &data);
-    memcpy(data, indices.data(), size);
-    vkUnmapMemory(device, staging_buffer_memory);
-    
-    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, index_buffer, index_buffer_memory);
-    copy_buffer(index_buffer, staging_buffer, size);
+    create_buffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniform_buffers, uniform_buffers_memory, "uniform_buffers", "scene");
+}
 
-    vkDestroyBuffer(device, staging_buffer, nullptr);
-    vkFreeMemory(device, staging_buffer_memory, nullptr);
+void Graphics::generate_scene() {
+    const char *object_count_env = std::getenv("VKT_OBJECTS");
+    std::size_t object_count = object_count_env ? std::stoull(object_count_env) : 1;
+    std::size_t side = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(object_count))));
+    float spacing = 1.25f;
+    float origin = -0.5f * spacing * static_cast<float>(side - 1);
+
+    AABB bounds = mesh_bounds();
+    object_transforms.resize(object_count);
+    object_bounds.resize(object_count);
+    for (std::size_t i = 0; i < object_count; ++i) {
+	glm::vec3 position(origin + spacing * static_cast<float>(i % side), origin + spacing * static_cast<float>(i / side), 0.0f);
+	object_transforms.at(i) = glm::translate(glm::mat4(1.0f), position);
+	object_bounds.at(i) = bounds.transformed(object_transforms.at(i));
+    }
+    bvh.build(object_bounds);
 }
 
-void Graphics::create_uniform_buffers() {
-    std::size_t size = sizeof(UniformBufferObject) * swap_chain_images.size();
+void Graphics::load_scene(const std::string &path) {
+    auto before = micro_sec();
+    SceneFile scene(path);
+    std::size_t object_count = scene.object_count();
+    if (!object_count) throw std::runtime_error(path + " contains no objects");
+    AABB bounds = mesh_bounds();
+    for (std::size_t i = 0; i < scene.mesh_count(); ++i) {
+	const AABB &scene_bounds = scene.meshes()[i].bounds;
+	if (glm::any(glm::lessThan(bounds.min, scene_bounds.min)) || glm::any(glm::greaterThan(bounds.max, scene_bounds.max)))
+	    throw std::runtime_error(path + ": mesh " + std::to_string(i) + " is bounded smaller than the rendered mesh, culling would drop visible objects");
+    }
+    object_transforms.assign(scene.transforms(), scene.transforms() + object_count);
+    object_bounds.assign(scene.bounds(), scene.bounds() + object_count);
+    bvh.assign(scene.bvh_nodes(), scene.bvh_node_count(), scene.bvh_indices(), object_bounds);
+    std::cout << "Loaded " << object_count << " objects, " << scene.mesh_count() << " meshes, " << scene.material_count() << " materials from " << path
+	      << " in " << static_cast<double>(micro_sec() - before) / 1000.0 << " ms" << std::endl;
+}
 
-    create_buffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniform_buffers, uniform_buffers_memory);
+void Graphics::create_scene() {
+    TRACE_ZONE(__func__);
+    if (const char *scene_path = std::getenv("VKT_SCENE")) load_scene(scene_path);
+    else generate_scene();
+    std::size_t object_count = object_transforms.size();
+    lod_selector.resize(object_count);
+
+    std::vector<glm::vec4> gpu_bounds(2 * object_count);
+    for (std::size_t i = 0; i < object_count; ++i) {
+	gpu_bounds.at(2 * i) = glm::vec4(object_bounds.at(i).min, 1.0f);
+	gpu_bounds.at(2 * i + 1) = glm::vec4(object_bounds.at(i).max, 1.0f);
+    }
+    std::vector<uint32_t> visibility(std::max<std::size_t>(object_count, 1), 0);
+    upload_buffer(object_transforms.data(), sizeof(glm::mat4) * std::max<std::size_t>(object_count, 1), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, transform_buffer, transform_buffer_memory, "transform_buffer", "scene");
+    upload_buffer(gpu_bounds.data(), sizeof(glm::vec4) * std::max<std::size_t>(2 * object_count, 1), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, bounds_buffer, bounds_buffer_memory, "bounds_buffer", "scene");
+    upload_buffer(visibility.data(), sizeof(uint32_t) * visibility.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, visibility_buffer, visibility_buffer_memory, "visibility_buffer", "occlusion");
+}
+
+void Graphics::create_object_buffers() {
+    TRACE_ZONE(__func__);
+    auto align = [](VkDeviceSize size) { return (size + STORAGE_BUFFER_ALIGNMENT - 1) / STORAGE_BUFFER_ALIGNMENT * STORAGE_BUFFER_ALIGNMENT; };
+    std::size_t object_count = std::max<std::size_t>(object_transforms.size(), 1);
+    candidate_buffer_stride = align(CANDIDATE_HEADER_SIZE + sizeof(uint32_t) * object_count);
+    draw_id_buffer_stride = align(2 * sizeof(uint32_t) * object_count);
+    indirect_buffer_stride = align(2 * MAX_LOD_LEVELS * sizeof(VkDrawIndexedIndirectCommand));
+    create_buffer(candidate_buffer_stride * swap_chain_images.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, candidate_buffers, candidate_buffers_memory, "candidate_buffers", "occlusion");
+    create_buffer(draw_id_buffer_stride * swap_chain_images.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, draw_id_buffers, draw_id_buffers_memory, "draw_id_buffers", "occlusion");
+    create_buffer(indirect_buffer_stride * swap_chain_images.size(), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, indirect_buffers, indirect_buffers_memory, "indirect_buffers", "occlusion");
+    image_candidate_counts.assign(swap_chain_images.size(), NO_CANDIDATES);
 }
 
 void Graphics::create_descriptor_pool() {
-    VkDescriptorPoolSize descriptor_pool_size {};
-    descriptor_pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptor_pool_size.descriptorCount = static_cast<uint32_t>(swap_chain_images.size());
+    TRACE_ZONE(__func__);
+    uint32_t images = static_cast<uint32_t>(swap_chain_images.size());
+    VkDescriptorPoolSize descriptor_pool_sizes[4] {};
+    descriptor_pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptor_pool_sizes[0].descriptorCount = 2 * images;
+    descriptor_pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_pool_sizes[1].descriptorCount = 7 * images;
+    descriptor_pool_sizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptor_pool_sizes[2].descriptorCount = images + hiz_levels;
+    descriptor_pool_sizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptor_pool_sizes[3].descriptorCount = hiz_levels;
 
     VkDescriptorPoolCreateInfo descriptor_pool_create_info {};
     descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descriptor_pool_create_info.poolSizeCount = 1;
-    descriptor_pool_create_info.pPoolSizes = &descriptor_pool_size;
-    descriptor_pool_create_info.maxSets = static_cast<uint32_t>(swap_chain_images.size());
+    descriptor_pool_create_info.poolSizeCount = 4;
+    descriptor_pool_create_info.pPoolSizes = descriptor_pool_sizes;
+    descriptor_pool_create_info.maxSets = 2 * images + hiz_levels;
 
-    VK_ASSERT(vkCreateDescriptorPool(device, &descriptor_pool_create_info, nullptr, &descriptor_pool));
+    VK_ASSERT(stream.create_descriptor_pool(device, &descriptor_pool_create_info, nullptr, &descriptor_pool));
+    registry.record(VK_OBJECT_TYPE_DESCRIPTOR_POOL, descriptor_pool, "descriptor_pool", "scene");
 }
 
 void Graphics::create_descriptor_sets() {
-    std::vector<VkDescriptorSetLayout> descriptor_set_layouts(swap_chain_images.size(), descriptor_set_layout);
+    TRACE_ZONE(__func__);
+    std::pmr::vector<VkDescriptorSetLayout> descriptor_set_layouts(swap_chain_images.size(), descriptor_set_layout, frame_memory());
     VkDescriptorSetAllocateInfo descriptor_set_allocate_info {};
     descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     descriptor_set_allocate_info.descriptorPool = descriptor_pool;
@@ -680,7 +1104,7 @@ void Graphics::create_descriptor_sets() {
     descriptor_set_allocate_info.pSetLayouts = descriptor_set_layouts.data();
 
     descriptor_sets.resize(swap_chain_images.size());
-    VK_ASSERT(vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, descriptor_sets.data()));
+    VK_ASSERT(stream.allocate_descriptor_sets(device, &descriptor_set_allocate_info, descriptor_sets.data()));
 
     for (uint32_t i = 0; i < static_cast<uint32_t>(swap_chain_images.size()); ++i) {
 	VkDescriptorBufferInfo descriptor_buffer_info {};
@@ -688,62 +1112,148 @@ void Graphics::create_descriptor_sets() {
 	descriptor_buffer_info.offset = i * sizeof(UniformBufferObject);
 	descriptor_buffer_info.range = sizeof(UniformBufferObject);
 
-	VkWriteDescriptorSet descriptor_write {};
-	descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptor_write.dstSet = descriptor_sets.at(i);
-	descriptor_write.dstBinding = 0;
-	descriptor_write.dstArrayElement = 0;
-	descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	descriptor_write.descriptorCount = 1;
-	descriptor_write.pBufferInfo = &descriptor_buffer_info;
-	descriptor_write.pImageInfo = nullptr;
-	descriptor_write.pTexelBufferView = nullptr;
-
-	vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
+	VkDescriptorBufferInfo transform_buffer_info {};
+	transform_buffer_info.buffer = transform_buffer;
+	transform_buffer_info.offset = 0;
+	transform_buffer_info.range = VK_WHOLE_SIZE;
+
+	VkDescriptorBufferInfo draw_id_buffer_info {};
+	draw_id_buffer_info.buffer = draw_id_buffers;
+	draw_id_buffer_info.offset = i * draw_id_buffer_stride;
+	draw_id_buffer_info.range = draw_id_buffer_stride;
+
+	VkWriteDescriptorSet descriptor_writes[3] {};
+	descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptor_writes[0].dstSet = descriptor_sets.at(i);
+	descriptor_writes[0].dstBinding = 0;
+	descriptor_writes[0].dstArrayElement = 0;
+	descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptor_writes[0].descriptorCount = 1;
+	descriptor_writes[0].pBufferInfo = &descriptor_buffer_info;
+	descriptor_writes[0].pImageInfo = nullptr;
+	descriptor_writes[0].pTexelBufferView = nullptr;
+	descriptor_writes[1] = descriptor_writes[0];
+	descriptor_writes[1].dstBinding = 1;
+	descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptor_writes[1].pBufferInfo = &transform_buffer_info;
+	descriptor_writes[2] = descriptor_writes[1];
+	descriptor_writes[2].dstBinding = 2;
+	descriptor_writes[2].pBufferInfo = &draw_id_buffer_info;
+
+	stream.update_descriptor_sets(device, 3, descriptor_writes, 0, nullptr);
     }
+
+    create_occlusion_descriptor_sets();
 }
 
 void Graphics::create_command_buffers() {
+    TRACE_ZONE(__func__);
     VkCommandBufferAllocateInfo command_buffer_allocate_info {};
     command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     command_buffer_allocate_info.commandPool = command_pool;
     command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    command_buffer_allocate_info.commandBufferCount = static_cast<uint32_t>(swap_chain_framebuffers.size());
+    command_buffer_allocate_info.commandBufferCount = static_cast<uint32_t>(swap_chain_images.size());
     
-    command_buffers.resize(swap_chain_framebuffers.size());
-    VK_ASSERT(vkAllocateCommandBuffers(device, &command_buffer_allocate_info, command_buffers.data()));
-
-    clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    for (std::size_t i = 0; i < command_buffers.size(); ++i) {
-	VkCommandBufferBeginInfo command_buffer_begin_info {};
-	command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	command_buffer_begin_info.flags = 0;
-	command_buffer_begin_info.pInheritanceInfo = nullptr;
-	VK_ASSERT(vkBeginCommandBuffer(command_buffers.at(i), &command_buffer_begin_info));
-
-	VkRenderPassBeginInfo render_pass_begin_info {};
-	render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	render_pass_begin_info.renderPass = render_pass;
-	render_pass_begin_info.framebuffer = swap_chain_framebuffers.at(i);
-	render_pass_begin_info.renderArea.offset = {0, 0};
-	render_pass_begin_info.renderArea.extent = swap_extent;
-	render_pass_begin_info.clearValueCount = 1;
-	render_pass_begin_info.pClearValues = &clear_color;
-	vkCmdBeginRenderPass(command_buffers.at(i), &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-
-	vkCmdBindPipeline(command_buffers.at(i), VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
-	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(command_buffers.at(i), 0, 1, &vertex_buffer, &offset);
-	vkCmdBindIndexBuffer(command_buffers.at(i), index_buffer, 0, VK_INDEX_TYPE_UINT32);
-	vkCmdBindDescriptorSets(command_buffers.at(i), VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_sets.at(i), 0, nullptr);
-	vkCmdDrawIndexed(command_buffers.at(i), static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-
-	vkCmdEndRenderPass(command_buffers.at(i));
-	VK_ASSERT(vkEndCommandBuffer(command_buffers.at(i)));
+    command_buffers.resize(swap_chain_images.size());
+    VK_ASSERT(stream.allocate_command_buffers(device, &command_buffer_allocate_info, command_buffers.data()));
+
+    clear_values[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clear_values[1].depthStencil = {1.0f, 0};
+    command_buffer_scales.resize(command_buffers.size());
+    for (std::size_t i = 0; i < command_buffers.size(); ++i)
+	record_command_buffer(i);
+}
+
+void Graphics::record_command_buffer(std::size_t image) {
+    VkCommandBuffer command_buffer = command_buffers.at(image);
+    command_buffer_scales.at(image) = render_scale();
+    VkExtent2D extent = scaled_extent(command_buffer_scales.at(image));
+    VkViewport viewport {0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f};
+    VkRect2D scissor {{0, 0}, extent};
+    uint32_t first_query = static_cast<uint32_t>(image) * OCCLUSION_TIMESTAMPS;
+    VkCommandBufferBeginInfo command_buffer_begin_info {};
+    command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    command_buffer_begin_info.flags = 0;
+    command_buffer_begin_info.pInheritanceInfo = nullptr;
+    VK_ASSERT(stream.begin_command_buffer(command_buffer, &command_buffer_begin_info));
+
+    if (timestamps_supported) {
+	stream.cmd_reset_query_pool(command_buffer, timestamp_query_pool, first_query, OCCLUSION_TIMESTAMPS);
+	stream.cmd_write_timestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, first_query);
+    }
+    VkMemoryBarrier frame_barrier {};
+    frame_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    frame_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    frame_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &frame_barrier, 0, nullptr, 0, nullptr);
+    record_cull(command_buffer, image, occlusion_enabled ? 0 : 2);
+    if (timestamps_supported)
+	stream.cmd_write_timestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestamp_query_pool, first_query + 1);
+
+    std::pmr::vector<VkFramebuffer> pass_framebuffers(frame_memory());
+    if (offscreen_views()) pass_framebuffers.assign(view_framebuffers.begin(), view_framebuffers.end());
+    else pass_framebuffers.push_back(swap_chain_framebuffers.at(image));
+    VkRenderPassBeginInfo render_pass_begin_info {};
+    render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_begin_info.renderPass = render_pass;
+    render_pass_begin_info.renderArea.offset = {0, 0};
+    render_pass_begin_info.renderArea.extent = extent;
+    render_pass_begin_info.clearValueCount = 2;
+    render_pass_begin_info.pClearValues = clear_values;
+    VkDeviceSize offset = 0;
+    for (uint32_t pass = 0; pass < pass_framebuffers.size(); ++pass) {
+	DrawParameters parameters {0, pass};
+	render_pass_begin_info.framebuffer = pass_framebuffers.at(pass);
+	stream.cmd_begin_render_pass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	stream.cmd_bind_pipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+	stream.cmd_set_viewport(command_buffer, 0, 1, &viewport);
+	stream.cmd_set_scissor(command_buffer, 0, 1, &scissor);
+	stream.cmd_bind_vertex_buffers(command_buffer, 0, 1, &vertex_buffer, &offset);
+	stream.cmd_bind_index_buffer(command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+	stream.cmd_bind_descriptor_sets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_sets.at(image), 0, nullptr);
+	stream.cmd_push_constants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(parameters), &parameters);
+	for (std::size_t level = 0; level < mesh_lod.levels.size(); ++level)
+	    stream.cmd_draw_indexed_indirect(command_buffer, indirect_buffers, image * indirect_buffer_stride + level * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+	stream.cmd_end_render_pass(command_buffer);
+    }
+    if (timestamps_supported)
+	stream.cmd_write_timestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, first_query + 2);
+
+    if (occlusion_enabled) {
+	record_hiz_build(command_buffer, extent);
+	record_cull(command_buffer, image, 1);
+    }
+    if (timestamps_supported)
+	stream.cmd_write_timestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestamp_query_pool, first_query + 3);
+
+    render_pass_begin_info.renderPass = render_pass_load;
+    render_pass_begin_info.clearValueCount = 0;
+    render_pass_begin_info.pClearValues = nullptr;
+    for (uint32_t pass = 0; pass < pass_framebuffers.size(); ++pass) {
+	DrawParameters parameters {late_draw_offset(), pass};
+	render_pass_begin_info.framebuffer = pass_framebuffers.at(pass);
+	stream.cmd_begin_render_pass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	if (occlusion_enabled) {
+	    stream.cmd_bind_pipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+	    stream.cmd_set_viewport(command_buffer, 0, 1, &viewport);
+	    stream.cmd_set_scissor(command_buffer, 0, 1, &scissor);
+	    stream.cmd_bind_vertex_buffers(command_buffer, 0, 1, &vertex_buffer, &offset);
+	    stream.cmd_bind_index_buffer(command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+	    stream.cmd_bind_descriptor_sets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_sets.at(image), 0, nullptr);
+	    stream.cmd_push_constants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(parameters), &parameters);
+	    for (std::size_t level = 0; level < mesh_lod.levels.size(); ++level)
+		stream.cmd_draw_indexed_indirect(command_buffer, indirect_buffers, image * indirect_buffer_stride + (MAX_LOD_LEVELS + level) * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+	}
+	stream.cmd_end_render_pass(command_buffer);
     }
+    if (timestamps_supported)
+	stream.cmd_write_timestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, first_query + 4);
+    if (offscreen_views()) record_view_resolve(command_buffer, image, extent);
+    VK_ASSERT(stream.end_command_buffer(command_buffer));
 }
 
 void Graphics::create_sync_objects() {
+    TRACE_ZONE(__func__);
     VkSemaphoreCreateInfo semaphore_create_info {};
     semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
@@ -754,18 +1264,21 @@ void Graphics::create_sync_objects() {
     image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
     render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
     in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
-    images_in_flight.resize(MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+    images_in_flight.assign(swap_chain_images.size(), VK_NULL_HANDLE);
     for (std::size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
 	VK_ASSERT(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &image_available_semaphores.at(i)));
 	VK_ASSERT(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &render_finished_semaphores.at(i)));
-	VK_ASSERT(vkCreateFence(device, &fence_create_info, nullptr, &in_flight_fences.at(i)));
+	VK_ASSERT(stream.create_fence(device, &fence_create_info, nullptr, &in_flight_fences.at(i)));
+	registry.record(VK_OBJECT_TYPE_SEMAPHORE, image_available_semaphores.at(i), "image_available_semaphore_" + std::to_string(i), "frame");
+	registry.record(VK_OBJECT_TYPE_SEMAPHORE, render_finished_semaphores.at(i), "render_finished_semaphore_" + std::to_string(i), "frame");
+	registry.record(VK_OBJECT_TYPE_FENCE, in_flight_fences.at(i), "in_flight_fence_" + std::to_string(i), "frame");
     }
 
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
+    submit_info.waitSemaphoreCount = headless ? 0 : 1;
     submit_info.pWaitDstStageMask = wait_stages;
     submit_info.commandBufferCount = 1;
-    submit_info.signalSemaphoreCount = 1;
+    submit_info.signalSemaphoreCount = headless ? 0 : 1;
 
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     present_info.waitSemaphoreCount = 1;
@@ -774,30 +1287,167 @@ void Graphics::create_sync_objects() {
     present_info.pResults = nullptr;
 }
 
+void Graphics::create_capture() {
+    TRACE_ZONE(__func__);
+    if (!capture_directory) return;
+    if (!capture_supported) {
+	std::cerr << "Swap chain images cannot be copied, frame capture disabled" << std::endl;
+	return;
+    }
+    capture_writer = std::make_unique<CaptureWriter>(capture_directory, CaptureWriter::parse_format(std::getenv("VKT_CAPTURE_FORMAT")), CAPTURE_SLOTS);
+
+    VkCommandPoolCreateInfo command_pool_create_info {};
+    command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_create_info.queueFamilyIndex = graphics_family_index;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    VK_ASSERT(stream.create_command_pool(device, &command_pool_create_info, nullptr, &capture_command_pool));
+    registry.record(VK_OBJECT_TYPE_COMMAND_POOL, capture_command_pool, "capture_command_pool", "capture");
+
+    VkCommandBufferAllocateInfo command_buffer_allocate_info {};
+    command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_allocate_info.commandPool = capture_command_pool;
+    command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_buffer_allocate_info.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+    capture_command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+    VK_ASSERT(stream.allocate_command_buffers(device, &command_buffer_allocate_info, capture_command_buffers.data()));
+
+    create_capture_buffers();
+}
+
+void Graphics::create_capture_buffers() {
+    TRACE_ZONE(__func__);
+    if (!capture_writer) return;
+    VkDeviceSize size = static_cast<VkDeviceSize>(swap_extent.width) * swap_extent.height * 4;
+    VkMemoryPropertyFlags properties = readback_memory_properties();
+
+    capture_buffers.resize(CAPTURE_SLOTS);
+    capture_buffers_memory.resize(CAPTURE_SLOTS);
+    capture_mapped.resize(CAPTURE_SLOTS);
+    capture_slot_frame.assign(CAPTURE_SLOTS, NO_FRAME);
+    capture_slot_index.assign(CAPTURE_SLOTS, 0);
+    for (std::size_t i = 0; i < CAPTURE_SLOTS; ++i) {
+	create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties, capture_buffers.at(i), capture_buffers_memory.at(i), "capture_buffer_" + std::to_string(i), "capture");
+	VK_ASSERT(vkMapMemory(device, capture_buffers_memory.at(i), 0, size, 0, &capture_mapped.at(i)));
+    }
+}
+
+bool Graphics::record_capture(uint32_t image_index) {
+    std::size_t slot = next_capture_slot;
+    if (headless) capture_writer->drain();
+    if (capture_slot_frame.at(slot) != NO_FRAME || capture_writer->slot_busy(slot)) {
+	capture_writer->drop();
+	return false;
+    }
+    next_capture_slot = (next_capture_slot + 1) % CAPTURE_SLOTS;
+
+    VkCommandBuffer command_buffer = capture_command_buffers.at(current_frame);
+    stream.reset_command_buffer(command_buffer, 0);
+    VkCommandBufferBeginInfo command_buffer_begin_info {};
+    command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_ASSERT(stream.begin_command_buffer(command_buffer, &command_buffer_begin_info));
+
+    VkImageMemoryBarrier image_barrier {};
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.image = swap_chain_images.at(image_index);
+    image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_barrier.subresourceRange.levelCount = 1;
+    image_barrier.subresourceRange.layerCount = 1;
+    stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+
+    VkBufferImageCopy copy_region {};
+    copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy_region.imageSubresource.layerCount = 1;
+    copy_region.imageExtent = {swap_extent.width, swap_extent.height, 1};
+    stream.cmd_copy_image_to_buffer(command_buffer, swap_chain_images.at(image_index), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, capture_buffers.at(slot), 1, &copy_region);
+
+    image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    image_barrier.dstAccessMask = 0;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkBufferMemoryBarrier buffer_barrier {};
+    buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buffer_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.buffer = capture_buffers.at(slot);
+    buffer_barrier.size = VK_WHOLE_SIZE;
+    stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &buffer_barrier, 1, &image_barrier);
+
+    VK_ASSERT(stream.end_command_buffer(command_buffer));
+    capture_slot_frame.at(slot) = current_frame;
+    capture_slot_index.at(slot) = frame_count;
+    return true;
+}
+
+void Graphics::collect_capture(std::size_t frame) {
+    if (!capture_writer) return;
+    bool bgra = surface_format.format == VK_FORMAT_B8G8R8A8_SRGB || surface_format.format == VK_FORMAT_B8G8R8A8_UNORM;
+    for (std::size_t slot = 0; slot < CAPTURE_SLOTS; ++slot) {
+	if (capture_slot_frame.at(slot) != frame) continue;
+	VkMappedMemoryRange range {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = capture_buffers_memory.at(slot);
+	range.offset = 0;
+	range.size = VK_WHOLE_SIZE;
+	vkInvalidateMappedMemoryRanges(device, 1, &range);
+	capture_writer->submit({slot, capture_slot_index.at(slot), static_cast<const uint8_t*>(capture_mapped.at(slot)), swap_extent.width, swap_extent.height, bgra});
+	capture_slot_frame.at(slot) = NO_FRAME;
+    }
+}
+
+void Graphics::destroy_capture_buffers() {
+    if (!capture_writer) return;
+    stream.wait_for_fences(device, static_cast<uint32_t>(in_flight_fences.size()), in_flight_fences.data(), VK_TRUE, UINT64_MAX);
+    for (std::size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; ++frame)
+	collect_capture(frame);
+    capture_writer->drain();
+    for (std::size_t i = 0; i < capture_buffers.size(); ++i) {
+	vkUnmapMemory(device, capture_buffers_memory.at(i));
+	destroy_buffer(capture_buffers.at(i), capture_buffers_memory.at(i));
+    }
+    capture_buffers.clear();
+    capture_buffers_memory.clear();
+    capture_mapped.clear();
+}
+
 void Graphics::update_uniform_buffers(uint32_t current_image) {
-    static auto start_time = micro_sec();
-    auto dt = static_cast<float>((micro_sec() - start_time)) / 1000000.0f;
+    auto dt = static_cast<float>((frame_clock() - start_time)) / 1000000.0f;
 
     UniformBufferObject ubo {};
     ubo.model = glm::rotate(glm::mat4(1.0f), dt * 1.5707963268f, glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.proj = glm::perspective(0.7853981634f, static_cast<float>(swap_extent.width) / static_cast<float>(swap_extent.height), 0.01f, 1000.0f);
-    ubo.proj[1][1] *= -1;
+    glm::vec3 eye(2.0f, 2.0f, 2.0f), target(0.0f, 0.0f, 0.0f), up(0.0f, 0.0f, 1.0f);
+    glm::vec3 right = glm::normalize(glm::cross(target - eye, up));
+    for (uint32_t view = 0; view < view_count; ++view) {
+	glm::vec3 shift = right * (static_cast<float>(view) - 0.5f * static_cast<float>(view_count - 1)) * view_separation;
+	ubo.view.at(view) = glm::lookAt(eye + shift, target + shift, up);
+	ubo.proj.at(view) = glm::perspective(0.7853981634f, static_cast<float>(render_extent.width) / static_cast<float>(render_extent.height), 0.01f, 1000.0f);
+	ubo.proj.at(view)[1][1] *= -1;
+    }
 
     void *data;
-    vkMapMemory(device, uniform_buffers_memory, current_image * sizeof(ubo), sizeof(ubo), 0, &data);
+    stream.map_memory(device, uniform_buffers_memory, current_image * sizeof(ubo), sizeof(ubo), 0, &data);
     memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device, uniform_buffers_memory);
+    stream.unmap_memory(device, uniform_buffers_memory);
+
+    update_candidates(current_image, ubo);
 }
 
-void Graphics::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &buffer_memory) {
+void Graphics::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &buffer_memory, const std::string &name, const std::string &owner) {
     VkBufferCreateInfo buffer_create_info {};
     buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buffer_create_info.size = size;
     buffer_create_info.usage = usage;
     buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    VK_ASSERT(vkCreateBuffer(device, &buffer_create_info, nullptr, &buffer));
+    VK_ASSERT(stream.create_buffer(device, &buffer_create_info, nullptr, &buffer));
 
     VkMemoryRequirements mem_reqs;
     vkGetBufferMemoryRequirements(device, buffer, &mem_reqs);
@@ -807,11 +1457,127 @@ void Graphics::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemo
     memory_allocate_info.allocationSize = mem_reqs.size;
     memory_allocate_info.memoryTypeIndex = find_memory_type(mem_reqs.memoryTypeBits, properties);
 
-    VK_ASSERT(vkAllocateMemory(device, &memory_allocate_info, nullptr, &buffer_memory));
-    vkBindBufferMemory(device, buffer, buffer_memory, 0);
+    VK_ASSERT(stream.allocate_memory(device, &memory_allocate_info, nullptr, &buffer_memory));
+    stream.bind_buffer_memory(device, buffer, buffer_memory, 0);
+
+    registry.record(VK_OBJECT_TYPE_BUFFER, buffer, name, owner, size);
+    registry.record(VK_OBJECT_TYPE_DEVICE_MEMORY, buffer_memory, name + "_memory", owner, mem_reqs.size, registry.heap_of_type(memory_allocate_info.memoryTypeIndex));
+}
+
+void Graphics::destroy_buffer(VkBuffer buffer, VkDeviceMemory buffer_memory) {
+    registry.release(VK_OBJECT_TYPE_BUFFER, buffer);
+    registry.release(VK_OBJECT_TYPE_DEVICE_MEMORY, buffer_memory);
+    vkDestroyBuffer(device, buffer, nullptr);
+    vkFreeMemory(device, buffer_memory, nullptr);
+}
+
+void Graphics::retire_buffer(VkBuffer buffer, VkDeviceMemory buffer_memory) {
+    retire(VK_OBJECT_TYPE_BUFFER, buffer);
+    retire(VK_OBJECT_TYPE_DEVICE_MEMORY, buffer_memory);
+}
+
+void Graphics::upload_buffer(const void *contents, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &buffer_memory, const std::string &name, const std::string &owner) {
+    VkBuffer staging_buffer;
+    VkDeviceMemory staging_buffer_memory;
+    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory, name + "_staging", owner);
+
+    void *data;
+    stream.map_memory(device, staging_buffer_memory, 0, size, 0, &data);
+    memcpy(data, contents, size);
+    stream.unmap_memory(device, staging_buffer_memory);
+
+    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, buffer_memory, name, owner);
+    copy_buffer(buffer, staging_buffer, size);
+    destroy_buffer(staging_buffer, staging_buffer_memory);
 }
 
 void Graphics::copy_buffer(VkBuffer dst_buffer, VkBuffer src_buffer, VkDeviceSize size) {
+    VkCommandBuffer command_buffer = begin_one_time_commands();
+    VkBufferCopy copy_region {};
+    copy_region.srcOffset = 0;
+    copy_region.dstOffset = 0;
+    copy_region.size = size;
+    stream.cmd_copy_buffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
+    end_one_time_commands(command_buffer);
+}
+
+void Graphics::create_image(VkExtent2D extent, uint32_t mip_levels, VkFormat format, VkImageUsageFlags usage, VkImage &image, VkDeviceMemory &image_memory, const std::string &name, const std::string &owner, uint32_t array_layers) {
+    VkImageCreateInfo image_create_info {};
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.imageType = VK_IMAGE_TYPE_2D;
+    image_create_info.extent = {extent.width, extent.height, 1};
+    image_create_info.mipLevels = mip_levels;
+    image_create_info.arrayLayers = array_layers;
+    image_create_info.format = format;
+    image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_create_info.usage = usage;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_ASSERT(stream.create_image(device, &image_create_info, nullptr, &image));
+
+    VkMemoryRequirements mem_reqs;
+    vkGetImageMemoryRequirements(device, image, &mem_reqs);
+
+    VkMemoryAllocateInfo memory_allocate_info {};
+    memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memory_allocate_info.allocationSize = mem_reqs.size;
+    memory_allocate_info.memoryTypeIndex = find_memory_type(mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VK_ASSERT(stream.allocate_memory(device, &memory_allocate_info, nullptr, &image_memory));
+    stream.bind_image_memory(device, image, image_memory, 0);
+
+    registry.record(VK_OBJECT_TYPE_IMAGE, image, name, owner, mem_reqs.size);
+    registry.record(VK_OBJECT_TYPE_DEVICE_MEMORY, image_memory, name + "_memory", owner, mem_reqs.size, registry.heap_of_type(memory_allocate_info.memoryTypeIndex));
+}
+
+VkImageView Graphics::create_image_view(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t base_mip, uint32_t mip_count, const std::string &name, const std::string &owner, VkImageViewType view_type, uint32_t base_layer, uint32_t layer_count) {
+    VkImageViewCreateInfo image_view_create_info {};
+    image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    image_view_create_info.image = image;
+    image_view_create_info.viewType = view_type;
+    image_view_create_info.format = format;
+    image_view_create_info.subresourceRange.aspectMask = aspect;
+    image_view_create_info.subresourceRange.baseMipLevel = base_mip;
+    image_view_create_info.subresourceRange.levelCount = mip_count;
+    image_view_create_info.subresourceRange.baseArrayLayer = base_layer;
+    image_view_create_info.subresourceRange.layerCount = layer_count;
+
+    VkImageView image_view;
+    VK_ASSERT(stream.create_image_view(device, &image_view_create_info, nullptr, &image_view));
+    registry.record(VK_OBJECT_TYPE_IMAGE_VIEW, image_view, name, owner);
+    return image_view;
+}
+
+void Graphics::destroy_image(VkImage image, VkDeviceMemory image_memory) {
+    registry.release(VK_OBJECT_TYPE_IMAGE, image);
+    registry.release(VK_OBJECT_TYPE_DEVICE_MEMORY, image_memory);
+    vkDestroyImage(device, image, nullptr);
+    vkFreeMemory(device, image_memory, nullptr);
+}
+
+void Graphics::retire_image(VkImage image, VkDeviceMemory image_memory) {
+    retire(VK_OBJECT_TYPE_IMAGE, image);
+    retire(VK_OBJECT_TYPE_DEVICE_MEMORY, image_memory);
+}
+
+VkShaderModule Graphics::create_shader_module(const char *start, const char *end, const std::string &name, const std::string &owner) {
+    std::size_t size = static_cast<std::size_t>(end - start);
+    std::vector<uint32_t> code((size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+    memcpy(code.data(), start, size);
+
+    VkShaderModuleCreateInfo shader_module_create_info {};
+    shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_module_create_info.codeSize = size;
+    shader_module_create_info.pCode = code.data();
+
+    VkShaderModule shader_module;
+    VK_ASSERT(stream.create_shader_module(device, &shader_module_create_info, nullptr, &shader_module));
+    registry.record(VK_OBJECT_TYPE_SHADER_MODULE, shader_module, name, owner, size);
+    return shader_module;
+}
+
+VkCommandBuffer Graphics::begin_one_time_commands() {
     VkCommandBufferAllocateInfo command_buffer_allocate_info {};
     command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -819,29 +1585,27 @@ void Graphics::copy_buffer(VkBuffer dst_buffer, VkBuffer src_buffer, VkDeviceSiz
     command_buffer_allocate_info.commandBufferCount = 1;
 
     VkCommandBuffer command_buffer;
-    vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &command_buffer);
+    stream.allocate_command_buffers(device, &command_buffer_allocate_info, &command_buffer);
 
     VkCommandBufferBeginInfo command_buffer_begin_info {};
     command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+    stream.begin_command_buffer(command_buffer, &command_buffer_begin_info);
+    return command_buffer;
+}
 
-    VkBufferCopy copy_region {};
-    copy_region.srcOffset = 0;
-    copy_region.dstOffset = 0;
-    copy_region.size = size;
-    vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
-    vkEndCommandBuffer(command_buffer);
+void Graphics::end_one_time_commands(VkCommandBuffer command_buffer) {
+    stream.end_command_buffer(command_buffer);
 
-    VkSubmitInfo copy_submit_info {};
-    copy_submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    copy_submit_info.commandBufferCount = 1;
-    copy_submit_info.pCommandBuffers = &command_buffer;
+    VkSubmitInfo one_time_submit_info {};
+    one_time_submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    one_time_submit_info.commandBufferCount = 1;
+    one_time_submit_info.pCommandBuffers = &command_buffer;
 
-    vkQueueSubmit(graphics_queue, 1, &copy_submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphics_queue);
+    stream.queue_submit(graphics_queue, 1, &one_time_submit_info, VK_NULL_HANDLE);
+    stream.queue_wait_idle(graphics_queue);
 
-    vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+    stream.free_command_buffers(device, command_pool, 1, &command_buffer);
 }
 
 uint32_t Graphics::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) {
@@ -849,48 +1613,88 @@ uint32_t Graphics::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags
     vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
 
     for (uint32_t i = 0; i < mem_props.memoryTypeCount; ++i) {
-	if ((type_filter & (1 << i)) && (mem_props.memoryTypes[i].propertyFlags & properties)) return i;
+	if ((type_filter & (1 << i)) && (mem_props.memoryTypes[i].propertyFlags & properties) == properties) return i;
     }
     throw std::runtime_error("Failed to find memory");
 }
 
+VkMemoryPropertyFlags Graphics::readback_memory_properties() {
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
+
+    VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    for (uint32_t i = 0; i < mem_props.memoryTypeCount; ++i) {
+	if ((mem_props.memoryTypes[i].propertyFlags & cached) == cached) return cached;
+    }
+    return VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
 void Graphics::cleanup_swap_chain() {
+    TRACE_ZONE(__func__);
     for (auto fb : swap_chain_framebuffers)
-	vkDestroyFramebuffer(device, fb, nullptr);
-    vkFreeCommandBuffers(device, command_pool, static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
-    vkDestroyPipeline(device, graphics_pipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-    vkDestroyRenderPass(device, render_pass, nullptr);
-    vkDestroyShaderModule(device, vert_shader_module, nullptr);
-    vkDestroyShaderModule(device, frag_shader_module, nullptr);
+	retire(VK_OBJECT_TYPE_FRAMEBUFFER, fb);
+    for (auto fb : view_framebuffers)
+	retire(VK_OBJECT_TYPE_FRAMEBUFFER, fb);
+    view_framebuffers.clear();
+    deletion_queue.retire_command_buffers(frame_count, command_pool, std::move(command_buffers));
+    command_buffers.clear();
     for (auto swap_chain_image_view : swap_chain_image_views)
-	vkDestroyImageView(device, swap_chain_image_view, nullptr);
+	retire(VK_OBJECT_TYPE_IMAGE_VIEW, swap_chain_image_view);
     swap_chain_image_views.clear();
-    vkDestroySwapchainKHR(device, swap_chain, nullptr);
-    vkDestroyBuffer(device, uniform_buffers, nullptr);
-    vkFreeMemory(device, uniform_buffers_memory, nullptr);
-    vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+    if (headless) {
+	for (std::size_t i = 0; i < swap_chain_images.size(); ++i)
+	    retire_image(swap_chain_images.at(i), headless_images_memory.at(i));
+	headless_images_memory.clear();
+    }
+    else {
+	retire(VK_OBJECT_TYPE_SWAPCHAIN_KHR, swap_chain);
+	retired_swap_chain = swap_chain;
+    }
+    retire_buffer(uniform_buffers, uniform_buffers_memory);
+    retire_buffer(candidate_buffers, candidate_buffers_memory);
+    retire_buffer(draw_id_buffers, draw_id_buffers_memory);
+    retire_buffer(indirect_buffers, indirect_buffers_memory);
+    destroy_view_targets();
+    destroy_depth_resources();
+    if (timestamps_supported)
+	retire(VK_OBJECT_TYPE_QUERY_POOL, timestamp_query_pool);
+    destroy_capture_buffers();
+    destroy_overlay_pipelines();
+    retire(VK_OBJECT_TYPE_DESCRIPTOR_POOL, descriptor_pool);
 }
 
 void Graphics::recreate_swap_chain() {
+    TRACE_ZONE(__func__);
+    stream.finish();
     int width = 0, height = 0;
-    glfwGetFramebufferSize(window, &width, &height);
-    while (width == 0 || height == 0) {
+    if (!headless) glfwGetFramebufferSize(window, &width, &height);
+    while (!headless && (width == 0 || height == 0)) {
 	glfwGetFramebufferSize(window, &width, &height);
 	glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(device);
-
+    auto before = micro_sec();
     cleanup_swap_chain();
 
     create_swap_chain();
     create_image_views();
-    create_render_pass();
-    create_graphics_pipeline();
+    create_depth_resources();
+    create_view_targets();
+    if (render_pass_stale()) {
+	retire_render_pass();
+	create_render_pass();
+	create_graphics_pipeline();
+    }
     create_framebuffers();
     create_uniform_buffers();
+    create_object_buffers();
     create_descriptor_pool();
     create_descriptor_sets();
+    create_query_pool();
     create_command_buffers();
+    create_capture_buffers();
+    create_overlay_pipelines();
+    images_in_flight.assign(swap_chain_images.size(), VK_NULL_HANDLE);
+    std::cout << "Swap chain recreated in " << static_cast<double>(micro_sec() - before) / 1000.0 << " ms without a device wait, "
+	      << deletion_queue.pending() << " objects awaiting retirement" << std::endl;
 }
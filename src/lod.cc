@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+#include "lod.h"
+
+static constexpr double BOUNDARY_WEIGHT = 10.0;
+static constexpr float MIN_REDUCTION = 0.9f;
+static constexpr std::size_t MIN_LOD_INDICES = 6;
+static constexpr std::size_t PARALLEL_SELECT_OBJECTS = 4096;
+
+struct Quadric {
+    double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+    double b2 = 0.0, bc = 0.0, bd = 0.0;
+    double c2 = 0.0, cd = 0.0;
+    double d2 = 0.0;
+
+    static Quadric plane(const glm::dvec3 &normal, double d, double weight) {
+	Quadric q;
+	q.a2 = weight * normal.x * normal.x;
+	q.ab = weight * normal.x * normal.y;
+	q.ac = weight * normal.x * normal.z;
+	q.ad = weight * normal.x * d;
+	q.b2 = weight * normal.y * normal.y;
+	q.bc = weight * normal.y * normal.z;
+	q.bd = weight * normal.y * d;
+	q.c2 = weight * normal.z * normal.z;
+	q.cd = weight * normal.z * d;
+	q.d2 = weight * d * d;
+	return q;
+    }
+
+    Quadric &operator+=(const Quadric &other) {
+	a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+	b2 += other.b2; bc += other.bc; bd += other.bd;
+	c2 += other.c2; cd += other.cd;
+	d2 += other.d2;
+	return *this;
+    }
+
+    double evaluate(const glm::vec3 &point) const {
+	double x = point.x, y = point.y, z = point.z;
+	return a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+	    + b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+	    + c2 * z * z + 2.0 * cd * z
+	    + d2;
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t from, to;
+    uint32_t from_version, to_version;
+
+    bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+static glm::dvec3 face_normal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    return glm::cross(glm::dvec3(b - a), glm::dvec3(c - a));
+}
+
+std::vector<uint32_t> simplify(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, std::size_t target_index_count, float &error) {
+    std::vector<uint32_t> result = indices;
+    std::size_t triangle_count = indices.size() / 3;
+    double max_cost = 0.0;
+    error = 0.0f;
+
+    std::vector<Quadric> quadrics(positions.size());
+    std::vector<std::vector<uint32_t>> adjacency(positions.size());
+    std::unordered_map<uint64_t, uint32_t> edge_faces;
+    auto edge_key = [](uint32_t a, uint32_t b) { return static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b); };
+    for (std::size_t t = 0; t < triangle_count; ++t) {
+	uint32_t v[3] = {result[3 * t], result[3 * t + 1], result[3 * t + 2]};
+	glm::dvec3 normal = face_normal(positions[v[0]], positions[v[1]], positions[v[2]]);
+	double length = glm::length(normal);
+	if (length > 0.0) {
+	    normal /= length;
+	    Quadric q = Quadric::plane(normal, -glm::dot(normal, glm::dvec3(positions[v[0]])), 1.0);
+	    for (uint32_t vertex : v) quadrics[vertex] += q;
+	}
+	for (int i = 0; i < 3; ++i) {
+	    adjacency[v[i]].push_back(static_cast<uint32_t>(t));
+	    ++edge_faces[edge_key(v[i], v[(i + 1) % 3])];
+	}
+    }
+
+    std::vector<bool> boundary(positions.size(), false);
+    for (std::size_t t = 0; t < triangle_count; ++t) {
+	uint32_t v[3] = {result[3 * t], result[3 * t + 1], result[3 * t + 2]};
+	glm::dvec3 normal = face_normal(positions[v[0]], positions[v[1]], positions[v[2]]);
+	for (int i = 0; i < 3; ++i) {
+	    uint32_t a = v[i], b = v[(i + 1) % 3];
+	    if (edge_faces[edge_key(a, b)] != 1) continue;
+	    boundary[a] = boundary[b] = true;
+	    glm::dvec3 edge = glm::dvec3(positions[b] - positions[a]);
+	    glm::dvec3 side = glm::cross(edge, normal);
+	    double length = glm::length(side);
+	    if (length <= 0.0) continue;
+	    side /= length;
+	    Quadric q = Quadric::plane(side, -glm::dot(side, glm::dvec3(positions[a])), BOUNDARY_WEIGHT);
+	    quadrics[a] += q;
+	    quadrics[b] += q;
+	}
+    }
+
+    std::vector<bool> removed(triangle_count, false);
+    std::vector<uint32_t> version(positions.size(), 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+    auto push_edge = [&](uint32_t a, uint32_t b) {
+	Quadric q = quadrics[a];
+	q += quadrics[b];
+	bool a_to_b = !boundary[a] || boundary[b];
+	bool b_to_a = !boundary[b] || boundary[a];
+	double cost_ab = a_to_b ? q.evaluate(positions[b]) : std::numeric_limits<double>::infinity();
+	double cost_ba = b_to_a ? q.evaluate(positions[a]) : std::numeric_limits<double>::infinity();
+	if (!a_to_b && !b_to_a) return;
+	if (cost_ab <= cost_ba) heap.push({cost_ab, a, b, version[a], version[b]});
+	else heap.push({cost_ba, b, a, version[b], version[a]});
+    };
+    for (const auto& [key, faces] : edge_faces)
+	push_edge(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key));
+
+    auto flips = [&](uint32_t from, uint32_t to) {
+	for (uint32_t t : adjacency[from]) {
+	    if (removed[t]) continue;
+	    uint32_t *v = &result[3 * t];
+	    if (v[0] == to || v[1] == to || v[2] == to) continue;
+	    glm::vec3 moved[3];
+	    for (int i = 0; i < 3; ++i) moved[i] = positions[v[i] == from ? to : v[i]];
+	    glm::dvec3 before = face_normal(positions[v[0]], positions[v[1]], positions[v[2]]);
+	    glm::dvec3 after = face_normal(moved[0], moved[1], moved[2]);
+	    if (glm::dot(before, after) <= 0.0) return true;
+	}
+	return false;
+    };
+
+    std::size_t live_triangles = triangle_count;
+    std::vector<uint32_t> neighbours;
+    while (live_triangles * 3 > target_index_count && !heap.empty()) {
+	Collapse collapse = heap.top();
+	heap.pop();
+	if (collapse.from_version != version[collapse.from] || collapse.to_version != version[collapse.to]) continue;
+	if (flips(collapse.from, collapse.to)) continue;
+
+	max_cost = std::max(max_cost, collapse.cost);
+	for (uint32_t t : adjacency[collapse.from]) {
+	    if (removed[t]) continue;
+	    uint32_t *v = &result[3 * t];
+	    if (v[0] == collapse.to || v[1] == collapse.to || v[2] == collapse.to) {
+		removed[t] = true;
+		--live_triangles;
+		continue;
+	    }
+	    for (int i = 0; i < 3; ++i) {
+		if (v[i] == collapse.from) v[i] = collapse.to;
+	    }
+	    adjacency[collapse.to].push_back(t);
+	}
+	adjacency[collapse.from].clear();
+	quadrics[collapse.to] += quadrics[collapse.from];
+	++version[collapse.from];
+	++version[collapse.to];
+
+	neighbours.clear();
+	auto& to_faces = adjacency[collapse.to];
+	to_faces.erase(std::remove_if(to_faces.begin(), to_faces.end(), [&removed](uint32_t t) { return removed[t]; }), to_faces.end());
+	for (uint32_t t : to_faces) {
+	    for (uint32_t i = 0; i < 3; ++i) {
+		if (result[3 * t + i] != collapse.to) neighbours.push_back(result[3 * t + i]);
+	    }
+	}
+	std::sort(neighbours.begin(), neighbours.end());
+	neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+	for (uint32_t neighbour : neighbours)
+	    push_edge(collapse.to, neighbour);
+    }
+
+    std::size_t live = 0;
+    for (std::size_t t = 0; t < triangle_count; ++t) {
+	if (removed[t]) continue;
+	for (std::size_t i = 0; i < 3; ++i) result[3 * live + i] = result[3 * t + i];
+	++live;
+    }
+    result.resize(3 * live);
+    error = static_cast<float>(std::sqrt(max_cost));
+    return result;
+}
+
+LODMesh LODPacker::add(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, float reduction) {
+    LODMesh mesh;
+    mesh.vertex_offset = static_cast<int32_t>(packed_vertex_count);
+    packed_vertex_count += positions.size();
+
+    std::vector<uint32_t> level = indices;
+    float level_error = 0.0f;
+    while (true) {
+	mesh.levels.push_back({static_cast<uint32_t>(packed_indices.size()), static_cast<uint32_t>(level.size()), level_error});
+	packed_indices.insert(packed_indices.end(), level.begin(), level.end());
+	if (mesh.levels.size() == MAX_LOD_LEVELS || level.size() <= MIN_LOD_INDICES) break;
+
+	std::size_t target = static_cast<std::size_t>(static_cast<float>(level.size() / 3) * reduction) * 3;
+	float error;
+	std::vector<uint32_t> next = simplify(positions, level, std::max(target, MIN_LOD_INDICES), error);
+	if (static_cast<float>(next.size()) > static_cast<float>(level.size()) * MIN_REDUCTION) break;
+	level.swap(next);
+	level_error += error;
+    }
+    return mesh;
+}
+
+void LODSelector::select(const LODMesh &mesh, const std::vector<AABB> &bounds, const glm::mat4 &model_view, float pixels_per_unit, std::vector<uint32_t> &visible, LODRanges &ranges) {
+    auto level_count = static_cast<uint8_t>(mesh.levels.size());
+    float coarsen_px = threshold_px * (1.0f - hysteresis);
+    float refine_px = threshold_px * (1.0f + hysteresis);
+    uint64_t switches = 0;
+    double error_px = 0.0;
+    float max_error_px = 0.0f;
+    std::array<uint32_t, MAX_LOD_LEVELS> counts {};
+
+#pragma omp parallel for reduction(+:switches, error_px) reduction(max:max_error_px) if (visible.size() > PARALLEL_SELECT_OBJECTS)
+    for (std::size_t i = 0; i < visible.size(); ++i) {
+	uint32_t id = visible[i];
+	glm::vec3 center = (bounds[id].min + bounds[id].max) * 0.5f;
+	float depth = std::max(-(model_view * glm::vec4(center, 1.0f)).z, 1e-3f);
+	float scale = pixels_per_unit / depth;
+
+	uint8_t current = std::min<uint8_t>(levels[id], static_cast<uint8_t>(level_count - 1));
+	uint8_t desired = 0;
+	while (desired + 1 < level_count && mesh.levels[desired + 1u].error * scale <= threshold_px) ++desired;
+	uint8_t level = current;
+	if (desired > current) {
+	    while (level < desired && mesh.levels[level + 1u].error * scale <= coarsen_px) ++level;
+	}
+	else if (desired < current && mesh.levels[current].error * scale > refine_px) level = desired;
+	if (level != levels[id]) ++switches;
+	levels[id] = level;
+	float projected = mesh.levels[level].error * scale;
+	error_px += projected;
+	max_error_px = std::max(max_error_px, projected);
+    }
+
+    for (uint32_t id : visible) ++counts[levels[id]];
+    ranges[0] = 0;
+    for (uint32_t level = 0; level < MAX_LOD_LEVELS; ++level)
+	ranges[level + 1] = ranges[level] + counts[level];
+    std::array<uint32_t, MAX_LOD_LEVELS> cursor;
+    std::copy(ranges.begin(), ranges.end() - 1, cursor.begin());
+    sorted.resize(visible.size());
+    for (uint32_t id : visible) sorted[cursor[levels[id]]++] = id;
+    visible.swap(sorted);
+
+    stats.objects += visible.size();
+    stats.switches += switches;
+    stats.error_px += error_px;
+    stats.max_error_px = std::max(stats.max_error_px, max_error_px);
+}
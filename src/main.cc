@@ -1,15 +1,55 @@
+#include <deque>
+#include <random>
+
 #include "graphics.h"
 
+static constexpr std::size_t GRAPH_FRAMES = 240;
+static constexpr float GRAPH_HEIGHT = 120.0f;
+static constexpr float GRAPH_MS = 33.3f;
+
+static void draw_overlay(Graphics &graphics, const std::deque<float> &frame_ms, const std::vector<glm::vec2> &markers, float time) {
+    glm::vec2 screen = graphics.screen_size();
+    float bar_width = screen.x / static_cast<float>(GRAPH_FRAMES);
+    graphics.draw_quad({0.0f, screen.y - GRAPH_HEIGHT}, screen, {0.0f, 0.0f, 0.0f, 0.5f}, OverlayPipeline::BLEND);
+    for (std::size_t i = 0; i < frame_ms.size(); ++i) {
+	float height = std::min(frame_ms[i] / GRAPH_MS, 1.0f) * GRAPH_HEIGHT;
+	float x = static_cast<float>(i) * bar_width;
+	glm::vec4 color = frame_ms[i] > 16.7f ? glm::vec4(1.0f, 0.2f, 0.2f, 1.0f) : glm::vec4(0.2f, 1.0f, 0.2f, 1.0f);
+	graphics.draw_quad({x, screen.y - height}, {x + bar_width, screen.y}, color, OverlayPipeline::SOLID, 1);
+    }
+    for (std::size_t i = 0; i < markers.size(); ++i) {
+	float phase = time + static_cast<float>(i);
+	glm::vec2 pos = markers[i] * screen + glm::vec2(std::cos(phase), std::sin(phase)) * 8.0f;
+	graphics.draw_quad(pos, pos + glm::vec2(4.0f), {markers[i].x, markers[i].y, 1.0f, 0.75f}, OverlayPipeline::BLEND);
+    }
+}
+
 int main() {
-    Graphics graphics;
+    const char *fixed_step = std::getenv("VKT_FIXED_STEP_US");
+    const char *frame_limit = std::getenv("VKT_FRAMES");
+    Graphics graphics(fixed_step ? fixed_step_clock(std::stoull(fixed_step)) : Clock(micro_sec));
     
     float dt = 0.0f;
-    unsigned long long before = 0, after = 0;
-    while (!graphics.should_close()) {
+    unsigned long long before = 0, after = 0, frames = 0;
+    unsigned long long max_frames = frame_limit ? std::stoull(frame_limit) : 0;
+
+    const char *overlay_quads = std::getenv("VKT_OVERLAY_QUADS");
+    std::vector<glm::vec2> markers(overlay_quads ? std::stoul(overlay_quads) : 0);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (auto& marker : markers) marker = {unit(rng), unit(rng)};
+    std::deque<float> frame_ms;
+    float time = 0.0f;
+
+    while (!graphics.should_close() && (!max_frames || frames++ < max_frames)) {
+	draw_overlay(graphics, frame_ms, markers, time);
 	before = micro_sec();
 	graphics.render_tick();
 	after = micro_sec();
 	dt = static_cast<float>(after - before) / 1000000.0f;
+	time += dt;
+	frame_ms.push_back(dt * 1000.0f);
+	if (frame_ms.size() > GRAPH_FRAMES) frame_ms.pop_front();
 	std::cout << "FPS: " << 1. / dt << '\n';
     }
     
@@ -0,0 +1,111 @@
+#include "graphics.h"
+
+void Graphics::configure_views() {
+    VkPhysicalDeviceMultiviewProperties multiview_properties {};
+    multiview_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &multiview_properties;
+    vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+    view_count = std::clamp(view_count, 1u, MAX_VIEWS);
+    if (dynamic_resolution && view_count > 1) {
+	std::cerr << "Dynamic resolution scales a single view, disabled for " << view_count << " views" << std::endl;
+	dynamic_resolution = false;
+    }
+    if (view_count == 1) {
+	multiview_enabled = false;
+	return;
+    }
+    if (multiview_enabled && view_count > multiview_properties.maxMultiviewViewCount) {
+	std::cerr << "Device supports " << multiview_properties.maxMultiviewViewCount << " multiview views, rendering " << view_count << " views in separate passes" << std::endl;
+	multiview_enabled = false;
+    }
+    if (occlusion_enabled) {
+	std::cerr << "Occlusion culling tests a single view, disabled for " << view_count << " views" << std::endl;
+	occlusion_enabled = false;
+    }
+    std::cout << "Rendering " << view_count << " views " << (multiview_enabled ? "in one multiview pass" : "in separate passes") << std::endl;
+}
+
+VkExtent2D Graphics::scaled_extent(float scale) const {
+    auto scaled = [scale](uint32_t size) { return std::clamp(static_cast<uint32_t>(static_cast<float>(size) * scale + 0.5f), 1u, size); };
+    return {scaled(render_extent.width), scaled(render_extent.height)};
+}
+
+void Graphics::create_view_targets() {
+    TRACE_ZONE(__func__);
+    if (!offscreen_views()) return;
+    create_image(render_extent, 1, surface_format.format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, view_image, view_image_memory, "view_image", "multiview", view_count);
+    if (multiview_enabled) {
+	view_color_views.push_back(create_image_view(view_image, surface_format.format, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, "view_color_view", "multiview", VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, view_count));
+	view_depth_views.push_back(create_image_view(depth_image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, "view_depth_view", "multiview", VK_IMAGE_VIEW_TYPE_2D_ARRAY, 0, view_count));
+	return;
+    }
+    for (uint32_t view = 0; view < view_count; ++view) {
+	view_color_views.push_back(create_image_view(view_image, surface_format.format, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, "view_color_view_" + std::to_string(view), "multiview", VK_IMAGE_VIEW_TYPE_2D, view, 1));
+	view_depth_views.push_back(create_image_view(depth_image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, "view_depth_view_" + std::to_string(view), "multiview", VK_IMAGE_VIEW_TYPE_2D, view, 1));
+    }
+}
+
+void Graphics::destroy_view_targets() {
+    if (!offscreen_views()) return;
+    for (auto views : {&view_color_views, &view_depth_views}) {
+	for (auto view : *views)
+	    retire(VK_OBJECT_TYPE_IMAGE_VIEW, view);
+	views->clear();
+    }
+    retire_image(view_image, view_image_memory);
+}
+
+void Graphics::record_view_resolve(VkCommandBuffer command_buffer, std::size_t image, VkExtent2D extent) {
+    VkImageMemoryBarrier image_barrier {};
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_barrier.srcAccessMask = 0;
+    image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.image = swap_chain_images.at(image);
+    image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_barrier.subresourceRange.levelCount = 1;
+    image_barrier.subresourceRange.layerCount = 1;
+    stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+
+    if (dynamic_resolution) {
+	VkImageBlit blit_region {};
+	blit_region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+	blit_region.srcOffsets[1] = {static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1};
+	blit_region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+	blit_region.dstOffsets[1] = {static_cast<int32_t>(swap_extent.width), static_cast<int32_t>(swap_extent.height), 1};
+	stream.cmd_blit_image(command_buffer, view_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swap_chain_images.at(image), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit_region, VK_FILTER_LINEAR);
+    }
+    else if (render_extent.width * view_count != swap_extent.width) {
+	stream.cmd_clear_color_image(command_buffer, swap_chain_images.at(image), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_values[0].color, 1, &image_barrier.subresourceRange);
+	VkMemoryBarrier memory_barrier {};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    if (!dynamic_resolution) {
+	std::pmr::vector<VkImageCopy> copy_regions(view_count, frame_memory());
+	for (uint32_t view = 0; view < view_count; ++view) {
+	    auto& copy_region = copy_regions.at(view);
+	    copy_region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, view, 1};
+	    copy_region.srcOffset = {0, 0, 0};
+	    copy_region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+	    copy_region.dstOffset = {static_cast<int32_t>(view * render_extent.width), 0, 0};
+	    copy_region.extent = {render_extent.width, render_extent.height, 1};
+	}
+	stream.cmd_copy_image(command_buffer, view_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swap_chain_images.at(image), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, view_count, copy_regions.data());
+    }
+
+    image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_barrier.dstAccessMask = 0;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+}
@@ -0,0 +1,407 @@
+#include <bit>
+
+#include "graphics.h"
+
+static constexpr uint32_t CULL_GROUP_SIZE = 64;
+static constexpr uint32_t HIZ_GROUP_SIZE = 8;
+static constexpr uint64_t OCCLUSION_REPORT_FRAMES = 240;
+
+struct CullParameters {
+    uint32_t phase;
+    uint32_t draw_offset;
+    glm::vec2 hiz_size;
+};
+
+struct ReduceParameters {
+    glm::ivec2 src_size;
+    glm::ivec2 dst_size;
+};
+
+void Graphics::create_depth_resources() {
+    TRACE_ZONE(__func__);
+    VkFormatFeatureFlags depth_features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, VK_FORMAT_D32_SFLOAT, &format_properties);
+    depth_format = (format_properties.optimalTilingFeatures & depth_features) == depth_features ? VK_FORMAT_D32_SFLOAT : VK_FORMAT_D16_UNORM;
+    create_image(render_extent, 1, depth_format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, depth_image, depth_image_memory, "depth_image", "occlusion", view_count);
+    depth_image_view = create_image_view(depth_image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, "depth_image_view", "occlusion");
+
+    hiz_extent = {std::bit_floor(render_extent.width), std::bit_floor(render_extent.height)};
+    hiz_levels = static_cast<uint32_t>(std::bit_width(std::max(hiz_extent.width, hiz_extent.height)));
+    create_image(hiz_extent, hiz_levels, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, hiz_image, hiz_image_memory, "hiz_image", "occlusion");
+    hiz_image_view = create_image_view(hiz_image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, hiz_levels, "hiz_image_view", "occlusion");
+    hiz_mip_views.resize(hiz_levels);
+    for (uint32_t level = 0; level < hiz_levels; ++level)
+	hiz_mip_views.at(level) = create_image_view(hiz_image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1, "hiz_mip_view_" + std::to_string(level), "occlusion");
+
+    VkCommandBuffer command_buffer = begin_one_time_commands();
+    VkImageMemoryBarrier image_barrier {};
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_barrier.srcAccessMask = 0;
+    image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.image = hiz_image;
+    image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_barrier.subresourceRange.levelCount = hiz_levels;
+    image_barrier.subresourceRange.layerCount = 1;
+    stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+    end_one_time_commands(command_buffer);
+}
+
+void Graphics::destroy_depth_resources() {
+    for (auto view : hiz_mip_views)
+	retire(VK_OBJECT_TYPE_IMAGE_VIEW, view);
+    hiz_mip_views.clear();
+    for (auto view : {hiz_image_view, depth_image_view})
+	retire(VK_OBJECT_TYPE_IMAGE_VIEW, view);
+    retire_image(hiz_image, hiz_image_memory);
+    retire_image(depth_image, depth_image_memory);
+}
+
+void Graphics::create_compute_pipelines() {
+    TRACE_ZONE(__func__);
+    cull_shader_module = create_shader_module(&_binary_build_shaders_cull_spv_start, &_binary_build_shaders_cull_spv_end, "cull_shader_module", "occlusion");
+    hiz_shader_module = create_shader_module(&_binary_build_shaders_hiz_spv_start, &_binary_build_shaders_hiz_spv_end, "hiz_shader_module", "occlusion");
+
+    VkSamplerCreateInfo sampler_create_info {};
+    sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_create_info.magFilter = VK_FILTER_NEAREST;
+    sampler_create_info.minFilter = VK_FILTER_NEAREST;
+    sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_create_info.minLod = 0.0f;
+    sampler_create_info.maxLod = VK_LOD_CLAMP_NONE;
+    VK_ASSERT(stream.create_sampler(device, &sampler_create_info, nullptr, &hiz_sampler));
+    registry.record(VK_OBJECT_TYPE_SAMPLER, hiz_sampler, "hiz_sampler", "occlusion");
+
+    VkDescriptorSetLayoutBinding cull_bindings[7] {};
+    for (uint32_t i = 0; i < 7; ++i) {
+	cull_bindings[i].binding = i;
+	cull_bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cull_bindings[i].descriptorCount = 1;
+	cull_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    cull_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    cull_bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    VkDescriptorSetLayoutBinding hiz_bindings[2] {};
+    for (uint32_t i = 0; i < 2; ++i) {
+	hiz_bindings[i].binding = i;
+	hiz_bindings[i].descriptorCount = 1;
+	hiz_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    hiz_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    hiz_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info {};
+    descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptor_set_layout_create_info.bindingCount = 7;
+    descriptor_set_layout_create_info.pBindings = cull_bindings;
+    VK_ASSERT(stream.create_descriptor_set_layout(device, &descriptor_set_layout_create_info, nullptr, &cull_descriptor_set_layout));
+    registry.record(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, cull_descriptor_set_layout, "cull_descriptor_set_layout", "occlusion");
+    descriptor_set_layout_create_info.bindingCount = 2;
+    descriptor_set_layout_create_info.pBindings = hiz_bindings;
+    VK_ASSERT(stream.create_descriptor_set_layout(device, &descriptor_set_layout_create_info, nullptr, &hiz_descriptor_set_layout));
+    registry.record(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, hiz_descriptor_set_layout, "hiz_descriptor_set_layout", "occlusion");
+
+    VkPushConstantRange push_constant_range {};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(CullParameters);
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info {};
+    pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_create_info.setLayoutCount = 1;
+    pipeline_layout_create_info.pSetLayouts = &cull_descriptor_set_layout;
+    pipeline_layout_create_info.pushConstantRangeCount = 1;
+    pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
+    VK_ASSERT(stream.create_pipeline_layout(device, &pipeline_layout_create_info, nullptr, &cull_pipeline_layout));
+    registry.record(VK_OBJECT_TYPE_PIPELINE_LAYOUT, cull_pipeline_layout, "cull_pipeline_layout", "occlusion");
+    push_constant_range.size = sizeof(ReduceParameters);
+    pipeline_layout_create_info.pSetLayouts = &hiz_descriptor_set_layout;
+    VK_ASSERT(stream.create_pipeline_layout(device, &pipeline_layout_create_info, nullptr, &hiz_pipeline_layout));
+    registry.record(VK_OBJECT_TYPE_PIPELINE_LAYOUT, hiz_pipeline_layout, "hiz_pipeline_layout", "occlusion");
+
+    VkComputePipelineCreateInfo compute_pipeline_create_infos[2] {};
+    for (auto& compute_pipeline_create_info : compute_pipeline_create_infos) {
+	compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	compute_pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compute_pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compute_pipeline_create_info.stage.pName = "main";
+    }
+    compute_pipeline_create_infos[0].stage.module = cull_shader_module;
+    compute_pipeline_create_infos[0].layout = cull_pipeline_layout;
+    compute_pipeline_create_infos[1].stage.module = hiz_shader_module;
+    compute_pipeline_create_infos[1].layout = hiz_pipeline_layout;
+    VkPipeline compute_pipelines[2];
+    VK_ASSERT(stream.create_compute_pipelines(device, VK_NULL_HANDLE, 2, compute_pipeline_create_infos, nullptr, compute_pipelines));
+    cull_pipeline = compute_pipelines[0];
+    hiz_pipeline = compute_pipelines[1];
+    registry.record(VK_OBJECT_TYPE_PIPELINE, cull_pipeline, "cull_pipeline", "occlusion");
+    registry.record(VK_OBJECT_TYPE_PIPELINE, hiz_pipeline, "hiz_pipeline", "occlusion");
+}
+
+void Graphics::create_occlusion_descriptor_sets() {
+    TRACE_ZONE(__func__);
+    std::pmr::vector<VkDescriptorSetLayout> descriptor_set_layouts(swap_chain_images.size(), cull_descriptor_set_layout, frame_memory());
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info {};
+    descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptor_set_allocate_info.descriptorPool = descriptor_pool;
+    descriptor_set_allocate_info.descriptorSetCount = static_cast<uint32_t>(descriptor_set_layouts.size());
+    descriptor_set_allocate_info.pSetLayouts = descriptor_set_layouts.data();
+    cull_descriptor_sets.resize(swap_chain_images.size());
+    VK_ASSERT(stream.allocate_descriptor_sets(device, &descriptor_set_allocate_info, cull_descriptor_sets.data()));
+
+    descriptor_set_layouts.assign(hiz_levels, hiz_descriptor_set_layout);
+    descriptor_set_allocate_info.descriptorSetCount = hiz_levels;
+    descriptor_set_allocate_info.pSetLayouts = descriptor_set_layouts.data();
+    hiz_descriptor_sets.resize(hiz_levels);
+    VK_ASSERT(stream.allocate_descriptor_sets(device, &descriptor_set_allocate_info, hiz_descriptor_sets.data()));
+
+    for (std::size_t i = 0; i < cull_descriptor_sets.size(); ++i) {
+	VkDescriptorBufferInfo buffer_infos[6] {};
+	buffer_infos[0] = {uniform_buffers, i * sizeof(UniformBufferObject), sizeof(UniformBufferObject)};
+	buffer_infos[1] = {bounds_buffer, 0, VK_WHOLE_SIZE};
+	buffer_infos[2] = {candidate_buffers, i * candidate_buffer_stride, candidate_buffer_stride};
+	buffer_infos[3] = {visibility_buffer, 0, VK_WHOLE_SIZE};
+	buffer_infos[4] = {draw_id_buffers, i * draw_id_buffer_stride, draw_id_buffer_stride};
+	buffer_infos[5] = {indirect_buffers, i * indirect_buffer_stride, 2 * MAX_LOD_LEVELS * sizeof(VkDrawIndexedIndirectCommand)};
+	VkDescriptorImageInfo image_info {hiz_sampler, hiz_image_view, VK_IMAGE_LAYOUT_GENERAL};
+
+	VkWriteDescriptorSet descriptor_writes[7] {};
+	for (uint32_t binding = 0; binding < 7; ++binding) {
+	    descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	    descriptor_writes[binding].dstSet = cull_descriptor_sets.at(i);
+	    descriptor_writes[binding].dstBinding = binding;
+	    descriptor_writes[binding].dstArrayElement = 0;
+	    descriptor_writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	    descriptor_writes[binding].descriptorCount = 1;
+	    if (binding < 6) descriptor_writes[binding].pBufferInfo = &buffer_infos[binding];
+	}
+	descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptor_writes[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptor_writes[6].pImageInfo = &image_info;
+	stream.update_descriptor_sets(device, 7, descriptor_writes, 0, nullptr);
+    }
+
+    for (uint32_t level = 0; level < hiz_levels; ++level) {
+	VkDescriptorImageInfo image_infos[2] {};
+	if (level) image_infos[0] = {hiz_sampler, hiz_mip_views.at(level - 1), VK_IMAGE_LAYOUT_GENERAL};
+	else image_infos[0] = {hiz_sampler, depth_image_view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+	image_infos[1] = {VK_NULL_HANDLE, hiz_mip_views.at(level), VK_IMAGE_LAYOUT_GENERAL};
+
+	VkWriteDescriptorSet descriptor_writes[2] {};
+	for (uint32_t binding = 0; binding < 2; ++binding) {
+	    descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	    descriptor_writes[binding].dstSet = hiz_descriptor_sets.at(level);
+	    descriptor_writes[binding].dstBinding = binding;
+	    descriptor_writes[binding].dstArrayElement = 0;
+	    descriptor_writes[binding].descriptorCount = 1;
+	    descriptor_writes[binding].pImageInfo = &image_infos[binding];
+	}
+	descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	stream.update_descriptor_sets(device, 2, descriptor_writes, 0, nullptr);
+    }
+}
+
+void Graphics::create_query_pool() {
+    TRACE_ZONE(__func__);
+    uint32_t queue_family_count;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+    std::pmr::vector<VkQueueFamilyProperties> queue_families(queue_family_count, frame_memory());
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    timestamp_period = properties.limits.timestampPeriod;
+    timestamps_supported = queue_families.at(graphics_family_index).timestampValidBits > 0;
+    if (dynamic_resolution && !timestamps_supported) std::cerr << "GPU timestamps unavailable, dynamic resolution fixed at scale " << render_scale() << std::endl;
+    if (!timestamps_supported) return;
+
+    VkQueryPoolCreateInfo query_pool_create_info {};
+    query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_create_info.queryCount = static_cast<uint32_t>(swap_chain_images.size()) * OCCLUSION_TIMESTAMPS;
+    VK_ASSERT(stream.create_query_pool(device, &query_pool_create_info, nullptr, &timestamp_query_pool));
+    registry.record(VK_OBJECT_TYPE_QUERY_POOL, timestamp_query_pool, "timestamp_query_pool", "occlusion");
+}
+
+void Graphics::record_cull(VkCommandBuffer command_buffer, std::size_t image, uint32_t phase) {
+    CullParameters parameters {phase, phase == 1 ? late_draw_offset() : 0, glm::vec2(hiz_extent.width, hiz_extent.height)};
+    stream.cmd_bind_pipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+    stream.cmd_bind_descriptor_sets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline_layout, 0, 1, &cull_descriptor_sets.at(image), 0, nullptr);
+    stream.cmd_push_constants(command_buffer, cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(parameters), &parameters);
+    stream.cmd_dispatch_indirect(command_buffer, candidate_buffers, image * candidate_buffer_stride);
+
+    VkMemoryBarrier memory_barrier {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+}
+
+void Graphics::record_hiz_build(VkCommandBuffer command_buffer, VkExtent2D extent) {
+    VkMemoryBarrier memory_barrier {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.srcAccessMask = 0;
+    memory_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+    stream.cmd_bind_pipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz_pipeline);
+    memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    glm::ivec2 src_size(extent.width, extent.height);
+    for (uint32_t level = 0; level < hiz_levels; ++level) {
+	glm::ivec2 dst_size(std::max(hiz_extent.width >> level, 1u), std::max(hiz_extent.height >> level, 1u));
+	ReduceParameters parameters {src_size, dst_size};
+	stream.cmd_bind_descriptor_sets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz_pipeline_layout, 0, 1, &hiz_descriptor_sets.at(level), 0, nullptr);
+	stream.cmd_push_constants(command_buffer, hiz_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(parameters), &parameters);
+	stream.cmd_dispatch(command_buffer, (static_cast<uint32_t>(dst_size.x) + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (static_cast<uint32_t>(dst_size.y) + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+	stream.cmd_pipeline_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+	src_size = dst_size;
+    }
+}
+
+void Graphics::update_candidates(uint32_t current_image, const UniformBufferObject &ubo) {
+    bvh.cull(Frustum::from_matrix(ubo.proj[0] * ubo.view[0] * ubo.model), visible_objects);
+    for (uint32_t view = 1; view < view_count; ++view) {
+	bvh.cull(Frustum::from_matrix(ubo.proj.at(view) * ubo.view.at(view) * ubo.model), view_objects);
+	visible_objects.insert(visible_objects.end(), view_objects.begin(), view_objects.end());
+    }
+    if (view_count > 1) {
+	std::sort(visible_objects.begin(), visible_objects.end());
+	visible_objects.erase(std::unique(visible_objects.begin(), visible_objects.end()), visible_objects.end());
+    }
+    float pixels_per_unit = 0.5f * static_cast<float>(scaled_extent(command_buffer_scales.at(current_image)).height) * std::fabs(ubo.proj[0][1][1]);
+    lod_selector.select(mesh_lod, object_bounds, ubo.view[0] * ubo.model, pixels_per_unit, visible_objects, lod_ranges);
+
+    uint32_t count = static_cast<uint32_t>(visible_objects.size());
+    void *data;
+    stream.map_memory(device, candidate_buffers_memory, current_image * candidate_buffer_stride, CANDIDATE_HEADER_SIZE + count * sizeof(uint32_t), 0, &data);
+    auto header = static_cast<uint32_t*>(data);
+    header[0] = (count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+    header[1] = 1;
+    header[2] = 1;
+    header[3] = count;
+    std::copy(lod_ranges.begin(), lod_ranges.end() - 1, header + 4);
+    memcpy(header + CANDIDATE_HEADER_SIZE / sizeof(uint32_t), visible_objects.data(), count * sizeof(uint32_t));
+    stream.unmap_memory(device, candidate_buffers_memory);
+
+    std::array<VkDrawIndexedIndirectCommand, 2 * MAX_LOD_LEVELS> commands {};
+    for (std::size_t level = 0; level < mesh_lod.levels.size(); ++level) {
+	for (std::size_t phase = 0; phase < 2; ++phase) {
+	    auto& command = commands.at(phase * MAX_LOD_LEVELS + level);
+	    command.indexCount = mesh_lod.levels.at(level).index_count;
+	    command.firstIndex = mesh_lod.levels.at(level).first_index;
+	    command.vertexOffset = mesh_lod.vertex_offset;
+	    command.firstInstance = lod_ranges.at(level);
+	}
+    }
+    stream.map_memory(device, indirect_buffers_memory, current_image * indirect_buffer_stride, sizeof(commands), 0, &data);
+    memcpy(data, commands.data(), sizeof(commands));
+    stream.unmap_memory(device, indirect_buffers_memory);
+    image_candidate_counts.at(current_image) = count;
+}
+
+void Graphics::calibrate_trace_clock() {
+    if (!timestamps_supported) return;
+    VkCommandBuffer command_buffer = begin_one_time_commands();
+    stream.cmd_reset_query_pool(command_buffer, timestamp_query_pool, 0, 1);
+    stream.cmd_write_timestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, 0);
+    uint64_t before = trace_now_ns();
+    end_one_time_commands(command_buffer);
+    uint64_t after = trace_now_ns();
+    uint64_t tick;
+    VK_ASSERT(vkGetQueryPoolResults(device, timestamp_query_pool, 0, 1, sizeof(tick), &tick, sizeof(tick), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    trace_gpu_offset_ns = static_cast<int64_t>(before + (after - before) / 2) - static_cast<int64_t>(static_cast<double>(tick) * static_cast<double>(timestamp_period));
+}
+
+void Graphics::trace_gpu_frame(const uint64_t *ticks) {
+    static const char *const spans[OCCLUSION_TIMESTAMPS - 1] = {"early_cull", "early_geometry", "hiz_and_late_cull", "late_geometry"};
+    auto ns = [this](uint64_t tick) {
+	return static_cast<uint64_t>(std::max<int64_t>(trace_gpu_offset_ns + static_cast<int64_t>(static_cast<double>(tick) * static_cast<double>(timestamp_period)), 0));
+    };
+    for (uint32_t span = 0; span + 1 < OCCLUSION_TIMESTAMPS; ++span)
+	trace_record(spans[span], ns(ticks[span]), ns(ticks[span + 1]), TraceTrack::GPU);
+}
+
+void Graphics::collect_occlusion_stats(uint32_t image_index) {
+    std::size_t candidates = image_candidate_counts.at(image_index);
+    if (candidates == NO_CANDIDATES) return;
+    image_candidate_counts.at(image_index) = NO_CANDIDATES;
+
+    void *data;
+    VK_ASSERT(vkMapMemory(device, indirect_buffers_memory, image_index * indirect_buffer_stride, 2 * MAX_LOD_LEVELS * sizeof(VkDrawIndexedIndirectCommand), 0, &data));
+    auto commands = static_cast<const VkDrawIndexedIndirectCommand*>(data);
+    uint64_t early = 0, late = 0;
+    for (uint32_t level = 0; level < MAX_LOD_LEVELS; ++level) {
+	uint64_t instances = commands[level].instanceCount + commands[MAX_LOD_LEVELS + level].instanceCount;
+	early += commands[level].instanceCount;
+	late += commands[MAX_LOD_LEVELS + level].instanceCount;
+	occlusion_stats.triangles += instances * commands[level].indexCount / 3;
+	occlusion_stats.full_triangles += instances * mesh_lod.levels.front().index_count / 3;
+    }
+    vkUnmapMemory(device, indirect_buffers_memory);
+
+    ++occlusion_stats.frames;
+    occlusion_stats.candidates += candidates;
+    occlusion_stats.drawn += early + late;
+    occlusion_stats.late_drawn += late;
+    if (timestamps_supported) {
+	std::array<uint64_t, OCCLUSION_TIMESTAMPS> ticks;
+	if (vkGetQueryPoolResults(device, timestamp_query_pool, image_index * OCCLUSION_TIMESTAMPS, OCCLUSION_TIMESTAMPS, sizeof(ticks), ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+	    auto ms = [this](uint64_t begin, uint64_t end) { return static_cast<double>(end - begin) * static_cast<double>(timestamp_period) / 1000000.0; };
+	    occlusion_stats.cull_ms += ms(ticks[0], ticks[1]) + ms(ticks[2], ticks[3]);
+	    occlusion_stats.geometry_ms += ms(ticks[1], ticks[2]) + ms(ticks[3], ticks[4]);
+	    ++occlusion_stats.timed_frames;
+	    if (dynamic_resolution) resolution_controller.update(ms(ticks[0], ticks[4]));
+#ifdef VKT_TRACE
+	    trace_gpu_frame(ticks.data());
+#endif
+	}
+    }
+    if (occlusion_stats.frames < OCCLUSION_REPORT_FRAMES) return;
+
+    auto frames = static_cast<double>(occlusion_stats.frames);
+    auto culled = occlusion_stats.candidates - occlusion_stats.drawn;
+    std::cout << "Occlusion " << (occlusion_enabled ? "on" : "off") << ": " << static_cast<double>(occlusion_stats.candidates) / frames << " candidates, "
+	      << (occlusion_stats.candidates ? 100.0 * static_cast<double>(culled) / static_cast<double>(occlusion_stats.candidates) : 0.0) << "% culled, "
+	      << static_cast<double>(occlusion_stats.late_drawn) / frames << " drawn late";
+    if (occlusion_stats.timed_frames) {
+	auto timed = static_cast<double>(occlusion_stats.timed_frames);
+	double geometry_ms = occlusion_stats.geometry_ms / timed, cull_ms = occlusion_stats.cull_ms / timed;
+	double drawn = static_cast<double>(occlusion_stats.drawn) / frames;
+	double saved_ms = drawn > 0.0 ? geometry_ms / drawn * static_cast<double>(culled) / frames : 0.0;
+	std::cout << ", geometry " << geometry_ms << " ms, cull+hi-z " << cull_ms << " ms, saved ~" << saved_ms - cull_ms << " ms";
+    }
+    std::cout << std::endl;
+
+    const LODStats &lod_stats = lod_selector.get_stats();
+    std::cout << "LOD: " << static_cast<double>(occlusion_stats.triangles) / frames << " triangles per frame, "
+	      << (occlusion_stats.full_triangles ? 100.0 * (1.0 - static_cast<double>(occlusion_stats.triangles) / static_cast<double>(occlusion_stats.full_triangles)) : 0.0)
+	      << "% saved vs full detail, mean error " << (lod_stats.objects ? lod_stats.error_px / static_cast<double>(lod_stats.objects) : 0.0)
+	      << " px (max " << lod_stats.max_error_px << " px), " << static_cast<double>(lod_stats.switches) / frames << " switches per frame" << std::endl;
+    if (view_count > 1) {
+	std::size_t passes = view_framebuffers.size();
+	std::cout << "Views: " << view_count << (multiview_enabled ? " in one multiview pass" : " in separate passes") << ", "
+		  << 2 * passes << " render passes and " << passes * mesh_lod.levels.size() << " indirect draws per frame, cpu " << occlusion_stats.cpu_ms / frames << " ms";
+	if (occlusion_stats.timed_frames)
+	    std::cout << ", geometry " << occlusion_stats.geometry_ms / static_cast<double>(occlusion_stats.timed_frames) / view_count << " ms per view";
+	std::cout << std::endl;
+    }
+    if (dynamic_resolution) {
+	const ResolutionStats &resolution_stats = resolution_controller.get_stats();
+	auto timed = static_cast<double>(std::max<uint64_t>(resolution_stats.frames, 1));
+	VkExtent2D extent = scaled_extent(resolution_controller.scale());
+	std::cout << "Resolution: scale " << resolution_controller.scale() << " (" << extent.width << "x" << extent.height << " of " << render_extent.width << "x" << render_extent.height
+		  << "), mean " << resolution_stats.scale_sum / timed << ", gpu " << resolution_stats.gpu_ms / timed << " ms against " << resolution_controller.target() << " ms, "
+		  << 100.0 * static_cast<double>(resolution_stats.over_budget) / timed << "% over budget, " << resolution_stats.changes << " changes" << std::endl;
+	resolution_controller.reset_stats();
+    }
+    lod_selector.reset_stats();
+    occlusion_stats = {};
+}
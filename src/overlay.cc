@@ -0,0 +1,264 @@
+#include "graphics.h"
+
+static constexpr uint64_t OVERLAY_REPORT_FRAMES = 240;
+
+void Graphics::create_overlay() {
+    TRACE_ZONE(__func__);
+    const char *capacity_env = std::getenv("VKT_OVERLAY_CAPACITY");
+    overlay_capacity = std::max(capacity_env ? static_cast<uint32_t>(std::stoul(capacity_env)) : 16384u, 1u);
+
+    overlay_vert_shader_module = create_shader_module(&_binary_build_shaders_overlay_vert_spv_start, &_binary_build_shaders_overlay_vert_spv_end, "overlay_vert_shader_module", "overlay");
+    overlay_frag_shader_module = create_shader_module(&_binary_build_shaders_overlay_frag_spv_start, &_binary_build_shaders_overlay_frag_spv_end, "overlay_frag_shader_module", "overlay");
+
+    VkDeviceSize ring_size = static_cast<VkDeviceSize>(overlay_capacity) * QuadBatcher::VERTICES_PER_QUAD * sizeof(QuadVertex) * MAX_FRAMES_IN_FLIGHT;
+    create_buffer(ring_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, overlay_vertex_buffer, overlay_vertex_buffer_memory, "overlay_vertex_buffer", "overlay");
+    void *data;
+    VK_ASSERT(vkMapMemory(device, overlay_vertex_buffer_memory, 0, ring_size, 0, &data));
+    overlay_vertices = static_cast<QuadVertex*>(data);
+    std::vector<uint32_t> indices = QuadBatcher::quad_indices(overlay_capacity);
+    upload_buffer(indices.data(), sizeof(indices[0]) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, overlay_index_buffer, overlay_index_buffer_memory, "overlay_index_buffer", "overlay");
+
+    VkCommandPoolCreateInfo command_pool_create_info {};
+    command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_create_info.queueFamilyIndex = graphics_family_index;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    VK_ASSERT(stream.create_command_pool(device, &command_pool_create_info, nullptr, &overlay_command_pool));
+    registry.record(VK_OBJECT_TYPE_COMMAND_POOL, overlay_command_pool, "overlay_command_pool", "overlay");
+
+    VkCommandBufferAllocateInfo command_buffer_allocate_info {};
+    command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_allocate_info.commandPool = overlay_command_pool;
+    command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_buffer_allocate_info.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+    overlay_command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
+    VK_ASSERT(stream.allocate_command_buffers(device, &command_buffer_allocate_info, overlay_command_buffers.data()));
+}
+
+void Graphics::destroy_overlay() {
+    registry.release(VK_OBJECT_TYPE_COMMAND_POOL, overlay_command_pool);
+    vkDestroyCommandPool(device, overlay_command_pool, nullptr);
+    vkUnmapMemory(device, overlay_vertex_buffer_memory);
+    destroy_buffer(overlay_vertex_buffer, overlay_vertex_buffer_memory);
+    destroy_buffer(overlay_index_buffer, overlay_index_buffer_memory);
+    for (auto module : {overlay_vert_shader_module, overlay_frag_shader_module}) {
+	registry.release(VK_OBJECT_TYPE_SHADER_MODULE, module);
+	vkDestroyShaderModule(device, module, nullptr);
+    }
+}
+
+void Graphics::create_overlay_pipelines() {
+    TRACE_ZONE(__func__);
+    VkAttachmentDescription attachment {};
+    attachment.format = surface_format.format;
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference color_attachment_reference {};
+    color_attachment_reference.attachment = 0;
+    color_attachment_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &color_attachment_reference;
+
+    VkSubpassDependency dependency {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo render_pass_create_info {};
+    render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_create_info.attachmentCount = 1;
+    render_pass_create_info.pAttachments = &attachment;
+    render_pass_create_info.subpassCount = 1;
+    render_pass_create_info.pSubpasses = &subpass;
+    render_pass_create_info.dependencyCount = 1;
+    render_pass_create_info.pDependencies = &dependency;
+    VK_ASSERT(stream.create_render_pass(device, &render_pass_create_info, nullptr, &overlay_render_pass));
+    registry.record(VK_OBJECT_TYPE_RENDER_PASS, overlay_render_pass, "overlay_render_pass", "overlay");
+
+    overlay_framebuffers.resize(swap_chain_image_views.size());
+    for (std::size_t i = 0; i < overlay_framebuffers.size(); ++i) {
+	VkFramebufferCreateInfo framebuffer_create_info {};
+	framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebuffer_create_info.renderPass = overlay_render_pass;
+	framebuffer_create_info.attachmentCount = 1;
+	framebuffer_create_info.pAttachments = &swap_chain_image_views.at(i);
+	framebuffer_create_info.width = swap_extent.width;
+	framebuffer_create_info.height = swap_extent.height;
+	framebuffer_create_info.layers = 1;
+	VK_ASSERT(stream.create_framebuffer(device, &framebuffer_create_info, nullptr, &overlay_framebuffers.at(i)));
+	registry.record(VK_OBJECT_TYPE_FRAMEBUFFER, overlay_framebuffers.at(i), "overlay_framebuffer_" + std::to_string(i), "overlay");
+    }
+
+    VkPushConstantRange push_constant_range {};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(glm::vec2);
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info {};
+    pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_create_info.pushConstantRangeCount = 1;
+    pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
+    VK_ASSERT(stream.create_pipeline_layout(device, &pipeline_layout_create_info, nullptr, &overlay_pipeline_layout));
+    registry.record(VK_OBJECT_TYPE_PIPELINE_LAYOUT, overlay_pipeline_layout, "overlay_pipeline_layout", "overlay");
+
+    VkPipelineShaderStageCreateInfo shader_stages_create_info[2] {};
+    for (auto& stage : shader_stages_create_info) {
+	stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stage.pName = "main";
+    }
+    shader_stages_create_info[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shader_stages_create_info[0].module = overlay_vert_shader_module;
+    shader_stages_create_info[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shader_stages_create_info[1].module = overlay_frag_shader_module;
+
+    VkVertexInputBindingDescription binding_description {0, sizeof(QuadVertex), VK_VERTEX_INPUT_RATE_VERTEX};
+    VkVertexInputAttributeDescription attribute_descriptions[3] = {
+	{0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(QuadVertex, pos)},
+	{1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(QuadVertex, uv)},
+	{2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(QuadVertex, color)},
+    };
+    VkPipelineVertexInputStateCreateInfo vertex_input_create_info {};
+    vertex_input_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_create_info.vertexBindingDescriptionCount = 1;
+    vertex_input_create_info.pVertexBindingDescriptions = &binding_description;
+    vertex_input_create_info.vertexAttributeDescriptionCount = 3;
+    vertex_input_create_info.pVertexAttributeDescriptions = attribute_descriptions;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_create_info {};
+    input_assembly_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkViewport overlay_viewport {0.0f, 0.0f, static_cast<float>(swap_extent.width), static_cast<float>(swap_extent.height), 0.0f, 1.0f};
+    VkRect2D overlay_scissor {{0, 0}, swap_extent};
+    VkPipelineViewportStateCreateInfo viewport_state_create_info {};
+    viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state_create_info.viewportCount = 1;
+    viewport_state_create_info.pViewports = &overlay_viewport;
+    viewport_state_create_info.scissorCount = 1;
+    viewport_state_create_info.pScissors = &overlay_scissor;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer_state_create_info {};
+    rasterizer_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer_state_create_info.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer_state_create_info.lineWidth = 1.0f;
+    rasterizer_state_create_info.cullMode = VK_CULL_MODE_NONE;
+    rasterizer_state_create_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisample_state_create_info {};
+    multisample_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample_state_create_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisample_state_create_info.minSampleShading = 1.0f;
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment {};
+    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo color_blend_state_create_info {};
+    color_blend_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blend_state_create_info.attachmentCount = 1;
+    color_blend_state_create_info.pAttachments = &color_blend_attachment;
+
+    VkGraphicsPipelineCreateInfo graphics_pipeline_create_info {};
+    graphics_pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    graphics_pipeline_create_info.stageCount = 2;
+    graphics_pipeline_create_info.pStages = shader_stages_create_info;
+    graphics_pipeline_create_info.pVertexInputState = &vertex_input_create_info;
+    graphics_pipeline_create_info.pInputAssemblyState = &input_assembly_create_info;
+    graphics_pipeline_create_info.pViewportState = &viewport_state_create_info;
+    graphics_pipeline_create_info.pRasterizationState = &rasterizer_state_create_info;
+    graphics_pipeline_create_info.pMultisampleState = &multisample_state_create_info;
+    graphics_pipeline_create_info.pColorBlendState = &color_blend_state_create_info;
+    graphics_pipeline_create_info.layout = overlay_pipeline_layout;
+    graphics_pipeline_create_info.renderPass = overlay_render_pass;
+    graphics_pipeline_create_info.subpass = 0;
+    graphics_pipeline_create_info.basePipelineIndex = -1;
+
+    for (std::size_t pipeline = 0; pipeline < OVERLAY_PIPELINES; ++pipeline) {
+	color_blend_attachment.blendEnable = pipeline == static_cast<std::size_t>(OverlayPipeline::BLEND) ? VK_TRUE : VK_FALSE;
+	VK_ASSERT(stream.create_graphics_pipelines(device, pipeline_cache, 1, &graphics_pipeline_create_info, nullptr, &overlay_pipelines.at(pipeline)));
+	registry.record(VK_OBJECT_TYPE_PIPELINE, overlay_pipelines.at(pipeline), "overlay_pipeline_" + std::to_string(pipeline), "overlay");
+    }
+}
+
+void Graphics::destroy_overlay_pipelines() {
+    for (auto pipeline : overlay_pipelines)
+	retire(VK_OBJECT_TYPE_PIPELINE, pipeline);
+    retire(VK_OBJECT_TYPE_PIPELINE_LAYOUT, overlay_pipeline_layout);
+    for (auto fb : overlay_framebuffers)
+	retire(VK_OBJECT_TYPE_FRAMEBUFFER, fb);
+    overlay_framebuffers.clear();
+    retire(VK_OBJECT_TYPE_RENDER_PASS, overlay_render_pass);
+}
+
+VkCommandBuffer Graphics::record_overlay(uint32_t image_index) {
+    if (!overlay_batcher.size()) return VK_NULL_HANDLE;
+
+    auto before = micro_sec();
+    std::size_t frame_vertex = current_frame * overlay_capacity * QuadBatcher::VERTICES_PER_QUAD;
+    const std::vector<QuadBatch> &batches = overlay_batcher.flush(overlay_vertices + frame_vertex, overlay_capacity);
+    overlay_flush_ms += static_cast<double>(micro_sec() - before) / 1000.0;
+    if (stream.recording()) {
+	uint32_t written_quads = 0;
+	for (const auto& batch : batches) written_quads = std::max(written_quads, batch.first_quad + batch.quad_count);
+	stream.write_memory(overlay_vertex_buffer_memory, frame_vertex * sizeof(QuadVertex), written_quads * QuadBatcher::VERTICES_PER_QUAD * sizeof(QuadVertex), overlay_vertices + frame_vertex);
+    }
+
+    VkCommandBuffer command_buffer = overlay_command_buffers.at(current_frame);
+    stream.reset_command_buffer(command_buffer, 0);
+    VkCommandBufferBeginInfo command_buffer_begin_info {};
+    command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_ASSERT(stream.begin_command_buffer(command_buffer, &command_buffer_begin_info));
+
+    VkRenderPassBeginInfo render_pass_begin_info {};
+    render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_begin_info.renderPass = overlay_render_pass;
+    render_pass_begin_info.framebuffer = overlay_framebuffers.at(image_index);
+    render_pass_begin_info.renderArea.offset = {0, 0};
+    render_pass_begin_info.renderArea.extent = swap_extent;
+    stream.cmd_begin_render_pass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    VkDeviceSize offset = 0;
+    stream.cmd_bind_vertex_buffers(command_buffer, 0, 1, &overlay_vertex_buffer, &offset);
+    stream.cmd_bind_index_buffer(command_buffer, overlay_index_buffer, 0, VK_INDEX_TYPE_UINT32);
+    glm::vec2 inverse_screen_size(1.0f / static_cast<float>(swap_extent.width), 1.0f / static_cast<float>(swap_extent.height));
+    stream.cmd_push_constants(command_buffer, overlay_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(inverse_screen_size), &inverse_screen_size);
+    std::size_t bound = OVERLAY_PIPELINES;
+    for (const auto& batch : batches) {
+	std::size_t pipeline = std::min<std::size_t>(batch.pipeline, OVERLAY_PIPELINES - 1);
+	if (pipeline != bound) {
+	    stream.cmd_bind_pipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, overlay_pipelines.at(pipeline));
+	    bound = pipeline;
+	}
+	auto vertex_offset = static_cast<int32_t>(frame_vertex + static_cast<std::size_t>(batch.first_quad) * QuadBatcher::VERTICES_PER_QUAD);
+	stream.cmd_draw_indexed(command_buffer, batch.quad_count * QuadBatcher::INDICES_PER_QUAD, 1, 0, vertex_offset, 0);
+    }
+    stream.cmd_end_render_pass(command_buffer);
+    VK_ASSERT(stream.end_command_buffer(command_buffer));
+
+    const BatchStats &stats = overlay_batcher.get_stats();
+    if (stats.frames >= OVERLAY_REPORT_FRAMES) {
+	auto frames = static_cast<double>(stats.frames);
+	std::cout << "Overlay: " << static_cast<double>(stats.quads) / frames << " quads in " << static_cast<double>(stats.batches) / frames << " draws per frame, flush "
+		  << overlay_flush_ms / frames << " ms (" << (overlay_flush_ms > 0.0 ? static_cast<double>(stats.quads) / overlay_flush_ms : 0.0) << " quads/ms)";
+	if (stats.dropped) std::cout << ", " << stats.dropped << " quads dropped over capacity " << overlay_capacity;
+	std::cout << std::endl;
+	overlay_batcher.reset_stats();
+	overlay_flush_ms = 0.0;
+    }
+    return command_buffer;
+}
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <exception>
+#include <unordered_set>
+
+#include "pipeline.h"
+
+std::string PipelineVariant::name() const {
+    return std::string("scene_pipeline_") + (shading == ShadingMode::OBJECT_ID ? "object" : "vertex") + "_l" + std::to_string(light_count) + "_c" + std::to_string(cull_mode);
+}
+
+std::size_t PipelineVariantHash::operator()(const PipelineVariant &variant) const noexcept {
+    uint64_t hash = 14695981039346656037ULL;
+    for (uint32_t word : {static_cast<uint32_t>(variant.shading), variant.light_count, static_cast<uint32_t>(variant.cull_mode)}) {
+	hash ^= word;
+	hash *= 1099511628211ULL;
+    }
+    return static_cast<std::size_t>(hash);
+}
+
+void PipelineVariants::reset(Builder new_builder, ResourceRegistry *new_registry) {
+    builder = std::move(new_builder);
+    registry = new_registry;
+}
+
+VkPipeline PipelineVariants::get(const PipelineVariant &variant) {
+    ++stats.requests;
+    auto found = pipelines.find(variant);
+    if (found != pipelines.end()) {
+	++stats.deduplicated;
+	return found->second;
+    }
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = builder(variant);
+    stats.compile_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    ++stats.compiled;
+    registry->record(VK_OBJECT_TYPE_PIPELINE, pipeline, variant.name(), "pipeline_variants");
+    pipelines.emplace(variant, pipeline);
+    return pipeline;
+}
+
+std::size_t PipelineVariants::prewarm(const std::vector<PipelineVariant> &variants) {
+    std::unordered_set<PipelineVariant, PipelineVariantHash> seen;
+    std::vector<PipelineVariant> missing;
+    for (const auto &variant : variants) {
+	++stats.requests;
+	if (pipelines.contains(variant) || !seen.insert(variant).second) ++stats.deduplicated;
+	else missing.push_back(variant);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<VkPipeline> built(missing.size(), VK_NULL_HANDLE);
+    std::vector<std::exception_ptr> errors(missing.size());
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t i = 0; i < missing.size(); ++i) {
+	try {
+	    built[i] = builder(missing[i]);
+	} catch (...) {
+	    errors[i] = std::current_exception();
+	}
+    }
+    stats.compile_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::exception_ptr error;
+    for (std::size_t i = 0; i < missing.size(); ++i) {
+	if (errors[i]) {
+	    if (!error) error = errors[i];
+	    continue;
+	}
+	++stats.compiled;
+	registry->record(VK_OBJECT_TYPE_PIPELINE, built[i], missing[i].name(), "pipeline_variants");
+	pipelines.emplace(missing[i], built[i]);
+    }
+    if (error) std::rethrow_exception(error);
+    return missing.size();
+}
+
+std::vector<VkPipeline> PipelineVariants::take_pipelines() {
+    std::vector<VkPipeline> taken;
+    taken.reserve(pipelines.size());
+    for (const auto &[variant, pipeline] : pipelines) taken.push_back(pipeline);
+    pipelines.clear();
+    return taken;
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "registry.h"
+
+const char *object_type_name(VkObjectType type) {
+    switch (type) {
+    case VK_OBJECT_TYPE_BUFFER: return "buffer";
+    case VK_OBJECT_TYPE_IMAGE: return "image";
+    case VK_OBJECT_TYPE_IMAGE_VIEW: return "image_view";
+    case VK_OBJECT_TYPE_DEVICE_MEMORY: return "device_memory";
+    case VK_OBJECT_TYPE_SWAPCHAIN_KHR: return "swapchain";
+    case VK_OBJECT_TYPE_FRAMEBUFFER: return "framebuffer";
+    case VK_OBJECT_TYPE_RENDER_PASS: return "render_pass";
+    case VK_OBJECT_TYPE_SHADER_MODULE: return "shader_module";
+    case VK_OBJECT_TYPE_PIPELINE: return "pipeline";
+    case VK_OBJECT_TYPE_PIPELINE_LAYOUT: return "pipeline_layout";
+    case VK_OBJECT_TYPE_PIPELINE_CACHE: return "pipeline_cache";
+    case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT: return "descriptor_set_layout";
+    case VK_OBJECT_TYPE_DESCRIPTOR_POOL: return "descriptor_pool";
+    case VK_OBJECT_TYPE_COMMAND_POOL: return "command_pool";
+    case VK_OBJECT_TYPE_SEMAPHORE: return "semaphore";
+    case VK_OBJECT_TYPE_FENCE: return "fence";
+    case VK_OBJECT_TYPE_QUERY_POOL: return "query_pool";
+    case VK_OBJECT_TYPE_SAMPLER: return "sampler";
+    default: return "object";
+    }
+}
+
+void ResourceRegistry::init(VkPhysicalDevice new_physical_device, VkDevice new_device, bool has_memory_budget, bool has_debug_utils) {
+    physical_device = new_physical_device;
+    device = new_device;
+    memory_budget_supported = has_memory_budget;
+    if (has_debug_utils)
+	set_object_name = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(vkGetDeviceProcAddr(device, "vkSetDebugUtilsObjectNameEXT"));
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
+    tracked_per_heap.assign(mem_props.memoryHeapCount, 0);
+}
+
+void ResourceRegistry::record_raw(VkObjectType type, uint64_t handle, std::string name, std::string owner, VkDeviceSize size, uint32_t heap) {
+    if (set_object_name) {
+	VkDebugUtilsObjectNameInfoEXT name_info {};
+	name_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+	name_info.objectType = type;
+	name_info.objectHandle = handle;
+	name_info.pObjectName = name.c_str();
+	set_object_name(device, &name_info);
+    }
+    if (heap != NO_HEAP) {
+	tracked_per_heap.at(heap) += size;
+	tracked_bytes += size;
+	peak_bytes = std::max(peak_bytes, tracked_bytes);
+    }
+    auto it = records.try_emplace(ResourceKey {type, handle}, ResourceRecord {type, handle, std::move(name), std::move(owner), size, heap, 0}).first;
+    ++it->second.count;
+}
+
+void ResourceRegistry::release_raw(VkObjectType type, uint64_t handle) {
+    auto it = records.find(ResourceKey {type, handle});
+    if (it == records.end()) throw std::runtime_error("Released unknown resource");
+    if (it->second.heap != NO_HEAP) {
+	tracked_per_heap.at(it->second.heap) -= it->second.size;
+	tracked_bytes -= it->second.size;
+    }
+    if (!--it->second.count) records.erase(it);
+}
+
+uint32_t ResourceRegistry::heap_of_type(uint32_t memory_type) const {
+    return mem_props.memoryTypes[memory_type].heapIndex;
+}
+
+std::vector<HeapUsage> ResourceRegistry::heap_usage() const {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props {};
+    budget_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 mem_props2 {};
+    mem_props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    mem_props2.pNext = memory_budget_supported ? &budget_props : nullptr;
+    vkGetPhysicalDeviceMemoryProperties2(physical_device, &mem_props2);
+
+    std::vector<HeapUsage> heaps(mem_props.memoryHeapCount);
+    for (uint32_t i = 0; i < mem_props.memoryHeapCount; ++i) {
+	heaps[i].size = mem_props.memoryHeaps[i].size;
+	heaps[i].flags = mem_props.memoryHeaps[i].flags;
+	heaps[i].tracked = tracked_per_heap.at(i);
+	heaps[i].budget = memory_budget_supported ? budget_props.heapBudget[i] : heaps[i].size;
+	heaps[i].usage = memory_budget_supported ? budget_props.heapUsage[i] : heaps[i].tracked;
+    }
+    return heaps;
+}
+
+static void write_json_string(std::ostream &out, const std::string &str) {
+    out << '"';
+    for (char c : str) {
+	if (c == '"' || c == '\\') out << '\\';
+	out << c;
+    }
+    out << '"';
+}
+
+void ResourceRegistry::export_snapshot(std::ostream &out) const {
+    auto heaps = heap_usage();
+    out << "{\n  \"memory_budget_ext\": " << (memory_budget_supported ? "true" : "false") << ",\n";
+    out << "  \"tracked_bytes\": " << tracked_bytes << ",\n  \"peak_tracked_bytes\": " << peak_bytes << ",\n";
+    out << "  \"heaps\": [\n";
+    for (std::size_t i = 0; i < heaps.size(); ++i) {
+	out << "    {\"index\": " << i
+	    << ", \"device_local\": " << ((heaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "true" : "false")
+	    << ", \"size\": " << heaps[i].size
+	    << ", \"budget\": " << heaps[i].budget
+	    << ", \"usage\": " << heaps[i].usage
+	    << ", \"tracked\": " << heaps[i].tracked << "}" << (i + 1 < heaps.size() ? ",\n" : "\n");
+    }
+    out << "  ],\n  \"resources\": [\n";
+
+    std::vector<const ResourceRecord*> sorted;
+    sorted.reserve(records.size());
+    for (const auto& [key, record] : records) sorted.push_back(&record);
+    std::sort(sorted.begin(), sorted.end(), [](const ResourceRecord *a, const ResourceRecord *b) { return a->size > b->size; });
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+	out << "    {\"type\": \"" << object_type_name(sorted[i]->type) << "\", \"name\": ";
+	write_json_string(out, sorted[i]->name);
+	out << ", \"owner\": ";
+	write_json_string(out, sorted[i]->owner);
+	out << ", \"size\": " << sorted[i]->size;
+	if (sorted[i]->count > 1) out << ", \"count\": " << sorted[i]->count;
+	if (sorted[i]->heap != NO_HEAP) out << ", \"heap\": " << sorted[i]->heap;
+	out << "}" << (i + 1 < sorted.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+std::size_t ResourceRegistry::report_leaks(std::ostream &out) const {
+    std::size_t leaks = 0;
+    for (const auto& [key, record] : records) {
+	out << "Leaked ";
+	if (record.count > 1) out << record.count << " x ";
+	out << object_type_name(record.type) << " \"" << record.name << "\" owned by " << record.owner;
+	if (record.heap != NO_HEAP) out << " (" << record.size << " bytes in heap " << record.heap << ")";
+	out << '\n';
+	leaks += record.count;
+    }
+    return leaks;
+}
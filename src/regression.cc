@@ -0,0 +1,188 @@
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "graphics.h"
+#include "golden.h"
+
+static constexpr unsigned long long FRAME_STEP_US = 16667;
+static constexpr uint64_t WARMUP_FRAMES = 8;
+static constexpr uint64_t MEASURED_FRAMES = 32;
+static constexpr double MAX_MEAN_DELTA_E = 0.5;
+static constexpr double MAX_PERCEPTIBLE_FRACTION = 0.001;
+static constexpr double FRAME_TIME_MARGIN = 1.5;
+static constexpr double DEVICE_MEMORY_MARGIN = 1.05;
+
+struct ReferenceScene {
+    const char *name;
+    std::vector<std::pair<const char*, const char*>> environment;
+    uint32_t overlay_quads;
+};
+
+struct SceneResult {
+    double frame_ms;
+    double allocations;
+    uint64_t max_allocations;
+    double device_mib;
+    std::string capture_path;
+};
+
+static const char *const scene_variables[] = {
+    "VKT_OBJECTS", "VKT_SCENE", "VKT_MESH_DETAIL", "VKT_LOD_PIXELS", "VKT_OCCLUSION", "VKT_VIEWS", "VKT_MULTIVIEW", "VKT_VIEW_SEPARATION",
+    "VKT_SHADING", "VKT_LIGHTS", "VKT_PIPELINE_PREWARM", "VKT_DYNAMIC_RESOLUTION", "VKT_FRAME_ARENA", "VKT_OVERLAY_CAPACITY", "VKT_STREAM_FILE",
+};
+
+static const std::vector<ReferenceScene> reference_scenes = {
+    {"single", {}, 0},
+    {"grid", {{"VKT_OBJECTS", "256"}}, 0},
+    {"grid_no_occlusion", {{"VKT_OBJECTS", "256"}, {"VKT_OCCLUSION", "0"}}, 0},
+    {"lit", {{"VKT_OBJECTS", "64"}, {"VKT_SHADING", "object"}, {"VKT_LIGHTS", "4"}}, 0},
+    {"stereo", {{"VKT_OBJECTS", "64"}, {"VKT_VIEWS", "2"}}, 0},
+    {"overlay", {{"VKT_OBJECTS", "16"}}, 512},
+};
+
+static void draw_reference_overlay(Graphics &graphics, uint32_t quads) {
+    glm::vec2 screen = graphics.screen_size();
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(quads))));
+    glm::vec2 cell = screen / static_cast<float>(std::max(side, 1u));
+    for (uint32_t i = 0; i < quads; ++i) {
+	glm::vec2 min = glm::vec2(static_cast<float>(i % side), static_cast<float>(i / side)) * cell;
+	float shade = static_cast<float>(i) / static_cast<float>(quads);
+	graphics.draw_quad(min + cell * 0.25f, min + cell * 0.75f, {shade, 1.0f - shade, 0.5f, 0.5f}, i % 2 ? OverlayPipeline::BLEND : OverlayPipeline::SOLID, static_cast<uint16_t>(i % 3));
+    }
+}
+
+static SceneResult render_scene(const ReferenceScene &scene, const std::filesystem::path &output_directory) {
+    std::filesystem::path directory = output_directory / scene.name;
+    std::filesystem::create_directories(directory);
+    for (const char *variable : scene_variables) unsetenv(variable);
+    for (const auto& [variable, value] : scene.environment) setenv(variable, value, 1);
+    setenv("VKT_HEADLESS", "1", 1);
+    setenv("VKT_CAPTURE_DIR", directory.c_str(), 1);
+    setenv("VKT_CAPTURE_FORMAT", "ppm", 1);
+
+    uint64_t golden_frame = WARMUP_FRAMES + MEASURED_FRAMES;
+    std::ostringstream name;
+    name << "frame_" << std::setw(6) << std::setfill('0') << golden_frame << ".ppm";
+    SceneResult result {0.0, 0.0, 0, 0.0, (directory / name.str()).string()};
+    std::filesystem::remove(result.capture_path);
+    {
+	Graphics graphics(fixed_step_clock(FRAME_STEP_US));
+	graphics.capture_from = golden_frame;
+	for (uint64_t frame = 0; frame <= golden_frame; ++frame) {
+	    draw_reference_overlay(graphics, scene.overlay_quads);
+	    uint64_t allocations = heap_allocation_count();
+	    auto before = micro_sec();
+	    graphics.render_tick();
+	    auto after = micro_sec();
+	    allocations = heap_allocation_count() - allocations;
+	    if (frame < WARMUP_FRAMES || frame >= golden_frame) continue;
+	    result.frame_ms += static_cast<double>(after - before) / 1000.0;
+	    result.allocations += static_cast<double>(allocations);
+	    result.max_allocations = std::max(result.max_allocations, allocations);
+	}
+	result.device_mib = static_cast<double>(graphics.peak_device_bytes()) / (1024.0 * 1024.0);
+    }
+    result.frame_ms /= MEASURED_FRAMES;
+    result.allocations /= MEASURED_FRAMES;
+    return result;
+}
+
+static void write_baseline(const std::string &path, const SceneResult &result) {
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("Failed to open " + path);
+    out << std::setprecision(17) << result.frame_ms << ' ' << result.allocations << ' ' << result.device_mib << std::endl;
+}
+
+static SceneResult read_baseline(const std::string &path) {
+    std::ifstream in(path);
+    SceneResult baseline {};
+    if (!(in >> baseline.frame_ms >> baseline.allocations >> baseline.device_mib)) throw std::runtime_error("Failed to read a measured baseline from " + path);
+    return baseline;
+}
+
+static bool check_budget(const char *label, double value, double budget, const char *unit) {
+    bool within = value <= budget;
+    std::cout << "  " << label << ": " << value << unit << " (budget " << budget << unit << ")" << (within ? "" : " OVER BUDGET") << std::endl;
+    return within;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+	std::cerr << "Usage: " << argv[0] << " <golden directory> [--update] [scene...]" << std::endl;
+	return 1;
+    }
+    std::filesystem::path golden_directory = argv[1];
+    std::filesystem::path output_directory = std::getenv("VKT_TEST_OUTPUT") ? std::getenv("VKT_TEST_OUTPUT") : "build/release/test";
+    bool update = false;
+    std::vector<std::string> selected;
+    for (int i = 2; i < argc; ++i) {
+	if (!strcmp(argv[i], "--update")) update = true;
+	else selected.push_back(argv[i]);
+    }
+    double budget_scale = std::getenv("VKT_BUDGET_SCALE") ? std::stod(std::getenv("VKT_BUDGET_SCALE")) : 1.0;
+    std::filesystem::create_directories(golden_directory);
+
+    std::size_t failures = 0, run = 0;
+    for (const auto& scene : reference_scenes) {
+	if (!selected.empty() && std::find(selected.begin(), selected.end(), scene.name) == selected.end()) continue;
+	++run;
+	bool passed = true;
+	std::string failure;
+	std::cout << "Scene " << scene.name << ":" << std::endl;
+	try {
+	    SceneResult result = render_scene(scene, output_directory);
+	    RGBImage actual = read_ppm(result.capture_path);
+	    std::filesystem::path golden_path = golden_directory / (std::string(scene.name) + ".ppm");
+	    std::filesystem::path baseline_path = golden_directory / (std::string(scene.name) + ".baseline");
+	    std::cout << "  measured: " << result.frame_ms << " ms, " << result.allocations << " heap allocations per frame (max "
+		      << result.max_allocations << "), " << result.device_mib << " MiB device memory" << std::endl;
+	    if (update) {
+		write_ppm(golden_path.string(), actual);
+		write_baseline(baseline_path.string(), result);
+		std::cout << "  wrote " << golden_path.string() << " and " << baseline_path.string() << std::endl;
+	    }
+	    else if (!std::filesystem::exists(golden_path) || !std::filesystem::exists(baseline_path)) {
+		passed = false;
+		failure = "no golden image or baseline for " + std::string(scene.name) + " in " + golden_directory.string() + ", render them with make test-update";
+	    }
+	    else {
+		RGBImage diff;
+		ImageDifference difference = compare_images(actual, read_ppm(golden_path.string()), &diff);
+		bool matches = difference.mean_delta_e <= MAX_MEAN_DELTA_E && difference.perceptible_fraction() <= MAX_PERCEPTIBLE_FRACTION;
+		std::cout << "  image: mean delta E " << difference.mean_delta_e << ", max " << difference.max_delta_e << ", "
+			  << 100.0 * difference.perceptible_fraction() << "% of pixels perceptibly different" << std::endl;
+		if (!matches) {
+		    std::string diff_path = (output_directory / scene.name / "diff.ppm").string();
+		    write_ppm(diff_path, diff);
+		    passed = false;
+		    failure = "image differs from " + golden_path.string() + ", see " + diff_path;
+		}
+		SceneResult baseline = read_baseline(baseline_path.string());
+		passed = check_budget("frame time", result.frame_ms, baseline.frame_ms * FRAME_TIME_MARGIN * budget_scale, " ms") && passed;
+		passed = check_budget("heap allocations per frame", result.allocations, baseline.allocations, "") && passed;
+		passed = check_budget("peak device memory", result.device_mib, baseline.device_mib * DEVICE_MEMORY_MARGIN, " MiB") && passed;
+	    }
+	}
+	catch (const std::exception &error) {
+	    passed = false;
+	    failure = error.what();
+	}
+	if (!failure.empty()) std::cout << "  " << failure << std::endl;
+	std::cout << "  " << (passed ? "PASS" : "FAIL") << std::endl;
+	if (!passed) ++failures;
+    }
+    if (!run) {
+	std::cerr << "No reference scene matches the selection" << std::endl;
+	return 1;
+    }
+    std::cout << run - failures << "/" << run << " scenes passed" << std::endl;
+    return failures ? 1 : 0;
+}
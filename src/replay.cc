@@ -0,0 +1,950 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "deletion.h"
+#include "device.h"
+#include "stream.h"
+
+static constexpr uint32_t DEFAULT_ITERATIONS = 10;
+
+using Command = std::function<void()>;
+
+static void VK_ASSERT(VkResult res) {
+    if ((res) != VK_SUCCESS) {
+	throw std::runtime_error("Vulkan failure " + std::to_string(static_cast<int>(res)));
+    }
+}
+
+static VkImageLayout offscreen(VkImageLayout layout) {
+    return layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR ? VK_IMAGE_LAYOUT_GENERAL : layout;
+}
+
+static bool image_descriptor(VkDescriptorType type) {
+    return type == VK_DESCRIPTOR_TYPE_SAMPLER || type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE
+	|| type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE || type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+}
+
+class Replay {
+public:
+    explicit Replay(const std::string &path);
+    ~Replay();
+
+    void load();
+    void run(uint32_t iterations);
+
+private:
+    struct Memory {
+	VkDeviceSize size;
+	VkMemoryPropertyFlags flags;
+	VkDeviceMemory memory;
+	void *mapped;
+	bool coherent;
+    };
+
+    struct Stage {
+	VkPipelineShaderStageCreateInfo info;
+	std::string name;
+	std::vector<VkSpecializationMapEntry> map_entries;
+	StreamBytes data;
+	VkSpecializationInfo specialization;
+
+	void link() {
+	    info.pName = name.c_str();
+	    if (map_entries.empty()) return;
+	    specialization = {static_cast<uint32_t>(map_entries.size()), map_entries.data(), data.size, data.data};
+	    info.pSpecializationInfo = &specialization;
+	}
+    };
+
+    StreamReader reader;
+    std::string device_name;
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queue = VK_NULL_HANDLE;
+    uint32_t queue_family = NO_QUEUE_FAMILY;
+    VkPhysicalDeviceMemoryProperties memory_properties {};
+    DeletionQueue deletion_queue;
+
+    std::vector<uint64_t> objects;
+    std::unordered_map<uint32_t, Memory> memories;
+    std::vector<VkFence> fences;
+    std::vector<bool> fences_signaled;
+    bool in_frames = false;
+    uint64_t frame_count = 0;
+    std::vector<Command> frame_commands;
+    std::unordered_map<uint32_t, std::vector<Command>> setup_recordings;
+    std::set<uint32_t> rerecorded;
+
+    template <typename T>
+    T handle(uint32_t id) const {
+	if (id == NO_OBJECT) return VK_NULL_HANDLE;
+	return reinterpret_cast<T>(objects.at(id));
+    }
+
+    template <typename T>
+    void store(uint32_t id, T object) {
+	if (id >= objects.size()) objects.resize(id + 1);
+	objects[id] = reinterpret_cast<uint64_t>(object);
+    }
+
+    template <typename T>
+    std::vector<T> handles() {
+	std::vector<T> result;
+	for (uint32_t id : reader.get_array<uint32_t>()) result.push_back(handle<T>(id));
+	return result;
+    }
+
+    void create_device();
+    uint32_t find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags flags) const;
+    VkDeviceMemory bind_memory(uint32_t memory_id, VkDeviceSize offset, const VkMemoryRequirements &requirements);
+    void read_stage(Stage &stage);
+    void create_render_pass(uint32_t id);
+    void create_graphics_pipeline(uint32_t id);
+    void decode(StreamOp op);
+    Command decode_command(StreamOp op);
+    Command decode_recording(StreamOp op, VkCommandBuffer command_buffer);
+    void restore();
+};
+
+Replay::Replay(const std::string &path): reader(path) {
+    const StreamHeader &header = reader.get_header();
+    if (!header.frames) throw std::runtime_error(path + " holds no complete frame");
+    create_device();
+}
+
+Replay::~Replay() {
+    if (device != VK_NULL_HANDLE) {
+	vkDeviceWaitIdle(device);
+	deletion_queue.flush();
+	vkDestroyDevice(device, nullptr);
+    }
+    if (instance != VK_NULL_HANDLE) vkDestroyInstance(instance, nullptr);
+}
+
+void Replay::create_device() {
+    VkApplicationInfo app_info {};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = "vulkan-tutorial-replay";
+    app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    app_info.pEngineName = "Custom";
+    app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    app_info.apiVersion = VK_API_VERSION_1_1;
+    VkInstanceCreateInfo instance_create_info {};
+    instance_create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instance_create_info.pApplicationInfo = &app_info;
+    VK_ASSERT(vkCreateInstance(&instance_create_info, nullptr, &instance));
+
+    uint32_t physical_device_count = 0;
+    vkEnumeratePhysicalDevices(instance, &physical_device_count, nullptr);
+    if (!physical_device_count) throw std::runtime_error("Vulkan failure");
+    std::vector<VkPhysicalDevice> physical_devices(physical_device_count);
+    vkEnumeratePhysicalDevices(instance, &physical_device_count, physical_devices.data());
+    std::vector<DeviceCandidate> candidates;
+    for (uint32_t i = 0; i < physical_device_count; ++i)
+	candidates.push_back(evaluate_device(physical_devices.at(i), i, VK_NULL_HANDLE, {}));
+    print_device_candidates(candidates, std::cout);
+    const DeviceCandidate &chosen = candidates.at(choose_device(candidates, std::getenv("VKT_DEVICE")));
+    physical_device = chosen.device;
+    device_name = chosen.name;
+    queue_family = chosen.queues.graphics;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    float queue_priority = 1.0f;
+    VkDeviceQueueCreateInfo queue_create_info {};
+    queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_create_info.queueFamilyIndex = queue_family;
+    queue_create_info.queueCount = 1;
+    queue_create_info.pQueuePriorities = &queue_priority;
+    const StreamHeader &header = reader.get_header();
+    std::vector<std::string> missing = unsupported_features(header, physical_device);
+    if (!missing.empty()) {
+	std::string names;
+	for (const auto& name : missing) names += (names.empty() ? "" : ", ") + name;
+	throw std::runtime_error("The stream was captured with " + names + " enabled, which " + device_name + " does not support");
+    }
+    VkPhysicalDeviceFeatures device_features = header.features;
+    VkPhysicalDeviceMultiviewFeatures multiview_features {};
+    multiview_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+    multiview_features.multiview = header.multiview;
+    VkDeviceCreateInfo device_create_info {};
+    device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_create_info.pNext = &multiview_features;
+    device_create_info.pQueueCreateInfos = &queue_create_info;
+    device_create_info.queueCreateInfoCount = 1;
+    device_create_info.pEnabledFeatures = &device_features;
+    VK_ASSERT(vkCreateDevice(physical_device, &device_create_info, nullptr, &device));
+    deletion_queue.init(device);
+    vkGetDeviceQueue(device, queue_family, 0, &queue);
+}
+
+uint32_t Replay::find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags flags) const {
+    const VkMemoryPropertyFlags host_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (VkMemoryPropertyFlags wanted : {flags, flags & host_flags, flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT}) {
+	for (uint32_t type = 0; type < memory_properties.memoryTypeCount; ++type) {
+	    if ((type_bits & (1u << type)) && (memory_properties.memoryTypes[type].propertyFlags & wanted) == wanted) return type;
+	}
+    }
+    throw std::runtime_error("No memory type for recorded flags " + std::to_string(flags));
+}
+
+VkDeviceMemory Replay::bind_memory(uint32_t memory_id, VkDeviceSize offset, const VkMemoryRequirements &requirements) {
+    Memory &memory = memories.at(memory_id);
+    if (offset % requirements.alignment) throw std::runtime_error("Recorded bind offset violates this device's alignment");
+    if (memory.memory != VK_NULL_HANDLE) {
+	if (offset + requirements.size > memory.size) throw std::runtime_error("Recorded bind exceeds its allocation on this device");
+	return memory.memory;
+    }
+
+    uint32_t type = find_memory_type(requirements.memoryTypeBits, memory.flags);
+    VkMemoryAllocateInfo allocate_info {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = std::max(memory.size, offset + requirements.size);
+    allocate_info.memoryTypeIndex = type;
+    VK_ASSERT(vkAllocateMemory(device, &allocate_info, nullptr, &memory.memory));
+    deletion_queue.retire(0, VK_OBJECT_TYPE_DEVICE_MEMORY, memory.memory);
+    memory.size = allocate_info.allocationSize;
+    VkMemoryPropertyFlags type_flags = memory_properties.memoryTypes[type].propertyFlags;
+    memory.coherent = type_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (type_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) VK_ASSERT(vkMapMemory(device, memory.memory, 0, VK_WHOLE_SIZE, 0, &memory.mapped));
+    return memory.memory;
+}
+
+void Replay::read_stage(Stage &stage) {
+    stage.info = {};
+    stage.info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stage.info.flags = reader.get<VkPipelineShaderStageCreateFlags>();
+    stage.info.stage = reader.get<VkShaderStageFlagBits>();
+    stage.info.module = handle<VkShaderModule>(reader.get<uint32_t>());
+    stage.name = reader.get_string();
+    stage.map_entries = reader.get_array<VkSpecializationMapEntry>();
+    stage.data = reader.get_bytes();
+}
+
+void Replay::create_render_pass(uint32_t id) {
+    struct Subpass {
+	std::vector<VkAttachmentReference> inputs, colors, resolves, depth;
+	std::vector<uint32_t> preserves;
+    };
+    VkRenderPassCreateInfo create_info {};
+    create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    create_info.flags = reader.get<VkRenderPassCreateFlags>();
+    auto attachments = reader.get_array<VkAttachmentDescription>();
+    for (auto& attachment : attachments) {
+	attachment.initialLayout = offscreen(attachment.initialLayout);
+	attachment.finalLayout = offscreen(attachment.finalLayout);
+    }
+    std::vector<Subpass> subpasses(reader.get<uint32_t>());
+    std::vector<VkSubpassDescription> descriptions(subpasses.size());
+    for (std::size_t i = 0; i < subpasses.size(); ++i) {
+	Subpass &subpass = subpasses[i];
+	VkSubpassDescription &description = descriptions[i];
+	description.flags = reader.get<VkSubpassDescriptionFlags>();
+	description.pipelineBindPoint = reader.get<VkPipelineBindPoint>();
+	subpass.inputs = reader.get_array<VkAttachmentReference>();
+	subpass.colors = reader.get_array<VkAttachmentReference>();
+	subpass.resolves = reader.get_array<VkAttachmentReference>();
+	subpass.depth = reader.get_array<VkAttachmentReference>();
+	subpass.preserves = reader.get_array<uint32_t>();
+	description.inputAttachmentCount = static_cast<uint32_t>(subpass.inputs.size());
+	description.pInputAttachments = subpass.inputs.data();
+	description.colorAttachmentCount = static_cast<uint32_t>(subpass.colors.size());
+	description.pColorAttachments = subpass.colors.data();
+	description.pResolveAttachments = subpass.resolves.empty() ? nullptr : subpass.resolves.data();
+	description.pDepthStencilAttachment = subpass.depth.empty() ? nullptr : subpass.depth.data();
+	description.preserveAttachmentCount = static_cast<uint32_t>(subpass.preserves.size());
+	description.pPreserveAttachments = subpass.preserves.data();
+    }
+    auto dependencies = reader.get_array<VkSubpassDependency>();
+    auto view_masks = reader.get_array<uint32_t>();
+    auto view_offsets = reader.get_array<int32_t>();
+    auto correlation_masks = reader.get_array<uint32_t>();
+
+    VkRenderPassMultiviewCreateInfo multiview {};
+    multiview.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+    multiview.subpassCount = static_cast<uint32_t>(view_masks.size());
+    multiview.pViewMasks = view_masks.data();
+    multiview.dependencyCount = static_cast<uint32_t>(view_offsets.size());
+    multiview.pViewOffsets = view_offsets.data();
+    multiview.correlationMaskCount = static_cast<uint32_t>(correlation_masks.size());
+    multiview.pCorrelationMasks = correlation_masks.data();
+    if (!view_masks.empty()) create_info.pNext = &multiview;
+    create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+    create_info.pAttachments = attachments.data();
+    create_info.subpassCount = static_cast<uint32_t>(descriptions.size());
+    create_info.pSubpasses = descriptions.data();
+    create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    create_info.pDependencies = dependencies.data();
+
+    VkRenderPass render_pass;
+    VK_ASSERT(vkCreateRenderPass(device, &create_info, nullptr, &render_pass));
+    store(id, render_pass);
+    deletion_queue.retire(0, VK_OBJECT_TYPE_RENDER_PASS, render_pass);
+}
+
+void Replay::create_graphics_pipeline(uint32_t id) {
+    VkGraphicsPipelineCreateInfo create_info {};
+    create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    create_info.flags = reader.get<VkPipelineCreateFlags>();
+    create_info.layout = handle<VkPipelineLayout>(reader.get<uint32_t>());
+    create_info.renderPass = handle<VkRenderPass>(reader.get<uint32_t>());
+    create_info.subpass = reader.get<uint32_t>();
+    std::vector<Stage> stages(reader.get<uint32_t>());
+    for (auto& stage : stages) read_stage(stage);
+    std::vector<VkPipelineShaderStageCreateInfo> stage_infos;
+    for (auto& stage : stages) {
+	stage.link();
+	stage_infos.push_back(stage.info);
+    }
+    create_info.stageCount = static_cast<uint32_t>(stage_infos.size());
+    create_info.pStages = stage_infos.data();
+
+    auto vertex_bindings = reader.get_array<VkVertexInputBindingDescription>();
+    auto vertex_attributes = reader.get_array<VkVertexInputAttributeDescription>();
+    VkPipelineVertexInputStateCreateInfo vertex_input {};
+    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_bindings.size());
+    vertex_input.pVertexBindingDescriptions = vertex_bindings.data();
+    vertex_input.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_attributes.size());
+    vertex_input.pVertexAttributeDescriptions = vertex_attributes.data();
+    create_info.pVertexInputState = &vertex_input;
+    auto input_assembly = reader.get<VkPipelineInputAssemblyStateCreateInfo>();
+    create_info.pInputAssemblyState = &input_assembly;
+
+    VkPipelineViewportStateCreateInfo viewport {};
+    viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport.viewportCount = reader.get<uint32_t>();
+    viewport.scissorCount = reader.get<uint32_t>();
+    auto viewports = reader.get_array<VkViewport>();
+    auto scissors = reader.get_array<VkRect2D>();
+    viewport.pViewports = viewports.empty() ? nullptr : viewports.data();
+    viewport.pScissors = scissors.empty() ? nullptr : scissors.data();
+    if (viewport.viewportCount) create_info.pViewportState = &viewport;
+    auto rasterization = reader.get<VkPipelineRasterizationStateCreateInfo>();
+    create_info.pRasterizationState = &rasterization;
+
+    auto multisample = reader.get<VkPipelineMultisampleStateCreateInfo>();
+    auto sample_mask = reader.get_array<VkSampleMask>();
+    multisample.pSampleMask = sample_mask.empty() ? nullptr : sample_mask.data();
+    if (multisample.sType) create_info.pMultisampleState = &multisample;
+    VkPipelineDepthStencilStateCreateInfo depth_stencil {};
+    if (reader.get<uint8_t>()) {
+	depth_stencil = reader.get<VkPipelineDepthStencilStateCreateInfo>();
+	create_info.pDepthStencilState = &depth_stencil;
+    }
+    auto color_blend = reader.get<VkPipelineColorBlendStateCreateInfo>();
+    auto blend_attachments = reader.get_array<VkPipelineColorBlendAttachmentState>();
+    color_blend.pAttachments = blend_attachments.data();
+    if (color_blend.sType) create_info.pColorBlendState = &color_blend;
+    auto dynamic_states = reader.get_array<VkDynamicState>();
+    VkPipelineDynamicStateCreateInfo dynamic {};
+    dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+    dynamic.pDynamicStates = dynamic_states.data();
+    if (!dynamic_states.empty()) create_info.pDynamicState = &dynamic;
+
+    VkPipeline pipeline;
+    VK_ASSERT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &create_info, nullptr, &pipeline));
+    store(id, pipeline);
+    deletion_queue.retire(0, VK_OBJECT_TYPE_PIPELINE, pipeline);
+}
+
+void Replay::load() {
+    while (!reader.done()) {
+	StreamOp op = reader.next();
+	if (op == StreamOp::END) break;
+	if (op == StreamOp::FRAME) {
+	    if (!in_frames) {
+		VK_ASSERT(vkDeviceWaitIdle(device));
+		in_frames = true;
+	    }
+	    ++frame_count;
+	}
+	else if (op >= StreamOp::BEGIN_COMMAND_BUFFER) {
+	    auto id = reader.get<uint32_t>();
+	    Command command = decode_recording(op, handle<VkCommandBuffer>(id));
+	    if (in_frames) {
+		if (op == StreamOp::BEGIN_COMMAND_BUFFER || op == StreamOp::RESET_COMMAND_BUFFER) rerecorded.insert(id);
+		frame_commands.push_back(std::move(command));
+	    }
+	    else {
+		auto& recording = setup_recordings[id];
+		if (op == StreamOp::BEGIN_COMMAND_BUFFER || op == StreamOp::RESET_COMMAND_BUFFER) recording.clear();
+		command();
+		recording.push_back(std::move(command));
+	    }
+	}
+	else if (Command command = decode_command(op)) {
+	    if (in_frames) frame_commands.push_back(std::move(command));
+	    else command();
+	}
+	else decode(op);
+	reader.expect_end();
+    }
+    if (frame_count != reader.get_header().frames) throw std::runtime_error("Stream ends before its last frame");
+
+    VK_ASSERT(vkDeviceWaitIdle(device));
+    fences_signaled.clear();
+    for (VkFence fence : fences) fences_signaled.push_back(vkGetFenceStatus(device, fence) == VK_SUCCESS);
+}
+
+void Replay::decode(StreamOp op) {
+    auto id = reader.get<uint32_t>();
+    switch (op) {
+    case StreamOp::ALLOCATE_MEMORY: {
+	auto size = reader.get<VkDeviceSize>();
+	auto flags = reader.get<VkMemoryPropertyFlags>();
+	memories[id] = {size, flags, VK_NULL_HANDLE, nullptr, true};
+	break;
+    }
+    case StreamOp::CREATE_BUFFER: {
+	auto create_info = reader.get<VkBufferCreateInfo>();
+	VkBuffer buffer;
+	VK_ASSERT(vkCreateBuffer(device, &create_info, nullptr, &buffer));
+	store(id, buffer);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_BUFFER, buffer);
+	break;
+    }
+    case StreamOp::BIND_BUFFER_MEMORY: {
+	auto buffer = handle<VkBuffer>(id);
+	auto memory_id = reader.get<uint32_t>();
+	auto offset = reader.get<VkDeviceSize>();
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+	VK_ASSERT(vkBindBufferMemory(device, buffer, bind_memory(memory_id, offset, requirements), offset));
+	break;
+    }
+    case StreamOp::CREATE_IMAGE: {
+	auto create_info = reader.get<VkImageCreateInfo>();
+	VkImage image;
+	VK_ASSERT(vkCreateImage(device, &create_info, nullptr, &image));
+	store(id, image);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_IMAGE, image);
+	break;
+    }
+    case StreamOp::BIND_IMAGE_MEMORY: {
+	auto image = handle<VkImage>(id);
+	auto memory_id = reader.get<uint32_t>();
+	auto offset = reader.get<VkDeviceSize>();
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(device, image, &requirements);
+	VK_ASSERT(vkBindImageMemory(device, image, bind_memory(memory_id, offset, requirements), offset));
+	break;
+    }
+    case StreamOp::CREATE_IMAGE_VIEW: {
+	auto image = handle<VkImage>(reader.get<uint32_t>());
+	auto create_info = reader.get<VkImageViewCreateInfo>();
+	create_info.image = image;
+	VkImageView view;
+	VK_ASSERT(vkCreateImageView(device, &create_info, nullptr, &view));
+	store(id, view);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_IMAGE_VIEW, view);
+	break;
+    }
+    case StreamOp::CREATE_SAMPLER: {
+	auto create_info = reader.get<VkSamplerCreateInfo>();
+	VkSampler sampler;
+	VK_ASSERT(vkCreateSampler(device, &create_info, nullptr, &sampler));
+	store(id, sampler);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_SAMPLER, sampler);
+	break;
+    }
+    case StreamOp::CREATE_SHADER_MODULE: {
+	StreamBytes bytes = reader.get_bytes();
+	std::vector<uint32_t> code((bytes.size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+	memcpy(code.data(), bytes.data, bytes.size);
+	VkShaderModuleCreateInfo create_info {};
+	create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	create_info.codeSize = bytes.size;
+	create_info.pCode = code.data();
+	VkShaderModule shader_module;
+	VK_ASSERT(vkCreateShaderModule(device, &create_info, nullptr, &shader_module));
+	store(id, shader_module);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_SHADER_MODULE, shader_module);
+	break;
+    }
+    case StreamOp::CREATE_FRAMEBUFFER: {
+	VkFramebufferCreateInfo create_info {};
+	create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	create_info.flags = reader.get<VkFramebufferCreateFlags>();
+	create_info.renderPass = handle<VkRenderPass>(reader.get<uint32_t>());
+	auto attachments = handles<VkImageView>();
+	create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+	create_info.pAttachments = attachments.data();
+	create_info.width = reader.get<uint32_t>();
+	create_info.height = reader.get<uint32_t>();
+	create_info.layers = reader.get<uint32_t>();
+	VkFramebuffer framebuffer;
+	VK_ASSERT(vkCreateFramebuffer(device, &create_info, nullptr, &framebuffer));
+	store(id, framebuffer);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_FRAMEBUFFER, framebuffer);
+	break;
+    }
+    case StreamOp::CREATE_DESCRIPTOR_SET_LAYOUT: {
+	VkDescriptorSetLayoutCreateInfo create_info {};
+	create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	create_info.flags = reader.get<VkDescriptorSetLayoutCreateFlags>();
+	auto bindings = reader.get_array<VkDescriptorSetLayoutBinding>();
+	create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+	create_info.pBindings = bindings.data();
+	VkDescriptorSetLayout layout;
+	VK_ASSERT(vkCreateDescriptorSetLayout(device, &create_info, nullptr, &layout));
+	store(id, layout);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, layout);
+	break;
+    }
+    case StreamOp::CREATE_PIPELINE_LAYOUT: {
+	VkPipelineLayoutCreateInfo create_info {};
+	create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	create_info.flags = reader.get<VkPipelineLayoutCreateFlags>();
+	auto set_layouts = handles<VkDescriptorSetLayout>();
+	auto push_constant_ranges = reader.get_array<VkPushConstantRange>();
+	create_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+	create_info.pSetLayouts = set_layouts.data();
+	create_info.pushConstantRangeCount = static_cast<uint32_t>(push_constant_ranges.size());
+	create_info.pPushConstantRanges = push_constant_ranges.data();
+	VkPipelineLayout layout;
+	VK_ASSERT(vkCreatePipelineLayout(device, &create_info, nullptr, &layout));
+	store(id, layout);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_PIPELINE_LAYOUT, layout);
+	break;
+    }
+    case StreamOp::CREATE_COMPUTE_PIPELINE: {
+	VkComputePipelineCreateInfo create_info {};
+	create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	create_info.flags = reader.get<VkPipelineCreateFlags>();
+	create_info.layout = handle<VkPipelineLayout>(reader.get<uint32_t>());
+	Stage stage;
+	read_stage(stage);
+	stage.link();
+	create_info.stage = stage.info;
+	VkPipeline pipeline;
+	VK_ASSERT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &create_info, nullptr, &pipeline));
+	store(id, pipeline);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_PIPELINE, pipeline);
+	break;
+    }
+    case StreamOp::CREATE_DESCRIPTOR_POOL: {
+	VkDescriptorPoolCreateInfo create_info {};
+	create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	create_info.flags = reader.get<VkDescriptorPoolCreateFlags>();
+	create_info.maxSets = reader.get<uint32_t>();
+	auto pool_sizes = reader.get_array<VkDescriptorPoolSize>();
+	create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	create_info.pPoolSizes = pool_sizes.data();
+	VkDescriptorPool pool;
+	VK_ASSERT(vkCreateDescriptorPool(device, &create_info, nullptr, &pool));
+	store(id, pool);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_DESCRIPTOR_POOL, pool);
+	break;
+    }
+    case StreamOp::ALLOCATE_DESCRIPTOR_SETS: {
+	auto set_layouts = handles<VkDescriptorSetLayout>();
+	auto set_ids = reader.get_array<uint32_t>();
+	VkDescriptorSetAllocateInfo allocate_info {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = handle<VkDescriptorPool>(id);
+	allocate_info.descriptorSetCount = static_cast<uint32_t>(set_layouts.size());
+	allocate_info.pSetLayouts = set_layouts.data();
+	std::vector<VkDescriptorSet> sets(set_layouts.size());
+	VK_ASSERT(vkAllocateDescriptorSets(device, &allocate_info, sets.data()));
+	for (std::size_t i = 0; i < sets.size(); ++i) store(set_ids.at(i), sets[i]);
+	break;
+    }
+    case StreamOp::CREATE_QUERY_POOL: {
+	auto create_info = reader.get<VkQueryPoolCreateInfo>();
+	VkQueryPool pool;
+	VK_ASSERT(vkCreateQueryPool(device, &create_info, nullptr, &pool));
+	store(id, pool);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_QUERY_POOL, pool);
+	break;
+    }
+    case StreamOp::CREATE_COMMAND_POOL: {
+	VkCommandPoolCreateInfo create_info {};
+	create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	create_info.flags = reader.get<VkCommandPoolCreateFlags>();
+	create_info.queueFamilyIndex = queue_family;
+	VkCommandPool pool;
+	VK_ASSERT(vkCreateCommandPool(device, &create_info, nullptr, &pool));
+	store(id, pool);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_COMMAND_POOL, pool);
+	break;
+    }
+    case StreamOp::ALLOCATE_COMMAND_BUFFERS: {
+	VkCommandBufferAllocateInfo allocate_info {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.commandPool = handle<VkCommandPool>(id);
+	allocate_info.level = reader.get<VkCommandBufferLevel>();
+	auto command_buffer_ids = reader.get_array<uint32_t>();
+	allocate_info.commandBufferCount = static_cast<uint32_t>(command_buffer_ids.size());
+	std::vector<VkCommandBuffer> command_buffers(command_buffer_ids.size());
+	VK_ASSERT(vkAllocateCommandBuffers(device, &allocate_info, command_buffers.data()));
+	for (std::size_t i = 0; i < command_buffers.size(); ++i) store(command_buffer_ids[i], command_buffers[i]);
+	break;
+    }
+    case StreamOp::FREE_COMMAND_BUFFERS: {
+	// Command buffers freed inside the frames are replayed every iteration, so they live until their pool is destroyed.
+	auto command_buffers = handles<VkCommandBuffer>();
+	if (!in_frames) vkFreeCommandBuffers(device, handle<VkCommandPool>(id), static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
+	break;
+    }
+    case StreamOp::CREATE_FENCE: {
+	VkFenceCreateInfo create_info {};
+	create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	create_info.flags = reader.get<VkFenceCreateFlags>();
+	VkFence fence;
+	VK_ASSERT(vkCreateFence(device, &create_info, nullptr, &fence));
+	store(id, fence);
+	fences.push_back(fence);
+	deletion_queue.retire(0, VK_OBJECT_TYPE_FENCE, fence);
+	break;
+    }
+    case StreamOp::CREATE_RENDER_PASS: create_render_pass(id); break;
+    case StreamOp::CREATE_GRAPHICS_PIPELINE: create_graphics_pipeline(id); break;
+    default: throw std::runtime_error("Unknown stream op " + std::to_string(static_cast<int>(op)));
+    }
+}
+
+Command Replay::decode_command(StreamOp op) {
+    switch (op) {
+    case StreamOp::WRITE_MEMORY: {
+	Memory *memory = &memories.at(reader.get<uint32_t>());
+	auto offset = reader.get<VkDeviceSize>();
+	StreamBytes bytes = reader.get_bytes();
+	if (!memory->mapped) throw std::runtime_error("Stream writes to memory that is not host visible on this device");
+	if (offset + bytes.size > memory->size) throw std::runtime_error("Stream writes past the end of an allocation");
+	return [this, memory, offset, bytes]() {
+	    memcpy(static_cast<uint8_t*>(memory->mapped) + offset, bytes.data, bytes.size);
+	    if (memory->coherent) return;
+	    VkMappedMemoryRange range {};
+	    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	    range.memory = memory->memory;
+	    range.size = VK_WHOLE_SIZE;
+	    VK_ASSERT(vkFlushMappedMemoryRanges(device, 1, &range));
+	};
+    }
+    case StreamOp::UPDATE_DESCRIPTOR_SETS: {
+	std::vector<VkWriteDescriptorSet> writes(reader.get<uint32_t>());
+	std::vector<std::size_t> starts;
+	std::vector<VkDescriptorImageInfo> image_infos;
+	std::vector<VkDescriptorBufferInfo> buffer_infos;
+	for (auto& write : writes) {
+	    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	    write.dstSet = handle<VkDescriptorSet>(reader.get<uint32_t>());
+	    write.dstBinding = reader.get<uint32_t>();
+	    write.dstArrayElement = reader.get<uint32_t>();
+	    write.descriptorType = reader.get<VkDescriptorType>();
+	    write.descriptorCount = reader.get<uint32_t>();
+	    bool images = image_descriptor(write.descriptorType);
+	    starts.push_back(images ? image_infos.size() : buffer_infos.size());
+	    for (uint32_t element = 0; element < write.descriptorCount; ++element) {
+		if (images) {
+		    auto sampler = handle<VkSampler>(reader.get<uint32_t>());
+		    auto view = handle<VkImageView>(reader.get<uint32_t>());
+		    image_infos.push_back({sampler, view, offscreen(reader.get<VkImageLayout>())});
+		}
+		else {
+		    auto buffer = handle<VkBuffer>(reader.get<uint32_t>());
+		    auto offset = reader.get<VkDeviceSize>();
+		    buffer_infos.push_back({buffer, offset, reader.get<VkDeviceSize>()});
+		}
+	    }
+	}
+	return [this, writes, starts, image_infos, buffer_infos]() mutable {
+	    for (std::size_t i = 0; i < writes.size(); ++i) {
+		if (image_descriptor(writes[i].descriptorType)) writes[i].pImageInfo = image_infos.data() + starts[i];
+		else writes[i].pBufferInfo = buffer_infos.data() + starts[i];
+	    }
+	    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	};
+    }
+    case StreamOp::WAIT_FOR_FENCES: {
+	auto wait_fences = handles<VkFence>();
+	auto wait_all = reader.get<VkBool32>();
+	return [this, wait_fences, wait_all]() {
+	    VK_ASSERT(vkWaitForFences(device, static_cast<uint32_t>(wait_fences.size()), wait_fences.data(), wait_all, UINT64_MAX));
+	};
+    }
+    case StreamOp::RESET_FENCES: {
+	auto reset = handles<VkFence>();
+	return [this, reset]() {
+	    VK_ASSERT(vkResetFences(device, static_cast<uint32_t>(reset.size()), reset.data()));
+	};
+    }
+    case StreamOp::QUEUE_SUBMIT: {
+	auto fence = handle<VkFence>(reader.get<uint32_t>());
+	std::vector<std::vector<VkCommandBuffer>> batches(reader.get<uint32_t>());
+	for (auto& batch : batches) batch = handles<VkCommandBuffer>();
+	return [this, fence, batches]() {
+	    std::vector<VkSubmitInfo> submits(batches.size());
+	    for (std::size_t i = 0; i < batches.size(); ++i) {
+		submits[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submits[i].commandBufferCount = static_cast<uint32_t>(batches[i].size());
+		submits[i].pCommandBuffers = batches[i].data();
+	    }
+	    VK_ASSERT(vkQueueSubmit(queue, static_cast<uint32_t>(submits.size()), submits.data(), fence));
+	};
+    }
+    case StreamOp::QUEUE_WAIT_IDLE:
+	return [this]() { VK_ASSERT(vkQueueWaitIdle(queue)); };
+    default: return {};
+    }
+}
+
+Command Replay::decode_recording(StreamOp op, VkCommandBuffer command_buffer) {
+    switch (op) {
+    case StreamOp::BEGIN_COMMAND_BUFFER: {
+	auto flags = reader.get<VkCommandBufferUsageFlags>();
+	return [command_buffer, flags]() {
+	    VkCommandBufferBeginInfo begin_info {};
+	    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	    begin_info.flags = flags;
+	    VK_ASSERT(vkBeginCommandBuffer(command_buffer, &begin_info));
+	};
+    }
+    case StreamOp::END_COMMAND_BUFFER:
+	return [command_buffer]() { VK_ASSERT(vkEndCommandBuffer(command_buffer)); };
+    case StreamOp::RESET_COMMAND_BUFFER: {
+	auto flags = reader.get<VkCommandBufferResetFlags>();
+	return [command_buffer, flags]() { VK_ASSERT(vkResetCommandBuffer(command_buffer, flags)); };
+    }
+    case StreamOp::CMD_BEGIN_RENDER_PASS: {
+	VkRenderPassBeginInfo begin_info {};
+	begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	begin_info.renderPass = handle<VkRenderPass>(reader.get<uint32_t>());
+	begin_info.framebuffer = handle<VkFramebuffer>(reader.get<uint32_t>());
+	begin_info.renderArea = reader.get<VkRect2D>();
+	auto clear_values = reader.get_array<VkClearValue>();
+	auto contents = reader.get<VkSubpassContents>();
+	return [command_buffer, begin_info, clear_values, contents]() mutable {
+	    begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+	    begin_info.pClearValues = clear_values.data();
+	    vkCmdBeginRenderPass(command_buffer, &begin_info, contents);
+	};
+    }
+    case StreamOp::CMD_END_RENDER_PASS:
+	return [command_buffer]() { vkCmdEndRenderPass(command_buffer); };
+    case StreamOp::CMD_BIND_PIPELINE: {
+	auto bind_point = reader.get<VkPipelineBindPoint>();
+	auto pipeline = handle<VkPipeline>(reader.get<uint32_t>());
+	return [command_buffer, bind_point, pipeline]() { vkCmdBindPipeline(command_buffer, bind_point, pipeline); };
+    }
+    case StreamOp::CMD_BIND_DESCRIPTOR_SETS: {
+	auto bind_point = reader.get<VkPipelineBindPoint>();
+	auto layout = handle<VkPipelineLayout>(reader.get<uint32_t>());
+	auto first_set = reader.get<uint32_t>();
+	auto sets = handles<VkDescriptorSet>();
+	auto dynamic_offsets = reader.get_array<uint32_t>();
+	return [command_buffer, bind_point, layout, first_set, sets, dynamic_offsets]() {
+	    vkCmdBindDescriptorSets(command_buffer, bind_point, layout, first_set, static_cast<uint32_t>(sets.size()), sets.data(),
+				    static_cast<uint32_t>(dynamic_offsets.size()), dynamic_offsets.data());
+	};
+    }
+    case StreamOp::CMD_BIND_VERTEX_BUFFERS: {
+	auto first_binding = reader.get<uint32_t>();
+	auto buffers = handles<VkBuffer>();
+	auto offsets = reader.get_array<VkDeviceSize>();
+	return [command_buffer, first_binding, buffers, offsets]() {
+	    vkCmdBindVertexBuffers(command_buffer, first_binding, static_cast<uint32_t>(buffers.size()), buffers.data(), offsets.data());
+	};
+    }
+    case StreamOp::CMD_BIND_INDEX_BUFFER: {
+	auto buffer = handle<VkBuffer>(reader.get<uint32_t>());
+	auto offset = reader.get<VkDeviceSize>();
+	auto index_type = reader.get<VkIndexType>();
+	return [command_buffer, buffer, offset, index_type]() { vkCmdBindIndexBuffer(command_buffer, buffer, offset, index_type); };
+    }
+    case StreamOp::CMD_PUSH_CONSTANTS: {
+	auto layout = handle<VkPipelineLayout>(reader.get<uint32_t>());
+	auto stages = reader.get<VkShaderStageFlags>();
+	auto offset = reader.get<uint32_t>();
+	StreamBytes values = reader.get_bytes();
+	return [command_buffer, layout, stages, offset, values]() {
+	    vkCmdPushConstants(command_buffer, layout, stages, offset, static_cast<uint32_t>(values.size), values.data);
+	};
+    }
+    case StreamOp::CMD_SET_VIEWPORT: {
+	auto first = reader.get<uint32_t>();
+	auto viewports = reader.get_array<VkViewport>();
+	return [command_buffer, first, viewports]() { vkCmdSetViewport(command_buffer, first, static_cast<uint32_t>(viewports.size()), viewports.data()); };
+    }
+    case StreamOp::CMD_SET_SCISSOR: {
+	auto first = reader.get<uint32_t>();
+	auto scissors = reader.get_array<VkRect2D>();
+	return [command_buffer, first, scissors]() { vkCmdSetScissor(command_buffer, first, static_cast<uint32_t>(scissors.size()), scissors.data()); };
+    }
+    case StreamOp::CMD_DRAW_INDEXED: {
+	auto index_count = reader.get<uint32_t>();
+	auto instance_count = reader.get<uint32_t>();
+	auto first_index = reader.get<uint32_t>();
+	auto vertex_offset = reader.get<int32_t>();
+	auto first_instance = reader.get<uint32_t>();
+	return [command_buffer, index_count, instance_count, first_index, vertex_offset, first_instance]() {
+	    vkCmdDrawIndexed(command_buffer, index_count, instance_count, first_index, vertex_offset, first_instance);
+	};
+    }
+    case StreamOp::CMD_DRAW_INDEXED_INDIRECT: {
+	auto buffer = handle<VkBuffer>(reader.get<uint32_t>());
+	auto offset = reader.get<VkDeviceSize>();
+	auto draw_count = reader.get<uint32_t>();
+	auto stride = reader.get<uint32_t>();
+	return [command_buffer, buffer, offset, draw_count, stride]() { vkCmdDrawIndexedIndirect(command_buffer, buffer, offset, draw_count, stride); };
+    }
+    case StreamOp::CMD_DISPATCH: {
+	auto x = reader.get<uint32_t>();
+	auto y = reader.get<uint32_t>();
+	auto z = reader.get<uint32_t>();
+	return [command_buffer, x, y, z]() { vkCmdDispatch(command_buffer, x, y, z); };
+    }
+    case StreamOp::CMD_DISPATCH_INDIRECT: {
+	auto buffer = handle<VkBuffer>(reader.get<uint32_t>());
+	auto offset = reader.get<VkDeviceSize>();
+	return [command_buffer, buffer, offset]() { vkCmdDispatchIndirect(command_buffer, buffer, offset); };
+    }
+    case StreamOp::CMD_PIPELINE_BARRIER: {
+	auto src_stages = reader.get<VkPipelineStageFlags>();
+	auto dst_stages = reader.get<VkPipelineStageFlags>();
+	auto dependencies = reader.get<VkDependencyFlags>();
+	std::vector<VkMemoryBarrier> memory_barriers(reader.get<uint32_t>());
+	for (auto& barrier : memory_barriers) barrier = reader.get<VkMemoryBarrier>();
+	std::vector<VkBufferMemoryBarrier> buffer_barriers(reader.get<uint32_t>());
+	for (auto& barrier : buffer_barriers) {
+	    auto buffer = handle<VkBuffer>(reader.get<uint32_t>());
+	    barrier = reader.get<VkBufferMemoryBarrier>();
+	    barrier.buffer = buffer;
+	    barrier.srcQueueFamilyIndex = barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	}
+	std::vector<VkImageMemoryBarrier> image_barriers(reader.get<uint32_t>());
+	for (auto& barrier : image_barriers) {
+	    auto image = handle<VkImage>(reader.get<uint32_t>());
+	    barrier = reader.get<VkImageMemoryBarrier>();
+	    barrier.image = image;
+	    barrier.srcQueueFamilyIndex = barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	    barrier.oldLayout = offscreen(barrier.oldLayout);
+	    barrier.newLayout = offscreen(barrier.newLayout);
+	}
+	return [command_buffer, src_stages, dst_stages, dependencies, memory_barriers, buffer_barriers, image_barriers]() {
+	    vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, dependencies, static_cast<uint32_t>(memory_barriers.size()), memory_barriers.data(),
+				 static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(), static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+	};
+    }
+    case StreamOp::CMD_RESET_QUERY_POOL: {
+	auto pool = handle<VkQueryPool>(reader.get<uint32_t>());
+	auto first = reader.get<uint32_t>();
+	auto count = reader.get<uint32_t>();
+	return [command_buffer, pool, first, count]() { vkCmdResetQueryPool(command_buffer, pool, first, count); };
+    }
+    case StreamOp::CMD_WRITE_TIMESTAMP: {
+	auto stage = reader.get<VkPipelineStageFlagBits>();
+	auto pool = handle<VkQueryPool>(reader.get<uint32_t>());
+	auto query = reader.get<uint32_t>();
+	return [command_buffer, stage, pool, query]() { vkCmdWriteTimestamp(command_buffer, stage, pool, query); };
+    }
+    case StreamOp::CMD_COPY_BUFFER: {
+	auto src = handle<VkBuffer>(reader.get<uint32_t>());
+	auto dst = handle<VkBuffer>(reader.get<uint32_t>());
+	auto regions = reader.get_array<VkBufferCopy>();
+	return [command_buffer, src, dst, regions]() { vkCmdCopyBuffer(command_buffer, src, dst, static_cast<uint32_t>(regions.size()), regions.data()); };
+    }
+    case StreamOp::CMD_COPY_IMAGE: {
+	auto src = handle<VkImage>(reader.get<uint32_t>());
+	auto src_layout = offscreen(reader.get<VkImageLayout>());
+	auto dst = handle<VkImage>(reader.get<uint32_t>());
+	auto dst_layout = offscreen(reader.get<VkImageLayout>());
+	auto regions = reader.get_array<VkImageCopy>();
+	return [command_buffer, src, src_layout, dst, dst_layout, regions]() {
+	    vkCmdCopyImage(command_buffer, src, src_layout, dst, dst_layout, static_cast<uint32_t>(regions.size()), regions.data());
+	};
+    }
+    case StreamOp::CMD_COPY_IMAGE_TO_BUFFER: {
+	auto src = handle<VkImage>(reader.get<uint32_t>());
+	auto src_layout = offscreen(reader.get<VkImageLayout>());
+	auto dst = handle<VkBuffer>(reader.get<uint32_t>());
+	auto regions = reader.get_array<VkBufferImageCopy>();
+	return [command_buffer, src, src_layout, dst, regions]() {
+	    vkCmdCopyImageToBuffer(command_buffer, src, src_layout, dst, static_cast<uint32_t>(regions.size()), regions.data());
+	};
+    }
+    case StreamOp::CMD_BLIT_IMAGE: {
+	auto src = handle<VkImage>(reader.get<uint32_t>());
+	auto src_layout = offscreen(reader.get<VkImageLayout>());
+	auto dst = handle<VkImage>(reader.get<uint32_t>());
+	auto dst_layout = offscreen(reader.get<VkImageLayout>());
+	auto regions = reader.get_array<VkImageBlit>();
+	auto filter = reader.get<VkFilter>();
+	return [command_buffer, src, src_layout, dst, dst_layout, regions, filter]() {
+	    vkCmdBlitImage(command_buffer, src, src_layout, dst, dst_layout, static_cast<uint32_t>(regions.size()), regions.data(), filter);
+	};
+    }
+    case StreamOp::CMD_CLEAR_COLOR_IMAGE: {
+	auto image = handle<VkImage>(reader.get<uint32_t>());
+	auto layout = offscreen(reader.get<VkImageLayout>());
+	auto color = reader.get<VkClearColorValue>();
+	auto ranges = reader.get_array<VkImageSubresourceRange>();
+	return [command_buffer, image, layout, color, ranges]() {
+	    vkCmdClearColorImage(command_buffer, image, layout, &color, static_cast<uint32_t>(ranges.size()), ranges.data());
+	};
+    }
+    default: throw std::runtime_error("Unknown stream op " + std::to_string(static_cast<int>(op)));
+    }
+}
+
+void Replay::restore() {
+    for (uint32_t id : rerecorded) {
+	auto found = setup_recordings.find(id);
+	if (found == setup_recordings.end()) continue;
+	for (auto& command : found->second) command();
+    }
+    for (std::size_t i = 0; i < fences.size(); ++i) {
+	bool signaled = vkGetFenceStatus(device, fences[i]) == VK_SUCCESS;
+	if (signaled && !fences_signaled[i]) VK_ASSERT(vkResetFences(device, 1, &fences[i]));
+	else if (!signaled && fences_signaled[i]) VK_ASSERT(vkQueueSubmit(queue, 0, nullptr, fences[i]));
+    }
+    VK_ASSERT(vkQueueWaitIdle(queue));
+}
+
+void Replay::run(uint32_t iterations) {
+    const StreamHeader &header = reader.get_header();
+    std::cout << "Replaying " << frame_count << " frames (" << frame_commands.size() << " calls) captured on " << header.device_name << " on " << device_name << std::endl;
+    if (header.device_name != device_name) std::cout << "Replay device differs from the capture device, timings are not comparable" << std::endl;
+
+    std::vector<double> iteration_ms;
+    for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+	if (iteration) restore();
+	auto before = std::chrono::steady_clock::now();
+	for (auto& command : frame_commands) command();
+	VK_ASSERT(vkDeviceWaitIdle(device));
+	iteration_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - before).count());
+    }
+
+    double total_ms = 0.0;
+    for (double ms : iteration_ms) total_ms += ms;
+    double mean_ms = total_ms / static_cast<double>(iteration_ms.size());
+    double frame_ms = mean_ms / static_cast<double>(frame_count);
+    std::cout << "replay " << iterations << " iterations: mean " << mean_ms << " ms, min " << *std::min_element(iteration_ms.begin(), iteration_ms.end())
+	      << " ms, max " << *std::max_element(iteration_ms.begin(), iteration_ms.end()) << " ms per iteration, " << frame_ms << " ms per frame (" << 1000.0 / frame_ms << " fps)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+	std::cerr << "Usage: " << argv[0] << " <stream> [iterations]" << std::endl;
+	return 1;
+    }
+    uint32_t iterations = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : DEFAULT_ITERATIONS;
+    if (!iterations) {
+	std::cerr << "A replay needs at least one iteration" << std::endl;
+	return 1;
+    }
+
+    Replay replay(argv[1]);
+    replay.load();
+    replay.run(iterations);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include <algorithm>
+#include <cmath>
+
+#include "resolution.h"
+
+static constexpr double AVERAGE_WEIGHT = 0.2;
+
+static float quantize(float scale) {
+    return std::round(scale / ResolutionController::SCALE_STEP) * ResolutionController::SCALE_STEP;
+}
+
+ResolutionController::ResolutionController(float new_target_ms, float new_min_scale, float new_max_scale, float new_headroom):
+    target_ms(new_target_ms), min_scale(quantize(std::max(new_min_scale, SCALE_STEP))), max_scale(std::max(quantize(new_max_scale), min_scale)), headroom(new_headroom), current_scale(max_scale) {}
+
+bool ResolutionController::update(double gpu_ms) {
+    ++stats.frames;
+    stats.scale_sum += current_scale;
+    stats.gpu_ms += gpu_ms;
+    if (gpu_ms > target_ms) ++stats.over_budget;
+    if (settle) {
+	--settle;
+	return false;
+    }
+    average_ms = average_ms > 0.0 ? average_ms + (gpu_ms - average_ms) * AVERAGE_WEIGHT : gpu_ms;
+
+    bool over = average_ms > target_ms;
+    bool under = average_ms < target_ms * headroom;
+    if (!over && !under) return false;
+
+    float desired = current_scale * static_cast<float>(std::sqrt(target_ms * (1.0 + headroom) * 0.5 / average_ms));
+    desired = quantize(std::clamp(desired, current_scale - MAX_CHANGE, current_scale + MAX_CHANGE));
+    if (over) desired = std::min(desired, current_scale - SCALE_STEP);
+    else desired = std::max(desired, current_scale + SCALE_STEP);
+    desired = std::clamp(desired, min_scale, max_scale);
+    if (std::fabs(desired - current_scale) < 0.5f * SCALE_STEP) return false;
+
+    current_scale = desired;
+    average_ms = 0.0;
+    settle = SETTLE_FRAMES;
+    ++stats.changes;
+    return true;
+}
@@ -0,0 +1,159 @@
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "scene.h"
+
+static uint64_t align_up(uint64_t offset) {
+    return (offset + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT;
+}
+
+SceneData build_scene(const std::vector<glm::mat4> &transforms, const AABB &mesh_bounds, const std::vector<SceneMaterial> &materials) {
+    std::vector<AABB> bounds(transforms.size());
+    for (std::size_t i = 0; i < transforms.size(); ++i)
+	bounds[i] = mesh_bounds.transformed(transforms[i]);
+    BVH bvh;
+    bvh.build(bounds);
+
+    SceneData scene;
+    const std::vector<uint32_t> &order = bvh.get_indices();
+    scene.transforms.resize(order.size());
+    scene.bounds.resize(order.size());
+    scene.object_meshes.assign(order.size(), 0);
+    scene.object_materials.resize(order.size());
+    scene.bvh_indices.resize(order.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+	scene.transforms[i] = transforms[order[i]];
+	scene.bounds[i] = bounds[order[i]];
+	scene.object_materials[i] = materials.empty() ? 0 : order[i] % static_cast<uint32_t>(materials.size());
+	scene.bvh_indices[i] = i;
+    }
+    scene.bvh_nodes = bvh.get_nodes();
+    scene.meshes = {{mesh_bounds}};
+    scene.materials = materials;
+    return scene;
+}
+
+template <typename T>
+static void place(SceneSection &section, const std::vector<T> &data, uint64_t &offset) {
+    section = {offset, data.size()};
+    offset = align_up(offset + sizeof(T) * data.size());
+}
+
+template <typename T>
+static void write_section(std::ofstream &out, const SceneSection &section, const std::vector<T> &data) {
+    out.seekp(static_cast<std::streamoff>(section.offset));
+    out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(sizeof(T) * data.size()));
+}
+
+void write_scene(const std::string &path, const SceneData &scene) {
+    SceneHeader header {};
+    header.magic = SCENE_MAGIC;
+    header.version = SCENE_VERSION;
+    uint64_t offset = align_up(sizeof(SceneHeader));
+    place(header.transforms, scene.transforms, offset);
+    place(header.bounds, scene.bounds, offset);
+    place(header.object_meshes, scene.object_meshes, offset);
+    place(header.object_materials, scene.object_materials, offset);
+    place(header.meshes, scene.meshes, offset);
+    place(header.materials, scene.materials, offset);
+    place(header.bvh_nodes, scene.bvh_nodes, offset);
+    place(header.bvh_indices, scene.bvh_indices, offset);
+    header.file_size = offset;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Failed to open " + path);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_section(out, header.transforms, scene.transforms);
+    write_section(out, header.bounds, scene.bounds);
+    write_section(out, header.object_meshes, scene.object_meshes);
+    write_section(out, header.object_materials, scene.object_materials);
+    write_section(out, header.meshes, scene.meshes);
+    write_section(out, header.materials, scene.materials);
+    write_section(out, header.bvh_nodes, scene.bvh_nodes);
+    write_section(out, header.bvh_indices, scene.bvh_indices);
+    out.seekp(static_cast<std::streamoff>(header.file_size - 1));
+    out.put('\0');
+    if (!out) throw std::runtime_error("Failed to write " + path);
+}
+
+SceneFile::SceneFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open " + path);
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) || static_cast<std::size_t>(file_stat.st_size) < sizeof(SceneHeader)) {
+	close(fd);
+	throw std::runtime_error(path + " is not a scene file");
+    }
+    mapped_size = static_cast<std::size_t>(file_stat.st_size);
+    void *data = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) throw std::runtime_error("Failed to map " + path);
+    base = static_cast<const uint8_t*>(data);
+    header = reinterpret_cast<const SceneHeader*>(base);
+    try {
+	validate(path);
+    }
+    catch (...) {
+	munmap(data, mapped_size);
+	throw;
+    }
+}
+
+SceneFile::~SceneFile() {
+    munmap(const_cast<uint8_t*>(base), mapped_size);
+}
+
+void SceneFile::validate(const std::string &path) const {
+    if (header->magic != SCENE_MAGIC) throw std::runtime_error(path + " is not a scene file");
+    if (header->version != SCENE_VERSION)
+	throw std::runtime_error(path + " has scene version " + std::to_string(header->version) + ", expected " + std::to_string(SCENE_VERSION));
+    if (header->file_size != mapped_size) throw std::runtime_error(path + " is truncated");
+
+    auto check = [this, &path](const SceneSection &s, std::size_t element_size, const char *name) {
+	if (s.offset % SCENE_ALIGNMENT || s.offset < sizeof(SceneHeader) || s.offset > mapped_size || s.count > (mapped_size - s.offset) / element_size)
+	    throw std::runtime_error(path + ": " + name + " section out of bounds");
+    };
+    check(header->transforms, sizeof(glm::mat4), "transform");
+    check(header->bounds, sizeof(AABB), "bounds");
+    check(header->object_meshes, sizeof(uint32_t), "object mesh");
+    check(header->object_materials, sizeof(uint32_t), "object material");
+    check(header->meshes, sizeof(SceneMesh), "mesh");
+    check(header->materials, sizeof(SceneMaterial), "material");
+    check(header->bvh_nodes, sizeof(BVHNode), "BVH node");
+    check(header->bvh_indices, sizeof(uint32_t), "BVH index");
+
+    std::size_t objects = object_count();
+    if (header->bounds.count != objects || header->object_meshes.count != objects || header->object_materials.count != objects || header->bvh_indices.count != objects)
+	throw std::runtime_error(path + ": per-object sections disagree on the object count");
+    if (objects && (!header->meshes.count || !header->bvh_nodes.count))
+	throw std::runtime_error(path + ": objects without a mesh table or BVH");
+
+    for (std::size_t i = 0; i < objects; ++i) {
+	if (object_meshes()[i] >= mesh_count()) throw std::runtime_error(path + ": object " + std::to_string(i) + " references a missing mesh");
+	if (material_count() && object_materials()[i] >= material_count()) throw std::runtime_error(path + ": object " + std::to_string(i) + " references a missing material");
+	if (bvh_indices()[i] >= objects) throw std::runtime_error(path + ": BVH index " + std::to_string(i) + " out of range");
+    }
+
+    // Children follow their parent, so one forward pass sees every parent before its children.
+    std::vector<uint32_t> depth(bvh_node_count(), 0);
+    if (!depth.empty()) depth[0] = 1;
+    for (std::size_t i = 0; i < depth.size(); ++i) {
+	const BVHNode &node = bvh_nodes()[i];
+	if (!depth[i]) throw std::runtime_error(path + ": BVH node " + std::to_string(i) + " is unreachable");
+	if (node.count) {
+	    if (static_cast<uint64_t>(node.right_or_first) + node.count > objects) throw std::runtime_error(path + ": BVH leaf " + std::to_string(i) + " out of range");
+	    continue;
+	}
+	if (node.right_or_first <= i + 1 || node.right_or_first >= depth.size()) throw std::runtime_error(path + ": BVH node " + std::to_string(i) + " has children out of range");
+	if (depth[i] >= BVH::STACK_SIZE) throw std::runtime_error(path + ": BVH is deeper than the traversal stack");
+	for (std::size_t child : {i + 1, static_cast<std::size_t>(node.right_or_first)}) {
+	    if (depth[child]) throw std::runtime_error(path + ": BVH node " + std::to_string(child) + " has more than one parent");
+	    depth[child] = depth[i] + 1;
+	}
+    }
+}
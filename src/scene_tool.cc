@@ -0,0 +1,56 @@
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "scene.h"
+
+static constexpr float SPACING = 1.25f;
+static constexpr float TILE_AMPLITUDE = 0.05f;
+
+static const std::vector<SceneMaterial> palette = {
+    {{0.8f, 0.8f, 0.8f, 1.0f}, 0.5f, 0.0f, 0, 0},
+    {{0.9f, 0.3f, 0.2f, 1.0f}, 0.3f, 0.0f, 0, 0},
+    {{0.2f, 0.6f, 0.9f, 1.0f}, 0.7f, 0.0f, 0, 0},
+    {{0.9f, 0.8f, 0.4f, 1.0f}, 0.2f, 1.0f, 0, 0},
+};
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+	std::cerr << "Usage: " << argv[0] << " <output> <object count> [grid|scatter]" << std::endl;
+	return 1;
+    }
+    std::string path = argv[1];
+    std::size_t object_count = std::stoull(argv[2]);
+    bool scatter = argc > 3 && !strcmp(argv[3], "scatter");
+    if (!object_count) {
+	std::cerr << "A scene needs at least one object" << std::endl;
+	return 1;
+    }
+
+    std::size_t side = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(object_count))));
+    float extent = SPACING * static_cast<float>(side);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> position(-0.5f * extent, 0.5f * extent), angle(0.0f, 6.2831853f), scale(0.5f, 1.5f);
+    std::vector<glm::mat4> transforms(object_count);
+    for (std::size_t i = 0; i < object_count; ++i) {
+	if (scatter) {
+	    glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(position(rng), position(rng), 0.0f));
+	    transform = glm::rotate(transform, angle(rng), glm::vec3(0.0f, 0.0f, 1.0f));
+	    transforms[i] = glm::scale(transform, glm::vec3(scale(rng)));
+	}
+	else {
+	    float origin = -0.5f * SPACING * static_cast<float>(side - 1);
+	    transforms[i] = glm::translate(glm::mat4(1.0f), glm::vec3(origin + SPACING * static_cast<float>(i % side), origin + SPACING * static_cast<float>(i / side), 0.0f));
+	}
+    }
+
+    AABB tile_bounds {glm::vec3(-0.5f, -0.5f, -TILE_AMPLITUDE), glm::vec3(0.5f, 0.5f, TILE_AMPLITUDE)};
+    SceneData scene = build_scene(transforms, tile_bounds, palette);
+    write_scene(path, scene);
+    std::cout << "Wrote " << object_count << " objects, " << scene.bvh_nodes.size() << " BVH nodes to " << path << std::endl;
+    return 0;
+}
@@ -0,0 +1,802 @@
+#include <algorithm>
+#include <iostream>
+
+#include "stream.h"
+
+static constexpr std::size_t SETUP_FLUSH_BYTES = 1 << 20;
+
+template <typename T>
+static const T *find_chained(const void *next, VkStructureType type) {
+    for (auto chained = static_cast<const VkBaseInStructure*>(next); chained; chained = chained->pNext)
+	if (chained->sType == type) return reinterpret_cast<const T*>(chained);
+    return nullptr;
+}
+
+template <typename T>
+static T unchained(const T &info) {
+    T copy = info;
+    copy.pNext = nullptr;
+    return copy;
+}
+
+static const char *const feature_names[] = {
+    "robustBufferAccess", "fullDrawIndexUint32", "imageCubeArray", "independentBlend", "geometryShader", "tessellationShader",
+    "sampleRateShading", "dualSrcBlend", "logicOp", "multiDrawIndirect", "drawIndirectFirstInstance", "depthClamp", "depthBiasClamp",
+    "fillModeNonSolid", "depthBounds", "wideLines", "largePoints", "alphaToOne", "multiViewport", "samplerAnisotropy",
+    "textureCompressionETC2", "textureCompressionASTC_LDR", "textureCompressionBC", "occlusionQueryPrecise", "pipelineStatisticsQuery",
+    "vertexPipelineStoresAndAtomics", "fragmentStoresAndAtomics", "shaderTessellationAndGeometryPointSize", "shaderImageGatherExtended",
+    "shaderStorageImageExtendedFormats", "shaderStorageImageMultisample", "shaderStorageImageReadWithoutFormat",
+    "shaderStorageImageWriteWithoutFormat", "shaderUniformBufferArrayDynamicIndexing", "shaderSampledImageArrayDynamicIndexing",
+    "shaderStorageBufferArrayDynamicIndexing", "shaderStorageImageArrayDynamicIndexing", "shaderClipDistance", "shaderCullDistance",
+    "shaderFloat64", "shaderInt64", "shaderInt16", "shaderResourceResidency", "shaderResourceMinLod", "sparseBinding",
+    "sparseResidencyBuffer", "sparseResidencyImage2D", "sparseResidencyImage3D", "sparseResidency2Samples", "sparseResidency4Samples",
+    "sparseResidency8Samples", "sparseResidency16Samples", "sparseResidencyAliased", "variableMultisampleRate", "inheritedQueries",
+};
+
+static_assert(std::size(feature_names) == sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32));
+
+std::vector<std::string> unsupported_features(const StreamHeader &header, VkPhysicalDevice physical_device) {
+    VkPhysicalDeviceMultiviewFeatures multiview_features {};
+    multiview_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+    VkPhysicalDeviceFeatures2 supported {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &multiview_features;
+    vkGetPhysicalDeviceFeatures2(physical_device, &supported);
+
+    VkBool32 enabled[std::size(feature_names)], available[std::size(feature_names)];
+    memcpy(enabled, &header.features, sizeof(enabled));
+    memcpy(available, &supported.features, sizeof(available));
+    std::vector<std::string> missing;
+    for (std::size_t i = 0; i < std::size(feature_names); ++i)
+	if (enabled[i] && !available[i]) missing.push_back(feature_names[i]);
+    if (header.multiview && !multiview_features.multiview) missing.push_back("multiview");
+    return missing;
+}
+
+void StreamRecorder::open(const std::string &new_path, uint64_t new_frame_limit, VkPhysicalDevice physical_device, const VkDeviceCreateInfo &device_create_info) {
+    path = new_path;
+    frame_limit = std::max<uint64_t>(new_frame_limit, 1);
+    out.open(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Failed to open " + path);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+    header.magic = STREAM_MAGIC;
+    header.version = STREAM_VERSION;
+    header.api_version = properties.apiVersion;
+    header.driver_version = properties.driverVersion;
+    header.vendor_id = properties.vendorID;
+    header.device_id = properties.deviceID;
+    memcpy(header.device_name, properties.deviceName, sizeof(header.device_name));
+    if (device_create_info.pEnabledFeatures) header.features = *device_create_info.pEnabledFeatures;
+    auto multiview = find_chained<VkPhysicalDeviceMultiviewFeatures>(device_create_info.pNext, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES);
+    header.multiview = multiview ? multiview->multiview : VK_FALSE;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    bytes = sizeof(header);
+    active = true;
+}
+
+void StreamRecorder::frame() {
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (framing) ++header.frames;
+    commit();
+    if (header.frames >= frame_limit) {
+	close();
+	return;
+    }
+    framing = true;
+    write(StreamOp::FRAME);
+}
+
+void StreamRecorder::finish() {
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (framing) pending.clear();
+    close();
+}
+
+void StreamRecorder::begin(StreamOp op) {
+    put(op);
+    put(uint32_t(0));
+    record_start = pending.size();
+}
+
+void StreamRecorder::end() {
+    auto size = static_cast<uint32_t>(pending.size() - record_start);
+    memcpy(pending.data() + record_start - sizeof(size), &size, sizeof(size));
+    if (!framing && pending.size() >= SETUP_FLUSH_BYTES) commit();
+}
+
+void StreamRecorder::commit() {
+    out.write(reinterpret_cast<const char*>(pending.data()), static_cast<std::streamsize>(pending.size()));
+    bytes += pending.size();
+    pending.clear();
+}
+
+void StreamRecorder::close() {
+    write(StreamOp::END);
+    commit();
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    active = false;
+    std::cout << "Recorded " << header.frames << " frames, " << ids.size() << " objects to " << path << " (" << static_cast<double>(bytes) / (1024.0 * 1024.0) << " MiB)" << std::endl;
+    if (!header.frames) std::cerr << "Stream " << path << " holds no complete frame and cannot be replayed" << std::endl;
+}
+
+VkResult StreamRecorder::allocate_memory(VkDevice device, const VkMemoryAllocateInfo *allocate_info, const VkAllocationCallbacks *allocator, VkDeviceMemory *memory) {
+    VkResult result = vkAllocateMemory(device, allocate_info, allocator, memory);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    memory_sizes[reinterpret_cast<uint64_t>(*memory)] = allocate_info->allocationSize;
+    write(StreamOp::ALLOCATE_MEMORY, assign(*memory), allocate_info->allocationSize, memory_properties.memoryTypes[allocate_info->memoryTypeIndex].propertyFlags);
+    return result;
+}
+
+VkResult StreamRecorder::map_memory(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, void **data) {
+    VkResult result = vkMapMemory(device, memory, offset, size, flags, data);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size == VK_WHOLE_SIZE) size = memory_sizes.at(reinterpret_cast<uint64_t>(memory)) - offset;
+    mappings[reinterpret_cast<uint64_t>(memory)] = {offset, size, *data};
+    return result;
+}
+
+void StreamRecorder::unmap_memory(VkDevice device, VkDeviceMemory memory) {
+    if (active) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = mappings.find(reinterpret_cast<uint64_t>(memory));
+	if (found != mappings.end()) {
+	    write(StreamOp::WRITE_MEMORY, id(memory), found->second.offset, StreamBytes {found->second.data, found->second.size});
+	    mappings.erase(found);
+	}
+    }
+    vkUnmapMemory(device, memory);
+}
+
+void StreamRecorder::write_memory(VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, const void *data) {
+    if (!active || !size) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::WRITE_MEMORY, id(memory), offset, StreamBytes {data, size});
+}
+
+VkResult StreamRecorder::create_buffer(VkDevice device, const VkBufferCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkBuffer *buffer) {
+    VkResult result = vkCreateBuffer(device, create_info, allocator, buffer);
+    if (!active || result != VK_SUCCESS) return result;
+    VkBufferCreateInfo info = unchained(*create_info);
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    info.queueFamilyIndexCount = 0;
+    info.pQueueFamilyIndices = nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_BUFFER, assign(*buffer), info);
+    return result;
+}
+
+VkResult StreamRecorder::bind_buffer_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset) {
+    VkResult result = vkBindBufferMemory(device, buffer, memory, offset);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::BIND_BUFFER_MEMORY, id(buffer), id(memory), offset);
+    return result;
+}
+
+VkResult StreamRecorder::create_image(VkDevice device, const VkImageCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkImage *image) {
+    VkResult result = vkCreateImage(device, create_info, allocator, image);
+    if (!active || result != VK_SUCCESS) return result;
+    VkImageCreateInfo info = unchained(*create_info);
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    info.queueFamilyIndexCount = 0;
+    info.pQueueFamilyIndices = nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_IMAGE, assign(*image), info);
+    return result;
+}
+
+VkResult StreamRecorder::bind_image_memory(VkDevice device, VkImage image, VkDeviceMemory memory, VkDeviceSize offset) {
+    VkResult result = vkBindImageMemory(device, image, memory, offset);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::BIND_IMAGE_MEMORY, id(image), id(memory), offset);
+    return result;
+}
+
+void StreamRecorder::swap_chain_images(const std::vector<VkImage> &images, VkFormat format, VkExtent2D extent, VkImageUsageFlags usage) {
+    if (!active) return;
+    VkImageCreateInfo info {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    info.imageType = VK_IMAGE_TYPE_2D;
+    info.format = format;
+    info.extent = {extent.width, extent.height, 1};
+    info.mipLevels = 1;
+    info.arrayLayers = 1;
+    info.samples = VK_SAMPLE_COUNT_1_BIT;
+    info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    info.usage = usage | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (VkImage image : images) {
+	uint32_t image_id = assign(image), memory_id = next_id++;
+	write(StreamOp::CREATE_IMAGE, image_id, info);
+	write(StreamOp::ALLOCATE_MEMORY, memory_id, VkDeviceSize(0), VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+	write(StreamOp::BIND_IMAGE_MEMORY, image_id, memory_id, VkDeviceSize(0));
+    }
+}
+
+VkResult StreamRecorder::create_image_view(VkDevice device, const VkImageViewCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkImageView *view) {
+    VkResult result = vkCreateImageView(device, create_info, allocator, view);
+    if (!active || result != VK_SUCCESS) return result;
+    VkImageViewCreateInfo info = unchained(*create_info);
+    info.image = VK_NULL_HANDLE;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_IMAGE_VIEW, assign(*view), id(create_info->image), info);
+    return result;
+}
+
+VkResult StreamRecorder::create_sampler(VkDevice device, const VkSamplerCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkSampler *sampler) {
+    VkResult result = vkCreateSampler(device, create_info, allocator, sampler);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_SAMPLER, assign(*sampler), unchained(*create_info));
+    return result;
+}
+
+VkResult StreamRecorder::create_shader_module(VkDevice device, const VkShaderModuleCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkShaderModule *shader_module) {
+    VkResult result = vkCreateShaderModule(device, create_info, allocator, shader_module);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_SHADER_MODULE, assign(*shader_module), StreamBytes {create_info->pCode, create_info->codeSize});
+    return result;
+}
+
+VkResult StreamRecorder::create_render_pass(VkDevice device, const VkRenderPassCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkRenderPass *render_pass) {
+    VkResult result = vkCreateRenderPass(device, create_info, allocator, render_pass);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CREATE_RENDER_PASS);
+    put(assign(*render_pass));
+    put(create_info->flags);
+    put_array(create_info->pAttachments, create_info->attachmentCount);
+    put(create_info->subpassCount);
+    for (uint32_t i = 0; i < create_info->subpassCount; ++i) {
+	const VkSubpassDescription &subpass = create_info->pSubpasses[i];
+	put(subpass.flags);
+	put(subpass.pipelineBindPoint);
+	put_array(subpass.pInputAttachments, subpass.inputAttachmentCount);
+	put_array(subpass.pColorAttachments, subpass.colorAttachmentCount);
+	put_array(subpass.pResolveAttachments, subpass.pResolveAttachments ? subpass.colorAttachmentCount : 0);
+	put_array(subpass.pDepthStencilAttachment, subpass.pDepthStencilAttachment ? 1u : 0u);
+	put_array(subpass.pPreserveAttachments, subpass.preserveAttachmentCount);
+    }
+    put_array(create_info->pDependencies, create_info->dependencyCount);
+    auto multiview = find_chained<VkRenderPassMultiviewCreateInfo>(create_info->pNext, VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO);
+    put_array(multiview ? multiview->pViewMasks : nullptr, multiview ? multiview->subpassCount : 0);
+    put_array(multiview ? multiview->pViewOffsets : nullptr, multiview ? multiview->dependencyCount : 0);
+    put_array(multiview ? multiview->pCorrelationMasks : nullptr, multiview ? multiview->correlationMaskCount : 0);
+    end();
+    return result;
+}
+
+VkResult StreamRecorder::create_framebuffer(VkDevice device, const VkFramebufferCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkFramebuffer *framebuffer) {
+    VkResult result = vkCreateFramebuffer(device, create_info, allocator, framebuffer);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_FRAMEBUFFER, assign(*framebuffer), create_info->flags, id(create_info->renderPass), ids_of(create_info->pAttachments, create_info->attachmentCount),
+	  create_info->width, create_info->height, create_info->layers);
+    return result;
+}
+
+VkResult StreamRecorder::create_descriptor_set_layout(VkDevice device, const VkDescriptorSetLayoutCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkDescriptorSetLayout *layout) {
+    VkResult result = vkCreateDescriptorSetLayout(device, create_info, allocator, layout);
+    if (!active || result != VK_SUCCESS) return result;
+    std::vector<VkDescriptorSetLayoutBinding> bindings(create_info->pBindings, create_info->pBindings + create_info->bindingCount);
+    for (auto& binding : bindings) {
+	if (binding.pImmutableSamplers) throw std::runtime_error("Immutable samplers are not recorded");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_DESCRIPTOR_SET_LAYOUT, assign(*layout), create_info->flags, bindings);
+    return result;
+}
+
+VkResult StreamRecorder::create_pipeline_layout(VkDevice device, const VkPipelineLayoutCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkPipelineLayout *layout) {
+    VkResult result = vkCreatePipelineLayout(device, create_info, allocator, layout);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CREATE_PIPELINE_LAYOUT);
+    put(assign(*layout));
+    put(create_info->flags);
+    put(ids_of(create_info->pSetLayouts, create_info->setLayoutCount));
+    put_array(create_info->pPushConstantRanges, create_info->pushConstantRangeCount);
+    end();
+    return result;
+}
+
+void StreamRecorder::put_stage(const VkPipelineShaderStageCreateInfo &stage) {
+    put(stage.flags);
+    put(stage.stage);
+    put(id(stage.module));
+    put(std::string_view(stage.pName));
+    const VkSpecializationInfo *specialization = stage.pSpecializationInfo;
+    put_array(specialization ? specialization->pMapEntries : nullptr, specialization ? specialization->mapEntryCount : 0);
+    put(StreamBytes {specialization ? specialization->pData : nullptr, specialization ? specialization->dataSize : 0});
+}
+
+VkResult StreamRecorder::create_graphics_pipelines(VkDevice device, VkPipelineCache cache, uint32_t count, const VkGraphicsPipelineCreateInfo *create_infos, const VkAllocationCallbacks *allocator, VkPipeline *pipelines) {
+    VkResult result = vkCreateGraphicsPipelines(device, cache, count, create_infos, allocator, pipelines);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t i = 0; i < count; ++i) {
+	const VkGraphicsPipelineCreateInfo &info = create_infos[i];
+	if (info.pTessellationState) throw std::runtime_error("Tessellation state is not recorded");
+	begin(StreamOp::CREATE_GRAPHICS_PIPELINE);
+	put(assign(pipelines[i]));
+	put(info.flags);
+	put(id(info.layout));
+	put(id(info.renderPass));
+	put(info.subpass);
+	put(info.stageCount);
+	for (uint32_t stage = 0; stage < info.stageCount; ++stage)
+	    put_stage(info.pStages[stage]);
+
+	const VkPipelineVertexInputStateCreateInfo *vertex_input = info.pVertexInputState;
+	put_array(vertex_input ? vertex_input->pVertexBindingDescriptions : nullptr, vertex_input ? vertex_input->vertexBindingDescriptionCount : 0);
+	put_array(vertex_input ? vertex_input->pVertexAttributeDescriptions : nullptr, vertex_input ? vertex_input->vertexAttributeDescriptionCount : 0);
+	put(unchained(*info.pInputAssemblyState));
+	const VkPipelineViewportStateCreateInfo *viewport = info.pViewportState;
+	put(viewport ? viewport->viewportCount : 0);
+	put(viewport ? viewport->scissorCount : 0);
+	put_array(viewport ? viewport->pViewports : nullptr, viewport && viewport->pViewports ? viewport->viewportCount : 0);
+	put_array(viewport ? viewport->pScissors : nullptr, viewport && viewport->pScissors ? viewport->scissorCount : 0);
+	put(unchained(*info.pRasterizationState));
+
+	VkPipelineMultisampleStateCreateInfo multisample {};
+	if (info.pMultisampleState) multisample = unchained(*info.pMultisampleState);
+	uint32_t sample_mask_words = multisample.pSampleMask ? (static_cast<uint32_t>(multisample.rasterizationSamples) + 31) / 32 : 0;
+	const VkSampleMask *sample_mask = multisample.pSampleMask;
+	multisample.pSampleMask = nullptr;
+	put(multisample);
+	put_array(sample_mask, sample_mask_words);
+
+	put(uint8_t(info.pDepthStencilState != nullptr));
+	if (info.pDepthStencilState) put(unchained(*info.pDepthStencilState));
+	VkPipelineColorBlendStateCreateInfo color_blend {};
+	if (info.pColorBlendState) color_blend = unchained(*info.pColorBlendState);
+	const VkPipelineColorBlendAttachmentState *blend_attachments = color_blend.pAttachments;
+	color_blend.pAttachments = nullptr;
+	put(color_blend);
+	put_array(blend_attachments, blend_attachments ? color_blend.attachmentCount : 0);
+	const VkPipelineDynamicStateCreateInfo *dynamic = info.pDynamicState;
+	put_array(dynamic ? dynamic->pDynamicStates : nullptr, dynamic ? dynamic->dynamicStateCount : 0);
+	end();
+    }
+    return result;
+}
+
+VkResult StreamRecorder::create_compute_pipelines(VkDevice device, VkPipelineCache cache, uint32_t count, const VkComputePipelineCreateInfo *create_infos, const VkAllocationCallbacks *allocator, VkPipeline *pipelines) {
+    VkResult result = vkCreateComputePipelines(device, cache, count, create_infos, allocator, pipelines);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t i = 0; i < count; ++i) {
+	begin(StreamOp::CREATE_COMPUTE_PIPELINE);
+	put(assign(pipelines[i]));
+	put(create_infos[i].flags);
+	put(id(create_infos[i].layout));
+	put_stage(create_infos[i].stage);
+	end();
+    }
+    return result;
+}
+
+VkResult StreamRecorder::create_descriptor_pool(VkDevice device, const VkDescriptorPoolCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkDescriptorPool *pool) {
+    VkResult result = vkCreateDescriptorPool(device, create_info, allocator, pool);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CREATE_DESCRIPTOR_POOL);
+    put(assign(*pool));
+    put(create_info->flags);
+    put(create_info->maxSets);
+    put_array(create_info->pPoolSizes, create_info->poolSizeCount);
+    end();
+    return result;
+}
+
+VkResult StreamRecorder::allocate_descriptor_sets(VkDevice device, const VkDescriptorSetAllocateInfo *allocate_info, VkDescriptorSet *sets) {
+    VkResult result = vkAllocateDescriptorSets(device, allocate_info, sets);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint32_t> set_ids(allocate_info->descriptorSetCount);
+    for (uint32_t i = 0; i < allocate_info->descriptorSetCount; ++i) set_ids[i] = assign(sets[i]);
+    write(StreamOp::ALLOCATE_DESCRIPTOR_SETS, id(allocate_info->descriptorPool), ids_of(allocate_info->pSetLayouts, allocate_info->descriptorSetCount), set_ids);
+    return result;
+}
+
+void StreamRecorder::update_descriptor_sets(VkDevice device, uint32_t write_count, const VkWriteDescriptorSet *writes, uint32_t copy_count, const VkCopyDescriptorSet *copies) {
+    vkUpdateDescriptorSets(device, write_count, writes, copy_count, copies);
+    if (!active) return;
+    if (copy_count) throw std::runtime_error("Descriptor copies are not recorded");
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::UPDATE_DESCRIPTOR_SETS);
+    put(write_count);
+    for (uint32_t i = 0; i < write_count; ++i) {
+	const VkWriteDescriptorSet &descriptor_write = writes[i];
+	put(id(descriptor_write.dstSet));
+	put(descriptor_write.dstBinding);
+	put(descriptor_write.dstArrayElement);
+	put(descriptor_write.descriptorType);
+	put(descriptor_write.descriptorCount);
+	for (uint32_t element = 0; element < descriptor_write.descriptorCount; ++element) {
+	    switch (descriptor_write.descriptorType) {
+	    case VK_DESCRIPTOR_TYPE_SAMPLER:
+	    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+	    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+	    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+	    case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: {
+		const VkDescriptorImageInfo &image_info = descriptor_write.pImageInfo[element];
+		put(id(image_info.sampler));
+		put(id(image_info.imageView));
+		put(image_info.imageLayout);
+		break;
+	    }
+	    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+	    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+	    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+	    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC: {
+		const VkDescriptorBufferInfo &buffer_info = descriptor_write.pBufferInfo[element];
+		put(id(buffer_info.buffer));
+		put(buffer_info.offset);
+		put(buffer_info.range);
+		break;
+	    }
+	    default: throw std::runtime_error("Descriptor type " + std::to_string(descriptor_write.descriptorType) + " is not recorded");
+	    }
+	}
+    }
+    end();
+}
+
+VkResult StreamRecorder::create_query_pool(VkDevice device, const VkQueryPoolCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkQueryPool *pool) {
+    VkResult result = vkCreateQueryPool(device, create_info, allocator, pool);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_QUERY_POOL, assign(*pool), unchained(*create_info));
+    return result;
+}
+
+VkResult StreamRecorder::create_command_pool(VkDevice device, const VkCommandPoolCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkCommandPool *pool) {
+    VkResult result = vkCreateCommandPool(device, create_info, allocator, pool);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_COMMAND_POOL, assign(*pool), create_info->flags);
+    return result;
+}
+
+VkResult StreamRecorder::allocate_command_buffers(VkDevice device, const VkCommandBufferAllocateInfo *allocate_info, VkCommandBuffer *command_buffers) {
+    VkResult result = vkAllocateCommandBuffers(device, allocate_info, command_buffers);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint32_t> command_buffer_ids(allocate_info->commandBufferCount);
+    for (uint32_t i = 0; i < allocate_info->commandBufferCount; ++i) command_buffer_ids[i] = assign(command_buffers[i]);
+    write(StreamOp::ALLOCATE_COMMAND_BUFFERS, id(allocate_info->commandPool), allocate_info->level, command_buffer_ids);
+    return result;
+}
+
+void StreamRecorder::free_command_buffers(VkDevice device, VkCommandPool pool, uint32_t count, const VkCommandBuffer *command_buffers) {
+    if (active) {
+	std::lock_guard<std::mutex> lock(mutex);
+	write(StreamOp::FREE_COMMAND_BUFFERS, id(pool), ids_of(command_buffers, count));
+    }
+    vkFreeCommandBuffers(device, pool, count, command_buffers);
+}
+
+VkResult StreamRecorder::create_fence(VkDevice device, const VkFenceCreateInfo *create_info, const VkAllocationCallbacks *allocator, VkFence *fence) {
+    VkResult result = vkCreateFence(device, create_info, allocator, fence);
+    if (!active || result != VK_SUCCESS) return result;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CREATE_FENCE, assign(*fence), create_info->flags);
+    return result;
+}
+
+VkResult StreamRecorder::wait_for_fences(VkDevice device, uint32_t count, const VkFence *fences, VkBool32 wait_all, uint64_t timeout) {
+    if (active) {
+	std::lock_guard<std::mutex> lock(mutex);
+	write(StreamOp::WAIT_FOR_FENCES, ids_of(fences, count), wait_all);
+    }
+    return vkWaitForFences(device, count, fences, wait_all, timeout);
+}
+
+VkResult StreamRecorder::reset_fences(VkDevice device, uint32_t count, const VkFence *fences) {
+    if (active) {
+	std::lock_guard<std::mutex> lock(mutex);
+	write(StreamOp::RESET_FENCES, ids_of(fences, count));
+    }
+    return vkResetFences(device, count, fences);
+}
+
+VkResult StreamRecorder::queue_submit(VkQueue queue, uint32_t count, const VkSubmitInfo *submits, VkFence fence) {
+    if (active) {
+	std::lock_guard<std::mutex> lock(mutex);
+	begin(StreamOp::QUEUE_SUBMIT);
+	put(id(fence));
+	put(count);
+	for (uint32_t i = 0; i < count; ++i)
+	    put(ids_of(submits[i].pCommandBuffers, submits[i].commandBufferCount));
+	end();
+    }
+    return vkQueueSubmit(queue, count, submits, fence);
+}
+
+VkResult StreamRecorder::queue_wait_idle(VkQueue queue) {
+    if (active) {
+	std::lock_guard<std::mutex> lock(mutex);
+	write(StreamOp::QUEUE_WAIT_IDLE);
+    }
+    return vkQueueWaitIdle(queue);
+}
+
+VkResult StreamRecorder::begin_command_buffer(VkCommandBuffer command_buffer, const VkCommandBufferBeginInfo *begin_info) {
+    if (active) {
+	std::lock_guard<std::mutex> lock(mutex);
+	write(StreamOp::BEGIN_COMMAND_BUFFER, id(command_buffer), begin_info->flags);
+    }
+    return vkBeginCommandBuffer(command_buffer, begin_info);
+}
+
+VkResult StreamRecorder::end_command_buffer(VkCommandBuffer command_buffer) {
+    if (active) {
+	std::lock_guard<std::mutex> lock(mutex);
+	write(StreamOp::END_COMMAND_BUFFER, id(command_buffer));
+    }
+    return vkEndCommandBuffer(command_buffer);
+}
+
+VkResult StreamRecorder::reset_command_buffer(VkCommandBuffer command_buffer, VkCommandBufferResetFlags flags) {
+    if (active) {
+	std::lock_guard<std::mutex> lock(mutex);
+	write(StreamOp::RESET_COMMAND_BUFFER, id(command_buffer), flags);
+    }
+    return vkResetCommandBuffer(command_buffer, flags);
+}
+
+void StreamRecorder::cmd_begin_render_pass(VkCommandBuffer command_buffer, const VkRenderPassBeginInfo *begin_info, VkSubpassContents contents) {
+    vkCmdBeginRenderPass(command_buffer, begin_info, contents);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_BEGIN_RENDER_PASS);
+    put(id(command_buffer));
+    put(id(begin_info->renderPass));
+    put(id(begin_info->framebuffer));
+    put(begin_info->renderArea);
+    put_array(begin_info->pClearValues, begin_info->clearValueCount);
+    put(contents);
+    end();
+}
+
+void StreamRecorder::cmd_end_render_pass(VkCommandBuffer command_buffer) {
+    vkCmdEndRenderPass(command_buffer);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_END_RENDER_PASS, id(command_buffer));
+}
+
+void StreamRecorder::cmd_bind_pipeline(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipeline pipeline) {
+    vkCmdBindPipeline(command_buffer, bind_point, pipeline);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_BIND_PIPELINE, id(command_buffer), bind_point, id(pipeline));
+}
+
+void StreamRecorder::cmd_bind_descriptor_sets(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout layout, uint32_t first_set, uint32_t count, const VkDescriptorSet *sets, uint32_t dynamic_offset_count, const uint32_t *dynamic_offsets) {
+    vkCmdBindDescriptorSets(command_buffer, bind_point, layout, first_set, count, sets, dynamic_offset_count, dynamic_offsets);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_BIND_DESCRIPTOR_SETS);
+    put(id(command_buffer));
+    put(bind_point);
+    put(id(layout));
+    put(first_set);
+    put(ids_of(sets, count));
+    put_array(dynamic_offsets, dynamic_offset_count);
+    end();
+}
+
+void StreamRecorder::cmd_bind_vertex_buffers(VkCommandBuffer command_buffer, uint32_t first_binding, uint32_t count, const VkBuffer *buffers, const VkDeviceSize *offsets) {
+    vkCmdBindVertexBuffers(command_buffer, first_binding, count, buffers, offsets);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_BIND_VERTEX_BUFFERS);
+    put(id(command_buffer));
+    put(first_binding);
+    put(ids_of(buffers, count));
+    put_array(offsets, count);
+    end();
+}
+
+void StreamRecorder::cmd_bind_index_buffer(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type) {
+    vkCmdBindIndexBuffer(command_buffer, buffer, offset, index_type);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_BIND_INDEX_BUFFER, id(command_buffer), id(buffer), offset, index_type);
+}
+
+void StreamRecorder::cmd_push_constants(VkCommandBuffer command_buffer, VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void *values) {
+    vkCmdPushConstants(command_buffer, layout, stages, offset, size, values);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_PUSH_CONSTANTS, id(command_buffer), id(layout), stages, offset, StreamBytes {values, size});
+}
+
+void StreamRecorder::cmd_set_viewport(VkCommandBuffer command_buffer, uint32_t first, uint32_t count, const VkViewport *viewports) {
+    vkCmdSetViewport(command_buffer, first, count, viewports);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_SET_VIEWPORT);
+    put(id(command_buffer));
+    put(first);
+    put_array(viewports, count);
+    end();
+}
+
+void StreamRecorder::cmd_set_scissor(VkCommandBuffer command_buffer, uint32_t first, uint32_t count, const VkRect2D *scissors) {
+    vkCmdSetScissor(command_buffer, first, count, scissors);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_SET_SCISSOR);
+    put(id(command_buffer));
+    put(first);
+    put_array(scissors, count);
+    end();
+}
+
+void StreamRecorder::cmd_draw_indexed(VkCommandBuffer command_buffer, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance) {
+    vkCmdDrawIndexed(command_buffer, index_count, instance_count, first_index, vertex_offset, first_instance);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_DRAW_INDEXED, id(command_buffer), index_count, instance_count, first_index, vertex_offset, first_instance);
+}
+
+void StreamRecorder::cmd_draw_indexed_indirect(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, uint32_t draw_count, uint32_t stride) {
+    vkCmdDrawIndexedIndirect(command_buffer, buffer, offset, draw_count, stride);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_DRAW_INDEXED_INDIRECT, id(command_buffer), id(buffer), offset, draw_count, stride);
+}
+
+void StreamRecorder::cmd_dispatch(VkCommandBuffer command_buffer, uint32_t x, uint32_t y, uint32_t z) {
+    vkCmdDispatch(command_buffer, x, y, z);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_DISPATCH, id(command_buffer), x, y, z);
+}
+
+void StreamRecorder::cmd_dispatch_indirect(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset) {
+    vkCmdDispatchIndirect(command_buffer, buffer, offset);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_DISPATCH_INDIRECT, id(command_buffer), id(buffer), offset);
+}
+
+void StreamRecorder::cmd_pipeline_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages, VkDependencyFlags dependencies,
+					  uint32_t memory_barrier_count, const VkMemoryBarrier *memory_barriers, uint32_t buffer_barrier_count, const VkBufferMemoryBarrier *buffer_barriers,
+					  uint32_t image_barrier_count, const VkImageMemoryBarrier *image_barriers) {
+    vkCmdPipelineBarrier(command_buffer, src_stages, dst_stages, dependencies, memory_barrier_count, memory_barriers, buffer_barrier_count, buffer_barriers, image_barrier_count, image_barriers);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_PIPELINE_BARRIER);
+    put(id(command_buffer));
+    put(src_stages);
+    put(dst_stages);
+    put(dependencies);
+    put(memory_barrier_count);
+    for (uint32_t i = 0; i < memory_barrier_count; ++i)
+	put(unchained(memory_barriers[i]));
+    put(buffer_barrier_count);
+    for (uint32_t i = 0; i < buffer_barrier_count; ++i) {
+	VkBufferMemoryBarrier barrier = unchained(buffer_barriers[i]);
+	barrier.buffer = VK_NULL_HANDLE;
+	put(id(buffer_barriers[i].buffer));
+	put(barrier);
+    }
+    put(image_barrier_count);
+    for (uint32_t i = 0; i < image_barrier_count; ++i) {
+	VkImageMemoryBarrier barrier = unchained(image_barriers[i]);
+	barrier.image = VK_NULL_HANDLE;
+	put(id(image_barriers[i].image));
+	put(barrier);
+    }
+    end();
+}
+
+void StreamRecorder::cmd_reset_query_pool(VkCommandBuffer command_buffer, VkQueryPool pool, uint32_t first, uint32_t count) {
+    vkCmdResetQueryPool(command_buffer, pool, first, count);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_RESET_QUERY_POOL, id(command_buffer), id(pool), first, count);
+}
+
+void StreamRecorder::cmd_write_timestamp(VkCommandBuffer command_buffer, VkPipelineStageFlagBits stage, VkQueryPool pool, uint32_t query) {
+    vkCmdWriteTimestamp(command_buffer, stage, pool, query);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    write(StreamOp::CMD_WRITE_TIMESTAMP, id(command_buffer), stage, id(pool), query);
+}
+
+void StreamRecorder::cmd_copy_buffer(VkCommandBuffer command_buffer, VkBuffer src, VkBuffer dst, uint32_t count, const VkBufferCopy *regions) {
+    vkCmdCopyBuffer(command_buffer, src, dst, count, regions);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_COPY_BUFFER);
+    put(id(command_buffer));
+    put(id(src));
+    put(id(dst));
+    put_array(regions, count);
+    end();
+}
+
+void StreamRecorder::cmd_copy_image(VkCommandBuffer command_buffer, VkImage src, VkImageLayout src_layout, VkImage dst, VkImageLayout dst_layout, uint32_t count, const VkImageCopy *regions) {
+    vkCmdCopyImage(command_buffer, src, src_layout, dst, dst_layout, count, regions);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_COPY_IMAGE);
+    put(id(command_buffer));
+    put(id(src));
+    put(src_layout);
+    put(id(dst));
+    put(dst_layout);
+    put_array(regions, count);
+    end();
+}
+
+void StreamRecorder::cmd_copy_image_to_buffer(VkCommandBuffer command_buffer, VkImage src, VkImageLayout src_layout, VkBuffer dst, uint32_t count, const VkBufferImageCopy *regions) {
+    vkCmdCopyImageToBuffer(command_buffer, src, src_layout, dst, count, regions);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_COPY_IMAGE_TO_BUFFER);
+    put(id(command_buffer));
+    put(id(src));
+    put(src_layout);
+    put(id(dst));
+    put_array(regions, count);
+    end();
+}
+
+void StreamRecorder::cmd_blit_image(VkCommandBuffer command_buffer, VkImage src, VkImageLayout src_layout, VkImage dst, VkImageLayout dst_layout, uint32_t count, const VkImageBlit *regions, VkFilter filter) {
+    vkCmdBlitImage(command_buffer, src, src_layout, dst, dst_layout, count, regions, filter);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_BLIT_IMAGE);
+    put(id(command_buffer));
+    put(id(src));
+    put(src_layout);
+    put(id(dst));
+    put(dst_layout);
+    put_array(regions, count);
+    put(filter);
+    end();
+}
+
+void StreamRecorder::cmd_clear_color_image(VkCommandBuffer command_buffer, VkImage image, VkImageLayout layout, const VkClearColorValue *color, uint32_t count, const VkImageSubresourceRange *ranges) {
+    vkCmdClearColorImage(command_buffer, image, layout, color, count, ranges);
+    if (!active) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    begin(StreamOp::CMD_CLEAR_COLOR_IMAGE);
+    put(id(command_buffer));
+    put(id(image));
+    put(layout);
+    put(*color);
+    put_array(ranges, count);
+    end();
+}
+
+StreamReader::StreamReader(const std::string &path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) throw std::runtime_error("Failed to open " + path);
+    data.resize(static_cast<std::size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!in) throw std::runtime_error("Failed to read " + path);
+    header = get<StreamHeader>();
+    if (header.magic != STREAM_MAGIC) throw std::runtime_error(path + " is not a command stream");
+    if (header.version != STREAM_VERSION) throw std::runtime_error(path + " has stream version " + std::to_string(header.version) + ", expected " + std::to_string(STREAM_VERSION));
+}
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <string>
+
+#include "trace.h"
+
+static std::mutex buffers_mutex;
+static std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+uint64_t trace_now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+TraceBuffer &trace_thread_buffer() {
+    thread_local TraceBuffer *buffer = nullptr;
+    if (!buffer) {
+	std::lock_guard<std::mutex> lock(buffers_mutex);
+	buffers.push_back(std::make_unique<TraceBuffer>(static_cast<uint32_t>(buffers.size() + 1)));
+	buffer = buffers.back().get();
+    }
+    return *buffer;
+}
+
+void trace_name_thread(const char *name) {
+    trace_thread_buffer().thread_name.store(name, std::memory_order_release);
+}
+
+static void write_string(std::ostream &out, const char *text) {
+    out << '"';
+    for (const char *c = text; *c; ++c) {
+	if (*c == '"' || *c == '\\') out << '\\';
+	out << *c;
+    }
+    out << '"';
+}
+
+static void write_thread_name(std::ostream &out, uint32_t thread_id, const char *name, bool &first) {
+    out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread_id << ",\"args\":{\"name\":";
+    write_string(out, name);
+    out << "}}";
+    first = false;
+}
+
+std::size_t trace_export(std::ostream &out) {
+    static constexpr uint32_t GPU_THREAD_ID = 0;
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    uint64_t origin = UINT64_MAX, dropped = 0;
+    for (const auto& buffer : buffers) {
+	std::size_t count = buffer->count.load(std::memory_order_acquire);
+	for (std::size_t i = 0; i < count; ++i) origin = std::min(origin, buffer->events[i].begin_ns);
+	dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+
+    std::size_t written = 0;
+    bool first = true;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":" << dropped << "},\"traceEvents\":[";
+    write_thread_name(out, GPU_THREAD_ID, "GPU", first);
+    for (const auto& buffer : buffers) {
+	const char *name = buffer->thread_name.load(std::memory_order_acquire);
+	std::string fallback = "thread " + std::to_string(buffer->thread_id);
+	write_thread_name(out, buffer->thread_id, name ? name : fallback.c_str(), first);
+
+	std::size_t count = buffer->count.load(std::memory_order_acquire);
+	for (std::size_t i = 0; i < count; ++i) {
+	    const TraceEvent &event = buffer->events[i];
+	    uint32_t thread_id = event.track == TraceTrack::GPU ? GPU_THREAD_ID : buffer->thread_id;
+	    out << ",\n{\"name\":";
+	    write_string(out, event.name);
+	    out << ",\"cat\":\"" << (event.track == TraceTrack::GPU ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread_id
+		<< ",\"ts\":" << static_cast<double>(event.begin_ns - origin) / 1000.0
+		<< ",\"dur\":" << static_cast<double>(event.end_ns - event.begin_ns) / 1000.0 << "}";
+	    ++written;
+	}
+    }
+    out << "\n]}" << std::endl;
+    return written;
+}